@@ -36,6 +36,7 @@ main(int argc, char *argv[])
 	int	 	 fdout, fdin;
 	enum kcgi_err	 kerr;
 	struct stat	 st;
+	struct kopts	 opts;
 	char		 buf[1024];
 
 	if (2 != argc)
@@ -70,7 +71,9 @@ main(int argc, char *argv[])
 	setenv("CONTENT_TYPE", "application/x-www-form-urlencoded", 1);
 	setenv("REQUEST_METHOD", "post", 1);
 	setenv("CONTENT_LENGTH", buf, 1);
-	kerr = kworker_child(fdout, NULL, 0, kmimetypes, KMIME__MAX, 0);
+	khttp_opts_init(&opts);
+	kerr = kworker_child(fdout, NULL, 0, 
+		kmimetypes, KMIME__MAX, 0, &opts);
 	close(fdin);
 	close(fdout);
 	return(KCGI_OK == kerr ? EXIT_SUCCESS : EXIT_FAILURE);
@@ -29,15 +29,162 @@
 
 #include "kcgi.h"
 #include "extern.h"
-
-#define MD5Updatec(_ctx, _b, _sz) \
-	MD5Update((_ctx), (const u_int8_t *)(_b), (_sz))
+#include "hash.h"
 
 static const char b64[] = 
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 	"abcdefghijklmnopqrstuvwxyz"
 	"0123456789+/";
 
+static const char hex[] = "0123456789abcdef";
+
+/*
+ * A small cache of session keys.
+ * A client making many requests with the session algorithms has us
+ * compute the same H(H(A1):nonce:cnonce) for every request with the
+ * same nonce.
+ * Entries are keyed by the hash function and its full input, so a hit
+ * is exactly a computation saved.
+ * Nothing keyed by a plaintext password is ever cached.
+ * Being static, each worker process has its own.
+ */
+#define	DIGEST_CACHESZ	 8
+#define	DIGEST_KEYMAX	 256
+#define	DIGEST_HEXSZ	 (KHASH_DIGEST_MAX * 2 + 1)
+
+struct	digestent {
+	const struct khash *alg; /* hash function */
+	char		 key[DIGEST_KEYMAX]; /* hash input */
+	size_t		 keysz; /* or zero if unused */
+	char		 hash[DIGEST_HEXSZ];
+};
+
+static	struct digestent digestcache[DIGEST_CACHESZ];
+static	size_t digestnext; /* entry to replace next */
+
+/*
+ * Write "sz" bytes of "src" as NUL-terminated lowercase hexadecimal
+ * into "dst", which must have room for twice as many bytes and one.
+ */
+static void
+hexbuf(char *dst, const unsigned char *src, size_t sz)
+{
+	size_t	 i;
+
+	for (i = 0; i < sz; i++) {
+		*dst++ = hex[src[i] >> 4];
+		*dst++ = hex[src[i] & 0x0f];
+	}
+	*dst = '\0';
+}
+
+/*
+ * Compare the string "given" with the expected "want" in time depending
+ * only upon the length of "want", so the comparison doesn't leak how
+ * much of a response was correct.
+ */
+static int
+ctstreq(const char *given, const char *want)
+{
+	size_t		 i, givensz, wantsz;
+	unsigned char	 diff;
+
+	givensz = strlen(given);
+	wantsz = strlen(want);
+	diff = givensz != wantsz;
+
+	for (i = 0; i < wantsz; i++)
+		diff |= (unsigned char)want[i] ^ 
+			(unsigned char)(i < givensz ? given[i] : '\0');
+
+	return(0 == diff);
+}
+
+/*
+ * Like ctstreq() for buffers of the same size.
+ */
+static int
+ctmemeq(const char *a, const char *b, size_t sz)
+{
+	size_t		 i;
+	unsigned char	 diff;
+
+	for (diff = 0, i = 0; i < sz; i++)
+		diff |= (unsigned char)a[i] ^ (unsigned char)b[i];
+
+	return(0 == diff);
+}
+
+/*
+ * Write the hexadecimal "alg" hash of the "sz" strings in "parts"
+ * joined by colons into "hash".
+ */
+static void
+digest_hash(char *hash, const struct khash *alg,
+	const char *const *parts, size_t sz)
+{
+	union khashctx	 ctx;
+	unsigned char	 ha[KHASH_DIGEST_MAX];
+	size_t		 i;
+
+	alg->init(&ctx);
+	for (i = 0; i < sz; i++) {
+		if (i > 0)
+			alg->update(&ctx, ":", 1);
+		alg->update(&ctx, parts[i], strlen(parts[i]));
+	}
+	alg->final(ha, &ctx);
+	hexbuf(hash, ha, alg->digestsz);
+	explicit_bzero(&ctx, sizeof(ctx));
+	explicit_bzero(ha, sizeof(ha));
+}
+
+/*
+ * Like digest_hash(), but look up and remember the hash in our cache.
+ * Inputs too long for the cache are simply hashed.
+ */
+static void
+digest_cached(char *hash, const struct khash *alg,
+	const char *const *parts, size_t sz)
+{
+	char		 key[DIGEST_KEYMAX];
+	size_t		 i, len, keysz;
+	struct digestent *ent;
+
+	for (keysz = i = 0; i < sz; i++) {
+		len = strlen(parts[i]);
+		if (keysz + len + 1 > sizeof(key)) {
+			explicit_bzero(key, keysz);
+			digest_hash(hash, alg, parts, sz);
+			return;
+		}
+		if (i > 0)
+			key[keysz++] = ':';
+		memcpy(key + keysz, parts[i], len);
+		keysz += len;
+	}
+
+	for (i = 0; i < DIGEST_CACHESZ; i++) {
+		ent = &digestcache[i];
+		if (ent->alg == alg && ent->keysz == keysz && 
+		    ctmemeq(ent->key, key, keysz)) {
+			memcpy(hash, ent->hash, sizeof(ent->hash));
+			explicit_bzero(key, keysz);
+			return;
+		}
+	}
+
+	digest_hash(hash, alg, parts, sz);
+
+	ent = &digestcache[digestnext];
+	digestnext = (digestnext + 1) % DIGEST_CACHESZ;
+	ent->alg = alg;
+	memcpy(ent->key, key, keysz);
+	ent->keysz = keysz;
+	memcpy(ent->hash, hash, sizeof(ent->hash));
+	explicit_bzero(key, keysz);
+}
+
 static size_t 
 base64len(size_t len)
 {
@@ -104,7 +251,7 @@ khttpbasic_validate(const struct kreq *req,
 		return(-1);
 	}
 	base64buf(enc, buf, sz);
-	rc = 0 == strcmp(enc, req->rawauth.d.basic.response);
+	rc = ctstreq(req->rawauth.d.basic.response, enc);
 	free(enc);
 	free(buf);
 	return(rc);
@@ -113,16 +260,15 @@ khttpbasic_validate(const struct kreq *req,
 int
 khttpdigest_validatehash(const struct kreq *req, const char *skey4)
 {
-	MD5_CTX	 	 ctx;
-	unsigned char	 ha1[MD5_DIGEST_LENGTH],
-			 ha2[MD5_DIGEST_LENGTH],
-			 ha3[MD5_DIGEST_LENGTH];
-	char		 skey1[MD5_DIGEST_LENGTH * 2 + 1],
-			 skey2[MD5_DIGEST_LENGTH * 2 + 1],
-			 skey3[MD5_DIGEST_LENGTH * 2 + 1],
+	char		 skey1[DIGEST_HEXSZ],
+			 skey2[DIGEST_HEXSZ],
+			 skey3[DIGEST_HEXSZ],
+			 body[DIGEST_HEXSZ],
 			 count[9];
+	const char	*parts[6];
 	size_t		 i;
 	const struct khttpdigest *auth;
+	const struct khash *alg;
 
 	/*
 	 * Make sure we're a digest with all fields intact.
@@ -136,85 +282,74 @@ khttpdigest_validatehash(const struct kreq *req, const char *skey4)
 
 	auth = &req->rawauth.d.digest;
 
+	if (NULL == (alg = khash_get(auth->alg)))
+		return(-1);
+
 	/*
-	 * MD5-sess hashes the nonce and client nonce as well as the
-	 * existing hash (user/real/pass).
-	 * Note that the existing hash is MD5_DIGEST_LENGTH * 2 as
-	 * validated by prncpl_pentry_check().
+	 * The session algorithms hash the nonce and client nonce as
+	 * well as the existing hash (user/real/pass).
+	 * This is the same for all requests with the same nonce, so
+	 * it's cached.
 	 */
-	if (KHTTPALG_MD5_SESS == auth->alg) {
-		MD5Init(&ctx);
-		MD5Updatec(&ctx, skey4, strlen(skey4));
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, auth->nonce, strlen(auth->nonce));
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, auth->cnonce, strlen(auth->cnonce));
-		MD5Final(ha1, &ctx);
-		for (i = 0; i < MD5_DIGEST_LENGTH; i++) 
-			snprintf(&skey1[i * 2], 3, "%02x", ha1[i]);
+	if (KHTTPALG_MD5_SESS == auth->alg ||
+	    KHTTPALG_SHA256_SESS == auth->alg ||
+	    KHTTPALG_SHA512_256_SESS == auth->alg) {
+		parts[0] = skey4;
+		parts[1] = auth->nonce;
+		parts[2] = auth->cnonce;
+		digest_cached(skey1, alg, parts, 3);
 	} else 
 		strlcpy(skey1, skey4, sizeof(skey1));
 
+	/*
+	 * With "auth-int", A2 also has the hash of the body, which the
+	 * child computed as it read the body.
+	 * RFC 7616 section 3.4.3.
+	 */
+	parts[0] = kmethods[req->method];
+	parts[1] = auth->uri;
 	if (KHTTPQOP_AUTH_INT == auth->qop) {
 		/* This shouldn't happen... */
 		if (NULL == req->rawauth.digest)
 			return(-1);
-		memcpy(ha2, req->rawauth.digest, sizeof(ha2));
-	} else {
-		MD5Init(&ctx);
-		MD5Updatec(&ctx, kmethods[req->method], 
-			strlen(kmethods[req->method]));
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, auth->uri, strlen(auth->uri));
-		MD5Final(ha2, &ctx);
-	}
-
-	for (i = 0; i < MD5_DIGEST_LENGTH; i++) 
-		snprintf(&skey2[i * 2], 3, "%02x", ha2[i]);
+		hexbuf(body, (const unsigned char *)
+			req->rawauth.digest, alg->digestsz);
+		parts[2] = body;
+		digest_hash(skey2, alg, parts, 3);
+	} else
+		digest_hash(skey2, alg, parts, 2);
 
 	if (KHTTPQOP_AUTH_INT == auth->qop || 
 	    KHTTPQOP_AUTH == auth->qop) {
-		snprintf(count, sizeof(count), "%08" PRIx32, auth->count);
-		MD5Init(&ctx);
-		MD5Updatec(&ctx, skey1, MD5_DIGEST_LENGTH * 2);
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, auth->nonce, strlen(auth->nonce));
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, count, strlen(count));
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, auth->cnonce, strlen(auth->cnonce));
-		MD5Updatec(&ctx, ":", 1);
-		if (KHTTPQOP_AUTH_INT == auth->qop)
-			MD5Updatec(&ctx, "auth-int", 8);
-		else
-			MD5Updatec(&ctx, "auth", 4);
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, skey2, MD5_DIGEST_LENGTH * 2);
-		MD5Final(ha3, &ctx);
+		for (i = 0; i < 8; i++)
+			count[i] = hex[(auth->count >> (28 - i * 4)) & 0x0f];
+		count[i] = '\0';
+		parts[0] = skey1;
+		parts[1] = auth->nonce;
+		parts[2] = count;
+		parts[3] = auth->cnonce;
+		parts[4] = KHTTPQOP_AUTH_INT == auth->qop ?
+			"auth-int" : "auth";
+		parts[5] = skey2;
+		digest_hash(skey3, alg, parts, 6);
 	} else {
-		MD5Init(&ctx);
-		MD5Updatec(&ctx, skey1, MD5_DIGEST_LENGTH * 2);
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, auth->nonce, strlen(auth->nonce));
-		MD5Updatec(&ctx, ":", 1);
-		MD5Updatec(&ctx, skey2, MD5_DIGEST_LENGTH * 2);
-		MD5Final(ha3, &ctx);
+		parts[0] = skey1;
+		parts[1] = auth->nonce;
+		parts[2] = skey2;
+		digest_hash(skey3, alg, parts, 3);
 	}
 
-	for (i = 0; i < MD5_DIGEST_LENGTH; i++) 
-		snprintf(&skey3[i * 2], 3, "%02x", ha3[i]);
-
-	return(0 == strcmp(auth->response, skey3));
+	return(ctstreq(auth->response, skey3));
 }
 
 int
 khttpdigest_validate(const struct kreq *req, const char *pass)
 {
-	MD5_CTX	 	 ctx;
-	unsigned char	 ha4[MD5_DIGEST_LENGTH];
-	char		 skey4[MD5_DIGEST_LENGTH * 2 + 1];
-	size_t		 i;
+	char		 skey4[DIGEST_HEXSZ];
+	const char	*parts[3];
 	const struct khttpdigest *auth;
+	const struct khash *alg;
+	int		 rc;
 
 	/*
 	 * Make sure we're a digest with all fields intact.
@@ -229,16 +364,15 @@ khttpdigest_validate(const struct kreq *req, const char *pass)
 
 	auth = &req->rawauth.d.digest;
 
-	MD5Init(&ctx);
-	MD5Updatec(&ctx, auth->user, strlen(auth->user));
-	MD5Updatec(&ctx, ":", 1);
-	MD5Updatec(&ctx, auth->realm, strlen(auth->realm));
-	MD5Updatec(&ctx, ":", 1);
-	MD5Updatec(&ctx, pass, strlen(pass));
-	MD5Final(ha4, &ctx);
+	if (NULL == (alg = khash_get(auth->alg)))
+		return(-1);
 
-	for (i = 0; i < MD5_DIGEST_LENGTH; i++) 
-		snprintf(&skey4[i * 2], 3, "%02x", ha4[i]);
+	parts[0] = auth->user;
+	parts[1] = auth->realm;
+	parts[2] = pass;
+	digest_hash(skey4, alg, parts, 3);
 
-	return(khttpdigest_validatehash(req, skey4));
+	rc = khttpdigest_validatehash(req, skey4);
+	explicit_bzero(skey4, sizeof(skey4));
+	return(rc);
 }
@@ -0,0 +1,263 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#if !HAVE_ARC4RANDOM
+# include <bsd/stdlib.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../kcgi.h"
+
+/*
+ * Compare the validators in kcgi.c against the previous (strtonum(3),
+ * strtod(3), atoi(3) and strchr(3)-based) implementations, which are
+ * reproduced here.
+ * Each is run over the same set of generated inputs.
+ */
+
+#define	INPUTS	 20000
+#define	ROUNDS	 50
+
+static char *
+old_trim(char *val)
+{
+	char		*cp;
+
+	if ('\0' == *val)
+		return(val);
+
+	cp = val + strlen(val) - 1;
+	while (cp > val && isspace((unsigned char)*cp))
+		*cp-- = '\0';
+
+	cp = val;
+	while (isspace((unsigned char)*cp))
+		cp++;
+
+	return(cp);
+}
+
+static int
+old_stringne(struct kpair *p)
+{
+
+	if (strlen(p->val) != p->valsz || 0 == p->valsz)
+		return(0);
+	p->type = KPAIR_STRING;
+	p->parsed.s = p->val;
+	return(1);
+}
+
+static int
+old_int(struct kpair *p)
+{
+	const char	*ep;
+
+	if ( ! old_stringne(p))
+		return(0);
+	p->parsed.i = strtonum
+		(old_trim(p->val), INT64_MIN, INT64_MAX, &ep);
+	p->type = KPAIR_INTEGER;
+	return(NULL == ep);
+}
+
+static int
+old_double(struct kpair *p)
+{
+	char		*ep;
+	double		 lval;
+
+	if ( ! old_stringne(p))
+		return(0);
+
+	errno = 0;
+	lval = strtod(p->val, &ep);
+	if (p->val[0] == '\0' || *ep != '\0')
+		return(0);
+	if (errno == ERANGE && (lval == HUGE_VAL || lval == -HUGE_VAL))
+		return(0);
+	p->parsed.d = lval;
+	p->type = KPAIR_DOUBLE;
+	return(1);
+}
+
+static char *
+old_valid_email(char *p)
+{
+	char		*domain, *cp, *start;
+	size_t		 i, sz;
+
+	cp = start = old_trim(p);
+
+	if ((sz = strlen(cp)) < 5 || sz > 254)
+		return(NULL);
+	if (NULL == (domain = strchr(cp, '@')))
+		return(NULL);
+	if ((sz = domain - cp) < 1 || sz > 64)
+		return(NULL);
+
+	for (i = 0; i < sz; i++) {
+		if (isalnum((unsigned char)cp[i]))
+			continue;
+		if (NULL == strchr("!#$%&'*+-/=?^_`{|}~.", cp[i]))
+			return(NULL);
+	}
+
+	cp = &cp[++i];
+	if ((sz = strlen(cp)) < 4 || sz > 254)
+		return(NULL);
+
+	for (i = 0; i < sz; i++) 
+		if ( ! isalnum((unsigned char)cp[i]))
+			if (NULL == strchr("-.", cp[i]))
+				return(NULL);
+
+	for (cp = start; '\0' != *cp; cp++)
+		*cp = tolower((unsigned char)*cp);
+
+	return(start);
+}
+
+static int
+old_email(struct kpair *p)
+{
+
+	if ( ! old_stringne(p))
+		return(0);
+	return(NULL != (p->parsed.s = old_valid_email(p->val)));
+}
+
+static int
+old_date(struct kpair *kp)
+{
+	int		 mday, mon, year;
+
+	if ( ! old_stringne(kp))
+		return(0);
+	else if (kp->valsz != 10)
+		return(0);
+	else if ( ! isdigit((unsigned char)kp->val[0]) ||
+		! isdigit((unsigned char)kp->val[1]) ||
+		! isdigit((unsigned char)kp->val[2]) ||
+		! isdigit((unsigned char)kp->val[3]) ||
+		'-' != kp->val[4] || 
+		! isdigit((unsigned char)kp->val[5]) ||
+		! isdigit((unsigned char)kp->val[6]) ||
+		'-' != kp->val[7] || 
+		! isdigit((unsigned char)kp->val[8]) ||
+		! isdigit((unsigned char)kp->val[9]))
+		return(0);
+
+	year = atoi(&kp->val[0]);
+	mon = atoi(&kp->val[5]);
+	mday = atoi(&kp->val[8]);
+
+	kp->parsed.i = kutil_date2epoch(mday, mon, year);
+	kp->type = KPAIR_INTEGER;
+	return(1);
+}
+
+/*
+ * Run validator "fp" ROUNDS times over all inputs "in", returning the
+ * mean number of nanoseconds per validation.
+ * The inputs are copied for each validation as the validators may
+ * modify them, so this copy is also counted in.
+ */
+static double
+run(int (*fp)(struct kpair *), char in[][64], size_t *ok)
+{
+	struct timespec	 start, end;
+	struct kpair	 kp;
+	char		 buf[64];
+	size_t		 i, j;
+
+	*ok = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (j = 0; j < ROUNDS; j++)
+		for (i = 0; i < INPUTS; i++) {
+			memset(&kp, 0, sizeof(struct kpair));
+			kp.valsz = strlcpy(buf, in[i], sizeof(buf));
+			kp.val = buf;
+			*ok += fp(&kp);
+		}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return(((end.tv_sec - start.tv_sec) * 1e9 + 
+		(end.tv_nsec - start.tv_nsec)) / 
+		((double)ROUNDS * INPUTS));
+}
+
+static void
+compare(const char *name, char in[][64],
+	int (*oldfp)(struct kpair *), int (*newfp)(struct kpair *))
+{
+	double	 o, n;
+	size_t	 ook, nok;
+
+	o = run(oldfp, in, &ook);
+	n = run(newfp, in, &nok);
+	printf("%-8s %10.1f %10.1f %8.2fx%s\n", name, o, n, o / n,
+		ook != nok ? " (results differ!)" : "");
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char	 in[INPUTS][64];
+	size_t		 i;
+
+	printf("%-8s %10s %10s %9s\n", 
+		"", "old ns", "new ns", "speedup");
+
+	for (i = 0; i < INPUTS; i++)
+		snprintf(in[i], sizeof(in[i]), "%" PRId64, 
+			(int64_t)((uint64_t)arc4random() << 
+			 arc4random_uniform(32)) - INT32_MAX);
+	compare("int", in, old_int, kvalid_int);
+
+	for (i = 0; i < INPUTS; i++)
+		snprintf(in[i], sizeof(in[i]), "%" PRIu32 ".%.2" PRIu32,
+			arc4random_uniform(100000), 
+			arc4random_uniform(100));
+	compare("double", in, old_double, kvalid_double);
+
+	for (i = 0; i < INPUTS; i++)
+		snprintf(in[i], sizeof(in[i]), "User%" PRIu32 
+			"@Example%" PRIu32 ".com", 
+			arc4random(), arc4random());
+	compare("email", in, old_email, kvalid_email);
+
+	for (i = 0; i < INPUTS; i++)
+		snprintf(in[i], sizeof(in[i]), "%.4" PRIu32 "-%.2" 
+			PRIu32 "-%.2" PRIu32, 
+			1970 + arc4random_uniform(100), 
+			1 + arc4random_uniform(12), 
+			1 + arc4random_uniform(28));
+	compare("date", in, old_date, kvalid_date);
+
+	return(EXIT_SUCCESS);
+}
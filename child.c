@@ -38,9 +38,7 @@
 
 #include "kcgi.h"
 #include "extern.h"
-
-#define MD5Updatec(_ctx, _b, _sz) \
-	MD5Update((_ctx), (const u_int8_t *)(_b), (_sz))
+#include "hash.h"
 
 /*
  * For handling HTTP multipart forms.
@@ -123,6 +121,7 @@ struct	parms {
 	const struct kvalid	*keys;
 	size_t			 keysz;
 	enum input		 type;
+	unsigned int		 flags; /* from struct kopts */
 };
 
 const char *const kmethods[KMETHOD__MAX] = {
@@ -207,17 +206,31 @@ str2ctype(const struct parms *pp, const char *ctype)
 }
 
 /*
- * Given a parsed field "key" with value "val" of size "valsz" and MIME
- * information "mime", first try to look it up in the array of
- * recognised keys ("pp->keys") and optionally validate.
- * Then output the type, parse status (key, type, etc.), and values read
- * by the parent input() function.
+ * Look up the key "key" of length "keysz" (not necessarily
+ * NUL-terminated) in the array of recognised keys ("pp->keys").
+ * Returns the key identifier or keysz if none is found.
+ */
+static size_t
+keylookup(const struct parms *pp, const char *key, size_t keysz)
+{
+	size_t	 i;
+
+	for (i = 0; i < pp->keysz; i++)
+		if (0 == strncmp(pp->keys[i].name, key, keysz) &&
+		    '\0' == pp->keys[i].name[keysz])
+			break;
+
+	return(i);
+}
+
+/*
+ * Like output(), but with the key identifier "keypos" (keysz if the
+ * key isn't recognised) having already been looked up.
  */
 static void
-output(const struct parms *pp, char *key, 
+outputpos(const struct parms *pp, char *key, size_t keypos,
 	char *val, size_t valsz, struct mime *mime)
 {
-	size_t	 	 i;
 	ptrdiff_t	 diff;
 	char		*save;
 	struct kpair	 pair;
@@ -233,22 +246,14 @@ output(const struct parms *pp, char *key,
 	pair.ctypepos = NULL == mime ? pp->mimesz : mime->ctypepos;
 
 	/*
-	 * Look up the key name in our key table.
-	 * If we find it and it has a validator, then run the validator
-	 * and record the output.
-	 * Either way, the keypos parameter is going to be the key
-	 * identifier or keysz if none is found.
+	 * If the key has been recognised (i.e., it's not keysz), run
+	 * its validator, if applicable, and record the output.
 	 */
 
-	for (i = 0; i < pp->keysz; i++) {
-		if (strcmp(pp->keys[i].name, pair.key)) 
-			continue;
-		if (NULL != pp->keys[i].valid)
-			pair.state = pp->keys[i].valid(&pair) ?
-				KPAIR_VALID : KPAIR_INVALID;
-		break;
-	}
-	pair.keypos = i;
+	if (keypos < pp->keysz && NULL != pp->keys[keypos].valid)
+		pair.state = pp->keys[keypos].valid(&pair) ?
+			KPAIR_VALID : KPAIR_INVALID;
+	pair.keypos = keypos;
 
 	fullwrite(pp->fd, &pp->type, sizeof(enum input));
 	fullwriteword(pp->fd, pair.key);
@@ -293,66 +298,164 @@ output(const struct parms *pp, char *key,
 }
 
 /*
- * Read full stdin request into memory.
- * This reads at most "len" bytes and NUL-terminates the results, the
- * length of which may be less than "len" and is stored in *szp if not
- * NULL.
- * Returns the pointer to the data.
+ * Given a parsed field "key" with value "val" of size "valsz" and MIME
+ * information "mime", first try to look it up in the array of
+ * recognised keys ("pp->keys") and optionally validate.
+ * Then output the type, parse status (key, type, etc.), and values read
+ * by the parent input() function.
+ */
+static void
+output(const struct parms *pp, char *key, 
+	char *val, size_t valsz, struct mime *mime)
+{
+
+	outputpos(pp, key, keylookup(pp, key, strlen(key)),
+		val, valsz, mime);
+}
+
+/*
+ * The hash of the request body needed by "auth-int" digest
+ * authentication (see kworker_auth_child()).
+ * If "hash" is NULL, the body isn't hashed.
+ */
+struct	bodyhash {
+	const struct khash *hash;
+	union khashctx	 ctx;
+};
+
+/*
+ * A request body being read from standard input.
+ * The buffer is allocated to the full expected length (plus a NUL
+ * terminator) up front, so pointers into it remain valid as more of
+ * the body is read in by scan_more().
+ */
+struct	scan {
+	char	*buf; /* NUL-terminated body so far */
+	size_t	 sz; /* bytes read so far */
+	size_t	 len; /* bytes expected */
+	int	 eof; /* whether we've stopped reading */
+	struct bodyhash *bh; /* hash of body as it's read */
+};
+
+/*
+ * Prepare to read a request body of "len" bytes, hashing it into "bh"
+ * as it's read.
+ */
+static void
+scan_init(struct scan *s, size_t len, struct bodyhash *bh)
+{
+
+	memset(s, 0, sizeof(struct scan));
+	s->len = len;
+	s->bh = bh;
+
+	/* Allocate the entire buffer here. */
+
+	if (NULL == (s->buf = XMALLOC(len + 1)))
+		_exit(EXIT_FAILURE);
+	s->buf[0] = '\0';
+}
+
+/*
+ * Read whatever is available of the request body, waiting until some
+ * data arrives.
+ * The buffer is always kept NUL-terminated.
+ * Returns zero if we have all the data or the sender stopped giving us
+ * data, non-zero if more was read.
  * NOTE: we can't use fullread() here because we may not get the total
  * number of bytes requested.
- * NOTE: "szp" can legit be set to zero.
  */
-static char *
-scanbuf(size_t len, size_t *szp)
+static int
+scan_more(struct scan *s)
 {
 	ssize_t		 ssz;
-	size_t		 sz;
-	char		*p;
 	int		 rc;
 	struct pollfd	 pfd;
 
+	if (s->eof || s->sz == s->len) {
+		s->eof = 1;
+		return(0);
+	}
+
 	pfd.fd = STDIN_FILENO;
 	pfd.events = POLLIN;
 
-	/* Allocate the entire buffer here. */
+	if ((rc = poll(&pfd, 1, -1)) < 0) {
+		XWARN("poll: POLLIN");
+		_exit(EXIT_FAILURE);
+	} else if (0 == rc) {
+		XWARNX("poll: timeout!?");
+		return(1);
+	} else if ( ! (POLLIN & pfd.revents)) {
+		s->eof = 1;
+		return(0);
+	}
 
-	if (NULL == (p = XMALLOC(len + 1)))
+	ssz = read(STDIN_FILENO, s->buf + s->sz, s->len - s->sz);
+	if (ssz < 0) {
+		XWARNX("read");
 		_exit(EXIT_FAILURE);
+	} else if (0 == ssz) {
+		s->eof = 1;
+		return(0);
+	}
+
+	if (NULL != s->bh->hash)
+		s->bh->hash->update(&s->bh->ctx, 
+			s->buf + s->sz, (size_t)ssz);
+
+	s->sz += (size_t)ssz;
+	s->buf[s->sz] = '\0';
+	return(1);
+}
+
+/*
+ * If reading the body incrementally (i.e., "s" is not NULL), make sure
+ * that at least "want" bytes are available, reading more as required.
+ * Returns the number of bytes available, which may be less than "want"
+ * if the input has ended, or simply "len" if "s" is NULL.
+ */
+static size_t
+scan_want(struct scan *s, size_t len, size_t want)
+{
+
+	if (NULL == s)
+		return(len);
+	while (s->sz < want && scan_more(s))
+		/* Spin. */ ;
+	return(s->sz);
+}
+
+/*
+ * Read full stdin request into memory.
+ * This reads at most "len" bytes and NUL-terminates the results, the
+ * length of which may be less than "len" and is stored in *szp if not
+ * NULL.
+ * Returns the pointer to the data.
+ * NOTE: "szp" can legit be set to zero.
+ */
+static char *
+scanbuf(size_t len, size_t *szp, struct bodyhash *bh)
+{
+	struct scan	 s;
 
 	/* 
 	 * Keep reading til we get all the data or the sender stops
 	 * giving us data---whichever comes first.
 	 */
 
-	for (sz = 0; sz < len; sz += (size_t)ssz) {
-		if ((rc = poll(&pfd, 1, -1)) < 0) {
-			XWARN("poll: POLLIN");
-			_exit(EXIT_FAILURE);
-		} else if (0 == rc) {
-			XWARNX("poll: timeout!?");
-			ssz = 0;
-			continue;
-		} else if ( ! (POLLIN & pfd.revents))
-			break;
+	scan_init(&s, len, bh);
+	while (scan_more(&s))
+		/* Spin. */ ;
 
-		if ((ssz = read(STDIN_FILENO, p + sz, len - sz)) < 0) {
-			XWARNX("read");
-			_exit(EXIT_FAILURE);
-		} else if (0 == ssz)
-			break;
-	}
-
-	if (sz < len)
+	if (s.sz < len)
 		XWARNX("content size mismatch: have "
-			"%zu, wanted %zu\n", sz, len);
-
-	/* ALWAYS NUL-terminate. */
+			"%zu, wanted %zu\n", s.sz, len);
 
-	p[sz] = '\0';
 	if (NULL != szp)
-		*szp = sz;
+		*szp = s.sz;
 
-	return(p);
+	return(s.buf);
 }
 
 /*
@@ -654,44 +757,134 @@ parse_body(const char *ct, const struct parms *pp, char *b, size_t bsz)
 }
 
 /*
- * In-place HTTP-decode a string.  The standard explanation is that this
- * turns "%4e+foo" into "n foo" in the regular way.  This is done
- * in-place over the allocated string.
- * Returns zero on decoding failure, non-zero otherwise.
+ * Convert a single hexadecimal digit into its value.
+ * Returns -1 if the character isn't a hexadecimal digit.
  */
 static int
-urldecode(char *p)
+xdigit(char c)
 {
-	char             hex[3];
-	unsigned int	 c;
 
-	hex[2] = '\0';
+	if (c >= '0' && c <= '9')
+		return(c - '0');
+	if (c >= 'a' && c <= 'f')
+		return(c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return(c - 'A' + 10);
+	return(-1);
+}
 
-	for ( ; '\0' != *p; p++) {
-		if ('%' == *p) {
-			if ('\0' == (hex[0] = *(p + 1))) {
-				XWARNX("urldecode: short hex");
-				return(0);
-			} else if ('\0' == (hex[1] = *(p + 2))) {
+/*
+ * In-place HTTP-decode a string of length "*sz".  The standard
+ * explanation is that this turns "%4e+foo" into "n foo" in the regular
+ * way.  This is done in-place over the allocated string in a single
+ * pass, the result being NUL-terminated and its new length (never
+ * larger than the original) set in "*sz".
+ * Returns zero on decoding failure, non-zero otherwise.
+ */
+static int
+urldecode(char *p, size_t *sz)
+{
+	size_t	 i, j;
+	int	 hi, lo;
+
+	for (i = j = 0; i < *sz; i++, j++) {
+		if ('%' == p[i]) {
+			if (i + 2 >= *sz) {
 				XWARNX("urldecode: short hex");
 				return(0);
-			} else if (1 != sscanf(hex, "%x", &c)) {
+			}
+			hi = xdigit(p[i + 1]);
+			lo = xdigit(p[i + 2]);
+			if (hi < 0 || lo < 0) {
 				XWARNX("urldecode: bad hex");
 				return(0);
-			} else if ('\0' == c) {
+			} else if (0 == hi && 0 == lo) {
 				XWARNX("urldecode: NUL byte");
 				return(0);
 			}
+			p[j] = (hi << 4) | lo;
+			i += 2;
+		} else if ('+' == p[i])
+			p[j] = ' ';
+		else
+			p[j] = p[i];
+	}
 
-			*p = c;
-			memmove(p + 1, p + 3, strlen(p + 3) + 1);
-		} else if ('+' == *p)
-			*p = ' ';
+	p[j] = '\0';
+	*sz = j;
+	return(1);
+}
+
+/*
+ * A key-value pair tokenised from a delimited string, such as
+ * "key=val;key2=val2", by parse_token().
+ * The key and value are recorded as offsets into the string, which is
+ * not modified.
+ */
+struct	token {
+	size_t	 key; /* offset of key */
+	size_t	 keysz; /* length of key */
+	size_t	 val; /* offset of value (if "hasval") */
+	size_t	 valsz; /* length of value */
+	int	 hasval; /* whether there was a '=' */
+};
+
+/*
+ * Tokenise the next pair in "p" starting at offset "*pos", where pairs
+ * are separated by ';' and also '&' if "amp" is non-zero.
+ * This is a single pass over the characters of the pair: leading
+ * spaces are skipped, then the key ends at the first '=' (the value
+ * following until the separator) or separator.
+ * On return, "*pos" is set to the beginning of the next pair.
+ * Returns zero when at the end of the string, non-zero otherwise.
+ */
+static int
+parse_token(const char *p, size_t *pos, int amp, struct token *tok)
+{
+	size_t	 i = *pos;
+	char	 c;
+
+	while (' ' == p[i])
+		i++;
+	if ('\0' == p[i]) {
+		*pos = i;
+		return(0);
 	}
 
+	memset(tok, 0, sizeof(struct token));
+	tok->key = i;
+
+	for ( ; '\0' != (c = p[i]); i++) {
+		if (';' == c || (amp && '&' == c))
+			break;
+		if ('=' == c && ! tok->hasval) {
+			tok->keysz = i - tok->key;
+			tok->val = i + 1;
+			tok->hasval = 1;
+		}
+	}
+
+	if (tok->hasval)
+		tok->valsz = i - tok->val;
+	else
+		tok->keysz = i - tok->key;
+
+	*pos = '\0' == c ? i : i + 1;
 	return(1);
 }
 
+/*
+ * Whether we should drop the pair with the given key identifier (keysz
+ * if not found), i.e., the key is unrecognised and we've been asked to
+ * drop those keys.
+ */
+static int
+dropkey(const struct parms *pp, size_t keypos)
+{
+
+	return((KOPT_DROPUNKNOWN & pp->flags) && keypos == pp->keysz);
+}
+
 /*
  * Parse out key-value pairs from an HTTP cookie.
  * These are not URL encoded (at this phase): they're just simple
@@ -699,42 +892,35 @@ urldecode(char *p)
  * This is defined by RFC 6265, however, we don't [yet] do the
  * quoted-string implementation, nor do we check for accepted
  * characters so long as the delimiters aren't used.
+ * Since cookie values aren't decoded, unrecognised keys may be
+ * dropped before their values are touched at all.
  */
 static void
 parse_pairs(const struct parms *pp, char *p)
 {
-	char            *key, *val;
-
-	while (NULL != p && '\0' != *p) {
-		/* Skip leading whitespace. */
-		while (' ' == *p)
-			p++;
+	struct token	 tok;
+	size_t		 pos, keypos;
 
-		key = p;
-		val = NULL;
-		if (NULL != (p = strchr(p, '='))) {
-			/* Key/value pair. */
-			*p++ = '\0';
-			val = p;
-			p = strchr(p, ';');
-			if (NULL != p)
-				*p++ = '\0';
-		} else {
+	pos = 0;
+	while (NULL != p && parse_token(p, &pos, 0, &tok)) {
+		if ( ! tok.hasval) {
 			/* No value--error. */
-			p = strchr(key, ';');
-			if (NULL != p)
-				p++;
 			XWARNX("cookie key: no value");
 			continue;
-		}
-
-		if ('\0' == *key) {
+		} else if (0 == tok.keysz) {
 			/* This is sort-of allowed. */
 			XWARNX("cookie key: zero length");
 			continue;
 		}
 
-		output(pp, key, val, strlen(val), NULL);
+		keypos = keylookup(pp, &p[tok.key], tok.keysz);
+		if (dropkey(pp, keypos))
+			continue;
+
+		p[tok.key + tok.keysz] = '\0';
+		p[tok.val + tok.valsz] = '\0';
+		outputpos(pp, &p[tok.key], keypos, 
+			&p[tok.val], tok.valsz, NULL);
 	}
 }
 
@@ -742,47 +928,37 @@ parse_pairs(const struct parms *pp, char *p)
  * Parse out key-value pairs from an HTTP request variable.
  * This is either a POST or GET string.
  * This MUST be a non-binary (i.e., NUL-terminated) string!
+ * Keys are decoded and looked up before the value, so the value of an
+ * unrecognised key need not be decoded if it's to be dropped.
  */
 static void
 parse_pairs_urlenc(const struct parms *pp, char *p)
 {
-	char	*key, *val;
-	char	 empty = '\0';
-	size_t	 sz;
+	struct token	 tok;
+	size_t		 pos, keypos;
+	char		*key, *val;
+	char		 empty = '\0';
 
 	assert(NULL != p);
 
-	while ('\0' != *p) {
-		/* Skip leading whitespace. */
-		while (' ' == *p)
-			p++;
+	pos = 0;
+	while (parse_token(p, &pos, 1, &tok)) {
+		key = &p[tok.key];
+		key[tok.keysz] = '\0';
 
-		key = p;
-		val = NULL;
+		/* 
+		 * No value.
+		 * We let this through and just specify that it has an
+		 * empty value.
+		 * There is no standard that says what we do, but the
+		 * information should pass through.
+		 */
 
-		if (NULL != (p = strchr(p, '='))) {
-			/* Key/value pair. */
-			*p++ = '\0';
-			val = p;
-			sz = strcspn(p, ";&");
-			p += sz;
-			if ('\0' != *p)
-				*p++ = '\0';
-		} else {
-			/* 
-			 * No value.
-			 * We let this through and just specify that it
-			 * has an empty value.
-			 * There is no standard that says what we do,
-			 * but the information should pass through.
-			 */
-			p = key;
-			sz = strcspn(p, ";&");
-			p += sz;
-			if ('\0' != *p)
-				p++;
+		if (tok.hasval) {
+			val = &p[tok.val];
+			val[tok.valsz] = '\0';
+		} else
 			val = &empty;
-		}
 
 		/*
 		 * Both the key and the value can be URL encoded, so
@@ -792,31 +968,507 @@ parse_pairs_urlenc(const struct parms *pp, char *p)
 		 * failure.
 		 */
 
-		if ('\0' == *key)
+		if (0 == tok.keysz) {
 			XWARNX("url key: zero length");
-		else if ( ! urldecode(key))
+			continue;
+		} else if ( ! urldecode(key, &tok.keysz)) {
 			XWARNX("url key: key decode");
-		else if (NULL != val && ! urldecode(val))
+			continue;
+		}
+
+		keypos = keylookup(pp, key, tok.keysz);
+		if (dropkey(pp, keypos))
+			continue;
+
+		if (tok.hasval && ! urldecode(val, &tok.valsz))
 			XWARNX("url key: val decode");
 		else
-			output(pp, key, val, strlen(val), NULL);
+			outputpos(pp, key, keypos, val, tok.valsz, NULL);
+	}
+}
+
+/*
+ * Bounds on JSON message bodies parsed into fields: the deepest
+ * nesting of objects and arrays and the longest member path.
+ */
+#define	JSON_DEPTH_MAX	 32
+#define	JSON_PATH_MAX	 256
+
+/*
+ * A JSON message body being parsed into fields.
+ * Strings are decoded in place, so values are slices of the body
+ * itself; keys are copied into the dotted member path.
+ * The body must be NUL-terminated.
+ */
+struct	json {
+	const struct parms *pp;
+	char		*b; /* body */
+	size_t		 bsz; /* length of body */
+	size_t		 pos; /* current position in body */
+	char		 path[JSON_PATH_MAX]; /* member path */
+	size_t		 pathsz; /* length of member path */
+};
+
+/*
+ * Whether the content type is that of JSON, RFC 8259, 11, possibly
+ * with parameters.
+ */
+static int
+json_ctype(const char *cp)
+{
+
+	if (0 != strncasecmp(cp, "application/json", 16))
+		return(0);
+	return('\0' == cp[16] || ';' == cp[16] || ' ' == cp[16]);
+}
+
+static void
+json_ws(struct json *j)
+{
+
+	while (j->pos < j->bsz &&
+	       (' ' == j->b[j->pos] || '\t' == j->b[j->pos] ||
+		'\n' == j->b[j->pos] || '\r' == j->b[j->pos]))
+		j->pos++;
+}
+
+/*
+ * Read the four hexadecimal digits of a "\u" escape.
+ * Returns the code unit or -1 on failure.
+ */
+static long
+json_hex4(const char *p)
+{
+	long	 v;
+	int	 i, d;
+
+	for (v = 0, i = 0; i < 4; i++) {
+		if ((d = xdigit(p[i])) < 0)
+			return(-1);
+		v = v * 16 + d;
+	}
+	return(v);
+}
+
+/*
+ * Write the code point "c" as UTF-8 into "p".
+ * Returns the position after the last byte written.
+ */
+static char *
+json_utf8(char *p, long c)
+{
+
+	if (c < 0x80) {
+		*p++ = c;
+	} else if (c < 0x800) {
+		*p++ = 0xc0 | (c >> 6);
+		*p++ = 0x80 | (c & 0x3f);
+	} else if (c < 0x10000) {
+		*p++ = 0xe0 | (c >> 12);
+		*p++ = 0x80 | ((c >> 6) & 0x3f);
+		*p++ = 0x80 | (c & 0x3f);
+	} else {
+		*p++ = 0xf0 | (c >> 18);
+		*p++ = 0x80 | ((c >> 12) & 0x3f);
+		*p++ = 0x80 | ((c >> 6) & 0x3f);
+		*p++ = 0x80 | (c & 0x3f);
+	}
+	return(p);
+}
+
+/*
+ * Decode the string whose opening quote is at the current position in
+ * place, NUL-terminating it.
+ * This is safe because no escape decodes into more bytes than it uses.
+ * We don't accept escaped NUL characters, so the result may be used as
+ * a C string.
+ * Returns zero if malformed.
+ */
+static int
+json_string(struct json *j, char **val, size_t *valsz)
+{
+	char		*dst;
+	unsigned char	 c;
+	long		 cp, lo;
+
+	assert('"' == j->b[j->pos]);
+	dst = *val = &j->b[++j->pos];
+
+	while (j->pos < j->bsz) {
+		c = j->b[j->pos++];
+		if ('"' == c) {
+			*valsz = dst - *val;
+			*dst = '\0';
+			return(1);
+		} else if (c < 0x20) {
+			return(0);
+		} else if ('\\' != c) {
+			*dst++ = c;
+			continue;
+		} else if (j->pos == j->bsz)
+			return(0);
+
+		switch (j->b[j->pos++]) {
+		case ('"'):
+			*dst++ = '"';
+			break;
+		case ('\\'):
+			*dst++ = '\\';
+			break;
+		case ('/'):
+			*dst++ = '/';
+			break;
+		case ('b'):
+			*dst++ = '\b';
+			break;
+		case ('f'):
+			*dst++ = '\f';
+			break;
+		case ('n'):
+			*dst++ = '\n';
+			break;
+		case ('r'):
+			*dst++ = '\r';
+			break;
+		case ('t'):
+			*dst++ = '\t';
+			break;
+		case ('u'):
+			if (j->bsz - j->pos < 4 ||
+			    (cp = json_hex4(&j->b[j->pos])) <= 0)
+				return(0);
+			j->pos += 4;
+			if (cp >= 0xdc00 && cp <= 0xdfff)
+				return(0);
+			if (cp >= 0xd800 && cp <= 0xdbff) {
+				/* Surrogate pair. */
+				if (j->bsz - j->pos < 6 ||
+				    '\\' != j->b[j->pos] ||
+				    'u' != j->b[j->pos + 1])
+					return(0);
+				lo = json_hex4(&j->b[j->pos + 2]);
+				if (lo < 0xdc00 || lo > 0xdfff)
+					return(0);
+				j->pos += 6;
+				cp = 0x10000 + 
+					((cp - 0xd800) << 10) + (lo - 0xdc00);
+			}
+			dst = json_utf8(dst, cp);
+			break;
+		default:
+			return(0);
+		}
+	}
+
+	return(0);
+}
+
+/*
+ * Scan the number at "p".
+ * Returns its length or zero if malformed.
+ */
+static size_t
+json_number(const char *p)
+{
+	const char	*start = p;
+
+	if ('-' == *p)
+		p++;
+	if ('0' == *p)
+		p++;
+	else if (isdigit((unsigned char)*p))
+		while (isdigit((unsigned char)*p))
+			p++;
+	else
+		return(0);
+
+	if ('.' == *p) {
+		if ( ! isdigit((unsigned char)*++p))
+			return(0);
+		while (isdigit((unsigned char)*p))
+			p++;
+	}
+
+	if ('e' == *p || 'E' == *p) {
+		if ('+' == *++p || '-' == *p)
+			p++;
+		if ( ! isdigit((unsigned char)*p))
+			return(0);
+		while (isdigit((unsigned char)*p))
+			p++;
+	}
+
+	return(p - start);
+}
+
+/*
+ * Pass back a scalar value, which must be NUL-terminated, as a field
+ * named by the current member path.
+ * Values outside of any object have no name and are ignored.
+ */
+static void
+json_field(struct json *j, char *val, size_t valsz)
+{
+	size_t	 keypos;
+
+	if (0 == j->pathsz)
+		return;
+	keypos = keylookup(j->pp, j->path, j->pathsz);
+	if ( ! dropkey(j->pp, keypos))
+		outputpos(j->pp, j->path, keypos, val, valsz, NULL);
+}
+
+static int json_value(struct json *, size_t);
+
+static int
+json_object(struct json *j, size_t depth)
+{
+	char	*key;
+	size_t	 keysz, pathsz = j->pathsz;
+
+	if (depth > JSON_DEPTH_MAX) {
+		XWARNX("json: too deeply nested");
+		return(0);
+	}
+
+	assert('{' == j->b[j->pos]);
+	j->pos++;
+	json_ws(j);
+	if ('}' == j->b[j->pos]) {
+		j->pos++;
+		return(1);
+	}
+
+	for (;;) {
+		json_ws(j);
+		if ('"' != j->b[j->pos] || 
+		    ! json_string(j, &key, &keysz))
+			return(0);
+		if (pathsz + keysz + 1 >= JSON_PATH_MAX) {
+			XWARNX("json: member path too long");
+			return(0);
+		}
+
+		/* Append ".key" (or "key" at the top) to the path. */
+
+		j->pathsz = pathsz;
+		if (pathsz > 0)
+			j->path[j->pathsz++] = '.';
+		memcpy(&j->path[j->pathsz], key, keysz);
+		j->pathsz += keysz;
+		j->path[j->pathsz] = '\0';
+
+		json_ws(j);
+		if (':' != j->b[j->pos++])
+			return(0);
+		if ( ! json_value(j, depth))
+			return(0);
+		json_ws(j);
+		if (',' == j->b[j->pos]) {
+			j->pos++;
+			continue;
+		} else if ('}' != j->b[j->pos])
+			return(0);
+		j->pos++;
+		break;
+	}
+
+	j->pathsz = pathsz;
+	j->path[pathsz] = '\0';
+	return(1);
+}
+
+/*
+ * Array elements are all named by the array's own member path, so they
+ * appear as a repeated field.
+ */
+static int
+json_array(struct json *j, size_t depth)
+{
+
+	if (depth > JSON_DEPTH_MAX) {
+		XWARNX("json: too deeply nested");
+		return(0);
+	}
+
+	assert('[' == j->b[j->pos]);
+	j->pos++;
+	json_ws(j);
+	if (']' == j->b[j->pos]) {
+		j->pos++;
+		return(1);
+	}
+
+	for (;;) {
+		if ( ! json_value(j, depth))
+			return(0);
+		json_ws(j);
+		if (',' == j->b[j->pos]) {
+			j->pos++;
+			continue;
+		} else if (']' != j->b[j->pos])
+			return(0);
+		j->pos++;
+		break;
 	}
+
+	return(1);
+}
+
+/*
+ * Parse a single value at nesting depth "depth".
+ * Numbers and the true and false literals are passed back as their
+ * text, so they're validated just like form fields; null values are
+ * skipped.
+ */
+static int
+json_value(struct json *j, size_t depth)
+{
+	char	*val;
+	size_t	 valsz;
+	char	 c;
+
+	json_ws(j);
+	val = &j->b[j->pos];
+
+	switch (*val) {
+	case ('{'):
+		return(json_object(j, depth + 1));
+	case ('['):
+		return(json_array(j, depth + 1));
+	case ('"'):
+		if ( ! json_string(j, &val, &valsz))
+			return(0);
+		json_field(j, val, valsz);
+		return(1);
+	default:
+		break;
+	}
+
+	if (0 == strncmp(val, "null", 4)) {
+		j->pos += 4;
+		return(1);
+	} else if (0 == strncmp(val, "true", 4))
+		valsz = 4;
+	else if (0 == strncmp(val, "false", 5))
+		valsz = 5;
+	else if (0 == (valsz = json_number(val)))
+		return(0);
+
+	/* Terminate in place just while passing it back. */
+
+	j->pos += valsz;
+	c = val[valsz];
+	val[valsz] = '\0';
+	json_field(j, val, valsz);
+	val[valsz] = c;
+	return(1);
+}
+
+/*
+ * Parse a JSON message body (RFC 8259) into fields named by the dotted
+ * path of their object members, e.g., "user.name" in the body
+ * {"user": {"name": "foo"}}.
+ * Only scalar values become fields.
+ * Parsing stops at malformed input or if JSON_DEPTH_MAX or
+ * JSON_PATH_MAX are exceeded, keeping any fields already passed back.
+ * The body is modified in place.
+ */
+static void
+parse_json(const struct parms *pp, char *b, size_t bsz)
+{
+	struct json	 j;
+
+	memset(&j, 0, sizeof(struct json));
+	j.pp = pp;
+	j.b = b;
+	j.bsz = bsz;
+
+	if ( ! json_value(&j, 0)) {
+		XWARNX("json: malformed at byte %zu", j.pos);
+		return;
+	}
+	json_ws(&j);
+	if (j.pos < j.bsz)
+		XWARNX("json: trailing data at byte %zu", j.pos);
+}
+
+/*
+ * Boyer-Moore-Horspool matcher for a multipart boundary.
+ * The skip table is computed once per boundary, then used for every
+ * part in the body.
+ */
+struct	bmh {
+	const char	*pat; /* pattern (not NUL-terminated) */
+	size_t		 patsz; /* length of pattern (non-zero) */
+	size_t		 skip[UCHAR_MAX + 1]; /* bad-character shifts */
+};
+
+/*
+ * Initialise the matcher "m" with the pattern "pat" of non-zero length
+ * "patsz", which must persist as long as the matcher is used.
+ */
+static void
+bmh_init(struct bmh *m, const char *pat, size_t patsz)
+{
+	size_t	 i;
+
+	assert(patsz > 0);
+	m->pat = pat;
+	m->patsz = patsz;
+
+	for (i = 0; i <= UCHAR_MAX; i++)
+		m->skip[i] = patsz;
+	for (i = 0; i < patsz - 1; i++)
+		m->skip[(unsigned char)pat[i]] = patsz - 1 - i;
+}
+
+/*
+ * Find the first instance of the pattern in "buf" of length "len".
+ * When the pattern isn't found, a match may still begin within the
+ * last "m->patsz - 1" bytes, so callers reading data incrementally
+ * should resume the search there.
+ * Returns a pointer to the match or NULL if not found.
+ */
+static char *
+bmh_find(const struct bmh *m, char *buf, size_t len)
+{
+	size_t		 pos, last;
+	unsigned char	 c;
+
+	if (len < m->patsz)
+		return(NULL);
+
+	last = m->patsz - 1;
+	for (pos = 0; pos <= len - m->patsz; pos += m->skip[c]) {
+		c = buf[pos + last];
+		if (c == (unsigned char)m->pat[last] &&
+		    0 == memcmp(&buf[pos], m->pat, last))
+			return(&buf[pos]);
+	}
+
+	return(NULL);
 }
 
 /*
  * This is described by the "multipart-body" BNF part of RFC 2046,
  * section 5.1.1.
+ * If "s" is not NULL, the body is still being read into "buf" (of
+ * which "len" bytes have been read), and we read more as we need it.
+ * This way, parts are passed to the parent as soon as they're in.
  * We return TRUE if the parse was ok, FALSE if errors occurred (all
  * calling parsers should bail too).
  */
 static int
-parse_multiform(const struct parms *pp, char *name, 
-	const char *bound, char *buf, size_t len, size_t *pos)
+parse_multiform(const struct parms *pp, char *name, const char *bound, 
+	char *buf, size_t len, size_t *pos, struct scan *s)
 {
 	struct mime	 mime;
-	size_t		 endpos, bbsz, partsz;
+	struct bmh	 mfirst, mrest;
+	const struct bmh *m;
+	size_t		 endpos, bbsz, partsz, from, nlen;
 	char		*ln, *bb;
-	int		 rc, first;
+	int		 rc, first, last;
 
 	/* Define our buffer boundary. */
 	
@@ -827,20 +1479,38 @@ parse_multiform(const struct parms *pp, char *name,
 	bbsz = rc;
 	rc = 0;
 
+	/*
+	 * The first prologue boundary will not incur an initial CRLF,
+	 * so its matcher is past the CRLF and two bytes smaller.
+	 */
+
+	bmh_init(&mfirst, bb + 2, bbsz - 2);
+	bmh_init(&mrest, bb, bbsz);
+
 	memset(&mime, 0, sizeof(struct mime));
 
 	/* Read to the next instance of a buffer boundary. */
 
-	for (first = 1; *pos < len; first = 0, *pos = endpos) {
+	for (first = 1, last = 0; ! last; first = 0, *pos = endpos) {
+		if ((len = scan_want(s, len, *pos + 1)) <= *pos)
+			break;
+
 		/*
-		 * The (first ? 2 : 0) is because the first prologue
-		 * boundary will not incur an initial CRLF, so our bb is
-		 * past the CRLF and two bytes smaller.
+		 * If we don't find the boundary in what we have, read
+		 * more (if we can) and search again from where a match
+		 * may start.
 		 */
 
-		ln = memmem(&buf[*pos], len - *pos, 
-			bb + (first ? 2 : 0), 
-			bbsz - (first ? 2 : 0));
+		m = first ? &mfirst : &mrest;
+		for (from = *pos; ; len = nlen) {
+			ln = bmh_find(m, &buf[from], len - from);
+			if (NULL != ln)
+				break;
+			if (len == (nlen = scan_want(s, len, len + 1)))
+				break;
+			if (len - from >= m->patsz)
+				from = len - m->patsz + 1;
+		}
 
 		if (NULL == ln) {
 			XWARNX("RFC violation: unexpected "
@@ -852,16 +1522,13 @@ parse_multiform(const struct parms *pp, char *name,
 		 * Set "endpos" to point to the beginning of the next
 		 * multipart component, i.e, the end of the boundary
 		 * "bb" string.
-		 * Again, be respectful of whether we should scan after
-		 * the lack of initial CRLF.
 		 */
 
-		endpos = *pos + (ln - &buf[*pos]) + 
-			bbsz - (first ? 2 : 0);
+		endpos = (size_t)(ln - buf) + m->patsz;
 
 		/* Check buffer space. */
 
-		if (endpos > len - 2) {
+		if ((len = scan_want(s, len, endpos + 2)) < endpos + 2) {
 			XWARNX("RFC violation: multipart section "
 				"writes into trailing CRLF");
 			goto out;
@@ -875,9 +1542,11 @@ parse_multiform(const struct parms *pp, char *name,
 		 */
 
 		if (memcmp(&buf[endpos], "--", 2)) {
-			while (endpos < len && ' ' == buf[endpos])
+			while ((len = scan_want(s, len, endpos + 1)) > 
+			       endpos && ' ' == buf[endpos])
 				endpos++;
-			if (endpos > len - 2 ||
+			len = scan_want(s, len, endpos + 2);
+			if (endpos + 2 > len ||
 			    memcmp(&buf[endpos], "\r\n", 2)) {
 				XWARNX("RFC violation: multipart "
 					"boundary without CRLF");
@@ -885,7 +1554,7 @@ parse_multiform(const struct parms *pp, char *name,
 			}
 			endpos += 2;
 		} else
-			endpos = len;
+			last = 1;
 
 		/* First section: jump directly to reprocess. */
 
@@ -950,7 +1619,7 @@ parse_multiform(const struct parms *pp, char *name,
 			if ( ! parse_multiform
 				(pp, NULL != name ? name :
 				 mime.name, mime.bound, buf, 
-				 *pos + partsz, pos)) {
+				 *pos + partsz, pos, NULL)) {
 				XWARNX("nested error: mixed "
 					"multipart section parse");
 				goto out;
@@ -987,10 +1656,13 @@ out:
 /*
  * Parse the boundary from a multipart CONTENT_TYPE and pass it to the
  * actual parsing engine.
+ * If "s" is not NULL, the body is read incrementally from it and "b"
+ * and "bsz" are ignored.
  * This doesn't actually handle any part of the MIME specification.
  */
 static void
-parse_multi(const struct parms *pp, char *line, char *b, size_t bsz)
+parse_multi(const struct parms *pp, char *line, 
+	char *b, size_t bsz, struct scan *s)
 {
 	char		*cp;
 	size_t		 len = 0;
@@ -1049,7 +1721,12 @@ parse_multi(const struct parms *pp, char *line, char *b, size_t bsz)
 	 * as to whether anything can come after it.
 	 */
 
-	parse_multiform(pp, NULL, line, b, bsz, &len);
+	if (NULL != s) {
+		b = s->buf;
+		bsz = s->sz;
+	}
+
+	parse_multiform(pp, NULL, line, b, bsz, &len, s);
 }
 
 /*
@@ -1184,13 +1861,17 @@ kworker_child_auth(struct env *env, int fd, size_t envsz)
  * Send the raw (i.e., un-webserver-filtered) authorisation to the
  * parent.
  * Most web servers will `handle this for us'.  Ugh.
+ * If the authorisation needs the body to be hashed, prime "bh".
  */
-static int
-kworker_child_rawauth(struct env *env, int fd, size_t envsz)
+static void
+kworker_child_rawauth(struct env *env, 
+	int fd, size_t envsz, struct bodyhash *bh)
 {
 
-	return(kworker_auth_child(fd, kworker_env
-		(env, envsz, "HTTP_AUTHORIZATION")));
+	bh->hash = khash_get(kworker_auth_child(fd, 
+		kworker_env(env, envsz, "HTTP_AUTHORIZATION")));
+	if (NULL != bh->hash)
+		bh->hash->init(&bh->ctx);
 }
 
 /*
@@ -1344,63 +2025,20 @@ kworker_child_path(struct env *env, int fd, size_t envsz)
 	}
 }
 
-/*
- * Construct the "HA2" component of an HTTP digest hash.
- * See RFC 2617.
- * We only do this if our authorisation requires it!
- */
-static void
-kworker_child_bodymd5(struct env *env, int fd, 
-	size_t envsz, const char *b, size_t bsz, int md5)
-{
-	MD5_CTX		 ctx;
-	unsigned char 	 ha2[MD5_DIGEST_LENGTH];
-	const char 	*uri, *script, *method;
-	size_t		 sz;
-
-	if ( ! md5) {
-		sz = 0;
-		fullwrite(fd, &sz, sizeof(size_t));
-		return;
-	}
-
-	uri = kworker_env(env, envsz, "PATH_INFO");
-	script = kworker_env(env, envsz, "SCRIPT_NAME");
-	method = kworker_env(env, envsz, "REQUEST_METHOD");
-
-	if (NULL == uri)
-		uri = "";
-	if (NULL == script)
-		script = "";
-	if (NULL == method)
-		method = "";
-
-	MD5Init(&ctx);
-	MD5Updatec(&ctx, method, strlen(method));
-	MD5Updatec(&ctx, ":", 1);
-	MD5Updatec(&ctx, script, strlen(script));
-	MD5Updatec(&ctx, uri, strlen(uri));
-	MD5Updatec(&ctx, ":", 1);
-	MD5Updatec(&ctx, b, bsz);
-	MD5Final(ha2, &ctx);
-
-	/* This is a binary write! */
-	sz = MD5_DIGEST_LENGTH;
-	fullwrite(fd, &sz, sizeof(size_t));
-	fullwrite(fd, ha2, sz);
-}
-
 /*
  * Parse and send the body of the request to the parent.
  * This is arguably the most complex part of the system.
+ * If we're CGI and read the body ourselves, note when we finished doing
+ * so as KTIME_BODY in "timing".
  */
 static void
 kworker_child_body(struct env *env, int fd, size_t envsz,
-	struct parms *pp, enum kmethod meth, char *b, 
-	size_t bsz, unsigned int debugging, int md5)
+	struct parms *pp, enum kmethod meth, char *b, size_t bsz, 
+	unsigned int debugging, struct bodyhash *bh, uint64_t *timing)
 {
-	size_t 	 i, len, cur;
-	char	*cp, *bp = b;
+	size_t 	 	 i, len, cur;
+	char		*cp, *bp = b;
+	struct scan	 scan;
 
 	/*
 	 * The CONTENT_LENGTH must be a valid integer.
@@ -1414,11 +2052,8 @@ kworker_child_body(struct env *env, int fd, size_t envsz,
 	if (NULL != (cp = kworker_env(env, envsz, "CONTENT_LENGTH")))
 		len = strtonum(cp, 0, LLONG_MAX, NULL);
 
-	if (0 == len) {
-		/* Remember to print our MD5 value. */
-		kworker_child_bodymd5(env, fd, envsz, "", 0, md5);
+	if (0 == len)
 		return;
-	}
 
 	/* Check FastCGI input lengths. */
 
@@ -1437,20 +2072,36 @@ kworker_child_body(struct env *env, int fd, size_t envsz,
 	pp->type = IN_FORM;
 	cp = kworker_env(env, envsz, "CONTENT_TYPE");
 
+	/*
+	 * If we're CGI and have a multipart form, we can parse the body
+	 * as it's read instead of reading it all in first.
+	 * We can't do so if we're going to print the body for debugging.
+	 */
+
+	if (NULL == b && NULL != cp &&
+	    ! (KREQ_DEBUG_READ_BODY & debugging) &&
+	    0 == strncasecmp(cp, "multipart/form-data", 19)) {
+		scan_init(&scan, len, bh);
+		parse_multi(pp, cp + 19, NULL, 0, &scan);
+		free(scan.buf);
+		timing[KTIME_BODY] = kstats_ns();
+		return;
+	}
+
 	/* 
-	 * If we're CGI, read the request now.
+	 * If we're CGI, read (and hash) the request now.
+	 * FastCGI bodies are already in memory, so hash them at once.
 	 * Note that the "bsz" can come out as zero.
 	 */
 
-	if (NULL == b)
-		b = scanbuf(len, &bsz);
+	if (NULL == b) {
+		b = scanbuf(len, &bsz, bh);
+		timing[KTIME_BODY] = kstats_ns();
+	} else if (NULL != bh->hash)
+		bh->hash->update(&bh->ctx, b, bsz);
 
 	assert(NULL != b);
 
-	/* If requested, print our MD5 value. */
-
-	kworker_child_bodymd5(env, fd, envsz, b, bsz, md5);
-
 	if (bsz && KREQ_DEBUG_READ_BODY & debugging) {
 		fprintf(stderr, "%u: ", getpid());
 		for (cur = i = 0; i < bsz; i++, cur++) {
@@ -1495,10 +2146,14 @@ kworker_child_body(struct env *env, int fd, size_t envsz,
 		if (0 == strcasecmp(cp, "application/x-www-form-urlencoded"))
 			parse_pairs_urlenc(pp, b);
 		else if (0 == strncasecmp(cp, "multipart/form-data", 19)) 
-			parse_multi(pp, cp + 19, b, bsz);
+			parse_multi(pp, cp + 19, b, bsz, NULL);
 		else if (KMETHOD_POST == meth && 0 == strcasecmp(cp, "text/plain"))
 			parse_pairs_text(pp, b);
-		else
+		else if ((KOPT_JSON_BODY & pp->flags) && json_ctype(cp)) {
+			/* The body is passed back before it's decoded. */
+			parse_body(cp, pp, b, bsz);
+			parse_json(pp, b, bsz);
+		} else
 			parse_body(cp, pp, b, bsz);
 	} else
 		parse_body(kmimetypes[KMIME_APP_OCTET_STREAM], pp, b, bsz);
@@ -1544,13 +2199,31 @@ kworker_child_cookies(struct env *env,
 
 /*
  * Terminate the input fields for the parent. 
+ * This is followed by our timing and, if the authorisation requires
+ * it, the hash of the body.
+ * The hash comes last because multipart bodies are hashed and parsed
+ * into fields as they're read.
  */
 static void
-kworker_child_last(int fd)
+kworker_child_last(int fd, uint64_t *timing, struct bodyhash *bh)
 {
-	enum input last = IN__MAX;
+	enum input	 last = IN__MAX;
+	unsigned char	 dgst[KHASH_DIGEST_MAX];
+	size_t		 sz = 0;
 
+	timing[KTIME_PARSE] = kstats_ns();
 	fullwrite(fd, &last, sizeof(enum input));
+	fullwrite(fd, timing, sizeof(uint64_t) * (KTIME_PARSE + 1));
+
+	if (NULL != bh->hash) {
+		bh->hash->final(dgst, &bh->ctx);
+		sz = bh->hash->digestsz;
+	}
+
+	/* This is a binary write! */
+	fullwrite(fd, &sz, sizeof(size_t));
+	if (sz > 0)
+		fullwrite(fd, dgst, sz);
 }
 
 /*
@@ -1564,24 +2237,27 @@ enum kcgi_err
 kworker_child(int wfd,
 	const struct kvalid *keys, size_t keysz, 
 	const char *const *mimes, size_t mimesz,
-	unsigned int debugging)
+	unsigned int debugging, const struct kopts *opts)
 {
 	struct parms	  pp;
 	char		 *cp;
 	const char	 *start;
 	char		**evp;
-	int		  md5;
+	struct bodyhash	  bh;
 	enum kmethod	  meth;
 	size_t	 	  i;
 	extern char	**environ;
 	struct env	 *envs = NULL;
 	size_t		  envsz;
+	uint64_t	  timing[KTIME_PARSE + 1];
 
+	timing[KTIME_START] = kstats_ns();
 	pp.fd = wfd;
 	pp.keys = keys;
 	pp.keysz = keysz;
 	pp.mimes = mimes;
 	pp.mimesz = mimesz;
+	pp.flags = opts->flags;
 
 	/*
 	 * Pull the entire environment into an array.
@@ -1645,21 +2321,22 @@ kworker_child(int wfd,
 	kworker_child_env(envs, wfd, envsz);
 	meth = kworker_child_method(envs, wfd, envsz);
 	kworker_child_auth(envs, wfd, envsz);
-	md5 = kworker_child_rawauth(envs, wfd, envsz);
+	kworker_child_rawauth(envs, wfd, envsz, &bh);
 	kworker_child_scheme(envs, wfd, envsz);
 	kworker_child_remote(envs, wfd, envsz);
 	kworker_child_path(envs, wfd, envsz);
 	kworker_child_scriptname(envs, wfd, envsz);
 	kworker_child_httphost(envs, wfd, envsz);
 	kworker_child_port(envs, wfd, envsz);
+	timing[KTIME_ENV] = timing[KTIME_BODY] = kstats_ns();
 
 	/* And now the message body itself. */
 
 	kworker_child_body(envs, wfd, envsz, 
-		&pp, meth, NULL, 0, debugging, md5);
+		&pp, meth, NULL, 0, debugging, &bh, timing);
 	kworker_child_query(envs, wfd, envsz, &pp);
 	kworker_child_cookies(envs, wfd, envsz, &pp);
-	kworker_child_last(wfd);
+	kworker_child_last(wfd, timing, &bh);
 
 	/* Note: the "val" is from within the key. */
 
@@ -1990,7 +2667,7 @@ void
 kworker_fcgi_child(int wfd, int work_ctl,
 	const struct kvalid *keys, size_t keysz, 
 	const char *const *mimes, size_t mimesz,
-	unsigned int debugging)
+	unsigned int debugging, const struct kopts *opts)
 {
 	struct parms 	 pp;
 	struct fcgi_hdr	*hdr, realhdr;
@@ -2001,8 +2678,10 @@ kworker_fcgi_child(int wfd, int work_ctl,
 	uint16_t	 rid;
 	uint32_t	 cookie;
 	size_t		 i, bsz, ssz, envsz;
-	int		 rc, md5;
+	int		 rc;
+	struct bodyhash	 bh;
 	enum kmethod	 meth;
+	uint64_t	 timing[KTIME_PARSE + 1];
 
 	sbuf = NULL;
 	ssz = 0;
@@ -2018,6 +2697,7 @@ kworker_fcgi_child(int wfd, int work_ctl,
 	pp.keysz = keysz;
 	pp.mimes = mimes;
 	pp.mimesz = mimesz;
+	pp.flags = opts->flags;
 
 	/*
 	 * Loop over all incoming sequences to this particular slave.
@@ -2053,6 +2733,7 @@ kworker_fcgi_child(int wfd, int work_ctl,
 		} else if (rc == 0)
 			break;
 
+		timing[KTIME_START] = kstats_ns();
 		bgn = kworker_fcgi_begin
 			(work_ctl, &realbgn, &buf, &bsz, &rid);
 		if (NULL == bgn)
@@ -2085,6 +2766,7 @@ kworker_fcgi_child(int wfd, int work_ctl,
 		}
 		if (NULL == hdr)
 			break;
+		timing[KTIME_ENV] = kstats_ns();
 
 		if (FCGI_STDIN != hdr->type) {
 			XWARNX("unexpected FastCGI header type");
@@ -2124,6 +2806,7 @@ kworker_fcgi_child(int wfd, int work_ctl,
 			XWARNX("not responding to FastCGI!?");
 			break;
 		}
+		timing[KTIME_BODY] = kstats_ns();
 
 		/* 
 		 * Notify the control process that we've received all of
@@ -2141,7 +2824,7 @@ kworker_fcgi_child(int wfd, int work_ctl,
 		kworker_child_env(envs, wfd, envsz);
 		meth = kworker_child_method(envs, wfd, envsz);
 		kworker_child_auth(envs, wfd, envsz);
-		md5 = kworker_child_rawauth(envs, wfd, envsz);
+		kworker_child_rawauth(envs, wfd, envsz, &bh);
 		kworker_child_scheme(envs, wfd, envsz);
 		kworker_child_remote(envs, wfd, envsz);
 		kworker_child_path(envs, wfd, envsz);
@@ -2153,10 +2836,10 @@ kworker_fcgi_child(int wfd, int work_ctl,
 
 		assert(NULL != sbuf);
 		kworker_child_body(envs, wfd, envsz, &pp, 
-			meth, (char *)sbuf, ssz, debugging, md5);
+			meth, (char *)sbuf, ssz, debugging, &bh, timing);
 		kworker_child_query(envs, wfd, envsz, &pp);
 		kworker_child_cookies(envs, wfd, envsz, &pp);
-		kworker_child_last(wfd);
+		kworker_child_last(wfd, timing, &bh);
 	}
 
 	for (i = 0; i < envsz; i++) {
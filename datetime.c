@@ -16,6 +16,7 @@
  */
 #include "config.h"
 
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -34,20 +35,56 @@ static const uint64_t monthdays[2][12] = {
 	{ 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
 };
 
+static const char *const days[7] = {
+	"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const char *const months[12] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
 #define LEAPYR(_yr) 	( ! ((_yr) % 4) && \
 			(((_yr) % 100) || ! ((_yr) % 400)))
-#define YEARDAY(_yr) 	(LEAPYR(_yr) ? 366 : 365)
 
 /*
- * This algorithm is simple and cribbed from NetBSD.
- * It sets the values of "tm" according to "tt", an epoch value.
+ * Days from 0000-03-01 to the epoch in the proleptic Gregorian
+ * calendar, which starts its years in March so that leap days fall at
+ * the end.
+ */
+#define	EPOCHDAYS	 ((int64_t)719468)
+
+/*
+ * Days in a 400-year era.
+ */
+#define	ERADAYS		 146097
+
+/*
+ * The last formatted date of kutil_epoch2str() and
+ * kutil_epoch2utcstr(), respectively.
+ * Dates are usually formatted for the current time over and over,
+ * so this lets us reformat only when the second changes.
+ */
+struct	datecache {
+	int64_t		 tt; /* formatted epoch or -1 */
+	char		 buf[64];
+};
+
+static	struct datecache datestr = { -1, "" };
+static	struct datecache dateutcstr = { -1, "" };
+
+/*
+ * Set the values of "tm" according to "tt", an epoch value.
  * It's truncated below at the zero epoch.
+ * This computes the civil date from the day number in constant time
+ * by splitting it into 400-year eras, each having the same number of
+ * days, then into years and months of the March-based year.
+ * See Howard Hinnant's "chrono-Compatible Low-Level Date Algorithms".
  */
 static void
 kutil_epoch2time(int64_t tt, struct tm *tm)
 {
-        time_t 	 	 time = (time_t)tt;
-        uint64_t	 dayclock, dayno, year;
+	uint64_t	 dayclock, dayno, era, doe, yoe, doy, mp, year;
 
 	memset(tm, 0, sizeof(struct tm));
 	
@@ -61,47 +98,64 @@ kutil_epoch2time(int64_t tt, struct tm *tm)
 	 * Thursday, seven days reliably per week).
 	 */
 
-        dayclock = time % (24 * 60 * 60);
-        dayno = time / (24 * 60 * 60);
+	dayclock = (uint64_t)tt % (24 * 60 * 60);
+	dayno = (uint64_t)tt / (24 * 60 * 60);
 
-	/*
-	 * Compute the time of day quite easily.
-	 * Same for the weekday.
-	 */
-
-        tm->tm_sec = dayclock % 60;
-        tm->tm_min = (dayclock % 3600) / 60;
-        tm->tm_hour = dayclock / 3600;
-        tm->tm_wday = (dayno + 4) % 7;
+	tm->tm_sec = dayclock % 60;
+	tm->tm_min = (dayclock % 3600) / 60;
+	tm->tm_hour = dayclock / 3600;
+	tm->tm_wday = (dayno + 4) % 7;
 
 	/*
-	 * More complicated: slough away the number of years.
-	 * XXX this takes time proportionate to the year, but is easier
-	 * to audit (and understand).
+	 * Now the era, day of era [0, 146096], year of era [0, 399],
+	 * day of (March-based) year [0, 365], and month starting from
+	 * March [0, 11].
 	 */
 
-	year = 1970;
-        while (dayno >= YEARDAY(year)) {
-                dayno -= YEARDAY(year);
-                year++;
-        }
+	dayno += EPOCHDAYS;
+	era = dayno / ERADAYS;
+	doe = dayno - era * ERADAYS;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	year = yoe + era * 400 + (mp >= 10);
 
-        tm->tm_year = year - 1900;
-        tm->tm_yday = dayno;
-        tm->tm_mon = 0;
+	tm->tm_year = year - 1900;
+	tm->tm_mon = mp < 10 ? mp + 2 : mp - 10;
+	tm->tm_mday = doy - (153 * mp + 2) / 5 + 1;
+	tm->tm_yday = mp < 10 ?
+		doy + 59 + LEAPYR(year) : doy - 306;
+	tm->tm_isdst = 0;
+}
 
-	/*
-	 * Similar computation as the year: increment ahead the day of
-	 * the month depending on our month value.
-	 */
+/*
+ * Write the "width" least significant decimal digits of "v" backward
+ * from "p".
+ */
+static void
+put_digits(char *p, unsigned int v, size_t width)
+{
 
-        while (dayno >= monthdays[LEAPYR(year)][tm->tm_mon]) {
-                dayno -= monthdays[LEAPYR(year)][tm->tm_mon];
-                tm->tm_mon++;
-        }
+	while (width-- > 0) {
+		*--p = '0' + v % 10;
+		v /= 10;
+	}
+}
 
-        tm->tm_mday = dayno + 1;
-        tm->tm_isdst = 0;
+/*
+ * Write the year of "tm" as at least four digits into "p".
+ * Returns the number of digits written.
+ */
+static size_t
+put_year(char *p, const struct tm *tm)
+{
+	unsigned int	 year = tm->tm_year + 1900, v;
+	size_t		 width;
+
+	for (width = 4, v = year / 10000; v > 0; v /= 10)
+		width++;
+	put_digits(p + width, year, width);
+	return(width);
 }
 
 /*
@@ -112,24 +166,69 @@ char *
 kutil_epoch2str(int64_t tt, char *buf, size_t sz)
 {
 	struct tm	 tm;
+	char		*p;
 
-	kutil_epoch2time(tt, &tm);
+	if (tt < 0)
+		tt = 0;
 
-	/* FIXME: replace with numeric values and table lookup */
+	if (tt != datestr.tt) {
+		kutil_epoch2time(tt, &tm);
+		p = datestr.buf;
+		memcpy(p, days[tm.tm_wday], 3);
+		p[3] = ',';
+		p[4] = ' ';
+		put_digits(p + 7, tm.tm_mday, 2);
+		p[7] = ' ';
+		memcpy(p + 8, months[tm.tm_mon], 3);
+		p[11] = ' ';
+		p += 12;
+		p += put_year(p, &tm);
+		*p++ = ' ';
+		put_digits(p + 2, tm.tm_hour, 2);
+		p[2] = ':';
+		put_digits(p + 5, tm.tm_min, 2);
+		p[5] = ':';
+		put_digits(p + 8, tm.tm_sec, 2);
+		memcpy(p + 8, " GMT", 5);
+		datestr.tt = tt;
+	}
 
-	strftime(buf, sz, "%a, %d %b %Y %T GMT", &tm);
+	strlcpy(buf, datestr.buf, sz);
 	return(buf);
 }
 
+/*
+ * Format an epoch time as ISO 8601, bounding below at the zero epoch.
+ * Returns "buf".
+ */
 char *
 kutil_epoch2utcstr(int64_t tt, char *buf, size_t sz)
 {
 	struct tm	 tm;
+	char		*p;
 
-	kutil_epoch2time(tt, &tm);
-	snprintf(buf, sz, "%.4d-%.2d-%.2dT%.2d:%.2d:%.2dZ",
-		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, 
-		tm.tm_hour, tm.tm_min, tm.tm_sec);
+	if (tt < 0)
+		tt = 0;
+
+	if (tt != dateutcstr.tt) {
+		kutil_epoch2time(tt, &tm);
+		p = dateutcstr.buf;
+		p += put_year(p, &tm);
+		*p++ = '-';
+		put_digits(p + 2, tm.tm_mon + 1, 2);
+		p[2] = '-';
+		put_digits(p + 5, tm.tm_mday, 2);
+		p[5] = 'T';
+		put_digits(p + 8, tm.tm_hour, 2);
+		p[8] = ':';
+		put_digits(p + 11, tm.tm_min, 2);
+		p[11] = ':';
+		put_digits(p + 14, tm.tm_sec, 2);
+		memcpy(p + 14, "Z", 2);
+		dateutcstr.tt = tt;
+	}
+
+	strlcpy(buf, dateutcstr.buf, sz);
 	return(buf);
 }
 
@@ -184,8 +283,7 @@ kutil_date2epoch(int64_t day, int64_t mon, int64_t year)
 
 	if (year < 1970 || mon < 0 || year < 0)
 		return(0);
-	return(mkdate(day, mon, year) -
-	       mkdate(1, 1, 1970));
+	return(mkdate(day, mon, year) - EPOCHDAYS * 86400);
 }
 
 int64_t
@@ -199,3 +297,68 @@ kutil_datetime2epoch(int64_t day, int64_t mon, int64_t year,
 	return(kutil_date2epoch(day, mon, year) +
 		hour * (60 * 60) + minute * 60 + sec);
 }
+
+/*
+ * Parse "sz" decimal digits from "cp" into "v".
+ * Returns zero if any aren't digits.
+ */
+static int
+get_digits(const char *cp, size_t sz, int64_t *v)
+{
+
+	for (*v = 0; sz > 0; sz--, cp++) {
+		if ( ! isdigit((unsigned char)*cp))
+			return(0);
+		*v = *v * 10 + (*cp - '0');
+	}
+	return(1);
+}
+
+/*
+ * Parse an RFC 7231 section 7.1.1.1 IMF-fixdate, e.g.,
+ * "Sun, 06 Nov 1994 08:49:37 GMT", into an epoch value.
+ * The day of week must be valid, but needn't match the date.
+ * Returns zero if the string isn't a date on or after the epoch.
+ */
+int
+kutil_str2epoch(const char *cp, int64_t *res)
+{
+	int64_t	 mday, mon, year, hour, min, sec;
+	size_t	 i;
+
+	if (29 != strlen(cp) ||
+	    ',' != cp[3] || ' ' != cp[4] || ' ' != cp[7] ||
+	    ' ' != cp[11] || ' ' != cp[16] || ':' != cp[19] || 
+	    ':' != cp[22] || strcmp(cp + 25, " GMT"))
+		return(0);
+
+	for (i = 0; i < 7; i++)
+		if (0 == memcmp(cp, days[i], 3))
+			break;
+	if (7 == i)
+		return(0);
+
+	for (mon = 0; mon < 12; mon++)
+		if (0 == memcmp(cp + 8, months[mon], 3))
+			break;
+	if (12 == mon)
+		return(0);
+
+	if ( ! get_digits(cp + 5, 2, &mday) ||
+	     ! get_digits(cp + 12, 4, &year) ||
+	     ! get_digits(cp + 17, 2, &hour) ||
+	     ! get_digits(cp + 20, 2, &min) ||
+	     ! get_digits(cp + 23, 2, &sec))
+		return(0);
+
+	/* Seconds may be 60 for a leap second. */
+
+	if (year < 1970 || mday < 1 || hour > 23 || min > 59 || sec > 60)
+		return(0);
+	if ((uint64_t)mday > monthdays[LEAPYR(year)][mon])
+		return(0);
+
+	*res = mkdate(mday, mon + 1, year) - EPOCHDAYS * 86400 +
+		hour * (60 * 60) + min * 60 + sec;
+	return(1);
+}
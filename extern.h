@@ -39,25 +39,31 @@ enum	sandtype {
 #define KWORKER_CHILD	0
 
 
+struct	kstats_slot;
+
 __BEGIN_DECLS
 
-struct kdata	*kdata_alloc(int, int, uint16_t, 
-			unsigned int, const struct kopts *);
+struct kdata	*kdata_alloc(int, int, uint16_t, unsigned int, 
+			const struct kopts *, volatile struct kstats_slot *,
+			uint64_t *);
 void		 kdata_body(struct kdata *);
 int		 kdata_compress(struct kdata *);
+void		 kdata_etag(struct kdata *, int, const char *);
 void		 kdata_free(struct kdata *, int);
+int		 kdata_status(const struct kdata *, uint64_t *);
 
-int		 kworker_auth_child(int, const char *);
+enum khttpalg	 kworker_auth_child(int, const char *);
 enum kcgi_err	 kworker_auth_parent(int, struct khttpauth *);
 enum kcgi_err	 kworker_child(int,
 			const struct kvalid *, size_t, 
 			const char *const *, size_t,
-			unsigned int);
+			unsigned int, const struct kopts *);
 void	 	 kworker_fcgi_child(int, int,
 			const struct kvalid *, size_t, 
 			const char *const *, size_t,
-			unsigned int);
-enum kcgi_err	 kworker_parent(int, struct kreq *, int, size_t);
+			unsigned int, const struct kopts *);
+enum kcgi_err	 kworker_parent(int, struct kreq *, int, 
+			size_t, const struct kopts *);
 
 int		 fulldiscard(int, size_t, enum kcgi_err *);
 int		 fullread(int, void *, size_t, int, enum kcgi_err *);
@@ -69,6 +75,10 @@ int		 fullwritenoerr(int, const void *, size_t);
 void		 fullwriteword(int, const char *);
 int		 fullwritefd(int, int, void *, size_t);
 
+int		 klogbuf_idle(void);
+
+uint64_t	 kstats_ns(void);
+
 int		 ksandbox_alloc(void **);
 void		 ksandbox_close(void *);
 void		 ksandbox_free(void *);
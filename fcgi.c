@@ -17,7 +17,10 @@
 #include "config.h"
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include <assert.h>
 #include <errno.h>
@@ -31,10 +34,12 @@
 #include <stdlib.h>
 #include <stdio.h> /* BUFSIZ */
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "kcgi.h"
 #include "extern.h"
+#include "stats.h"
 
 struct	kfcgi {
 	const struct kvalid	 *keys;
@@ -55,6 +60,9 @@ struct	kfcgi {
 	int			  sock_ctl;
 	struct kopts		  opts;
 	void			 *arg;
+	volatile struct kstats_slot *stats; /* kfcgi(8) statistics */
+	void			 *statsmap; /* mapping of stats */
+	size_t			  statsmapsz;
 };
 
 static	volatile sig_atomic_t sig = 0;
@@ -66,6 +74,87 @@ dosignal(int arg)
 	sig = 1;
 }
 
+/*
+ * Monotonic time in nanoseconds for our statistics.
+ */
+uint64_t
+kstats_ns(void)
+{
+	struct timespec	 ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * If kfcgi(8) has given us a statistics file, map it and return our
+ * slot, noting the mapping in "map" and "mapsz".
+ * The descriptor is closed: we only need the mapping, which is
+ * inherited by our control and worker processes.
+ * Returns NULL if there's no (usable) file.
+ */
+static volatile struct kstats_slot *
+kstats_attach(void **map, size_t *mapsz)
+{
+	const char	*cp, *ercp;
+	int		 fd;
+	size_t		 slot;
+	struct stat	 st;
+	struct kstats_hdr *hdr;
+
+	*map = NULL;
+	*mapsz = 0;
+
+	if (NULL == (cp = getenv("KFCGI_STATS_FD")))
+		return(NULL);
+	fd = strtonum(cp, 0, INT_MAX, &ercp);
+	if (NULL != ercp)
+		return(NULL);
+	if (NULL == (cp = getenv("KFCGI_STATS_SLOT"))) {
+		close(fd);
+		return(NULL);
+	}
+	slot = strtonum(cp, 0, INT_MAX, &ercp);
+	if (NULL != ercp) {
+		close(fd);
+		return(NULL);
+	}
+
+	if (-1 == fstat(fd, &st)) {
+		XWARN("fstat: statistics");
+		close(fd);
+		return(NULL);
+	} else if ((size_t)st.st_size < sizeof(struct kstats_hdr)) {
+		XWARNX("statistics file too small");
+		close(fd);
+		return(NULL);
+	}
+
+	*mapsz = st.st_size;
+	*map = mmap(NULL, *mapsz, 
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == *map) {
+		XWARN("mmap: statistics");
+		*map = NULL;
+		*mapsz = 0;
+		return(NULL);
+	}
+
+	hdr = *map;
+	if (KSTATS_MAGIC != hdr->magic || slot >= hdr->slots ||
+	    sizeof(struct kstats_hdr) + (slot + 1) * 
+	    sizeof(struct kstats_slot) > *mapsz) {
+		XWARNX("statistics file invalid");
+		munmap(*map, *mapsz);
+		*map = NULL;
+		*mapsz = 0;
+		return(NULL);
+	}
+
+	return((struct kstats_slot *)(hdr + 1) + slot);
+}
+
 /*
  * This is our control process.
  * It listens for FastCGI connections on STDIN_FILENO ("fdaccept") xor
@@ -78,7 +167,8 @@ dosignal(int arg)
  * It will close the fdaccept or fdfiled descriptor.
  */
 static int
-kfcgi_control(int work, int ctrl, int fdaccept, int fdfiled)
+kfcgi_control(int work, int ctrl, int fdaccept, int fdfiled,
+	volatile struct kstats_slot *stats)
 {
 	struct sockaddr_storage ss;
 	socklen_t	 sslen;
@@ -173,6 +263,11 @@ kfcgi_control(int work, int ctrl, int fdaccept, int fdfiled)
 			goto out;
 		}
 
+		if (NULL != stats) {
+			stats->mark = kstats_ns();
+			stats->state = KSTATS_PARSE;
+		}
+
 		/* This doesn't need to be crypto quality. */
 #if HAVE_ARC4RANDOM
 		cookie = arc4random();
@@ -238,6 +333,8 @@ kfcgi_control(int work, int ctrl, int fdaccept, int fdfiled)
 				XWARNX("work request empty read");
 				goto out;
 			}
+			if (NULL != stats)
+				stats->bytesin += ssz;
 			rc = fullwritenoerr(pfd[1].fd, buf, ssz);
 			if (rc < 0) {
 				XWARNX("worker write error");
@@ -326,6 +423,8 @@ void
 khttp_fcgi_child_free(struct kfcgi *fcgi)
 {
 
+	if (NULL != fcgi->statsmap)
+		munmap(fcgi->statsmap, fcgi->statsmapsz);
 	close(fcgi->sock_ctl);
 	close(fcgi->work_dat);
 	ksandbox_free(fcgi->work_box);
@@ -348,6 +447,8 @@ khttp_fcgi_free(struct kfcgi *fcgi)
 	ksandbox_free(fcgi->work_box);
 	ksandbox_close(fcgi->sock_box);
 	ksandbox_free(fcgi->sock_box);
+	if (NULL != fcgi->statsmap)
+		munmap(fcgi->statsmap, fcgi->statsmapsz);
 	free(fcgi);
 	return(KCGI_OK);
 }
@@ -369,6 +470,10 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 	const char	*cp, *ercp;
 	sigset_t	 mask;
 	enum sandtype	 st;
+	struct kopts	 kopts;
+	volatile struct kstats_slot *stats;
+	void		*statsmap;
+	size_t		 statsmapsz;
 
 	/*
 	 * Determine whether we're supposed to accept() on a socket or,
@@ -387,6 +492,16 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 	} else
 		fdaccept = STDIN_FILENO;
 
+	/* Our worker also needs the options, so set them up now. */
+
+	if (NULL == opts)
+		khttp_opts_init(&kopts);
+	else
+		memcpy(&kopts, opts, sizeof(struct kopts));
+
+	if (kopts.sndbufsz < 0)
+		kopts.sndbufsz = UINT16_MAX;
+
 	/*
 	 * Block this signal unless we're right at the fullreadfd
 	 * function, at which point unblock and let it interrupt us.
@@ -460,7 +575,7 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 				(work_dat[KWORKER_CHILD],
 				 work_ctl[KWORKER_CHILD],
 				 keys, keysz, mimes, mimesz,
-				 debugging);
+				 debugging, &kopts);
 			er = EXIT_SUCCESS;
 		}
 		ksandbox_free(work_box);
@@ -496,9 +611,14 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 		return(KCGI_SYSTEM);
 	}
 
+	/* Our control process also records statistics. */
+	stats = kstats_attach(&statsmap, &statsmapsz);
+
 	if (-1 == (sock_pid = fork())) {
 		er = errno;
 		XWARN("fork");
+		if (NULL != statsmap)
+			munmap(statsmap, statsmapsz);
 		close(work_dat[KWORKER_PARENT]);
 		close(work_ctl[KWORKER_PARENT]);
 		close(sock_ctl[KWORKER_CHILD]);
@@ -525,7 +645,7 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 			er = kfcgi_control
 				(work_ctl[KWORKER_PARENT], 
 				 sock_ctl[KWORKER_CHILD],
-				 fdaccept, fdfiled);
+				 fdaccept, fdfiled, stats);
 		close(work_ctl[KWORKER_PARENT]);
 		close(sock_ctl[KWORKER_CHILD]);
 		ksandbox_free(sock_box);
@@ -542,6 +662,8 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 
 	if ( ! ksandbox_init_parent(sock_box, st, sock_pid)) {
 		XWARNX("ksandbox_init_parent");
+		if (NULL != statsmap)
+			munmap(statsmap, statsmapsz);
 		close(sock_ctl[KWORKER_PARENT]);
 		close(work_dat[KWORKER_PARENT]);
 		kxwaitpid(work_pid);
@@ -556,6 +678,8 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 	/* Now allocate our device. */
 	*fcgip = fcgi = XCALLOC(1, sizeof(struct kfcgi));
 	if (NULL == fcgi) {
+		if (NULL != statsmap)
+			munmap(statsmap, statsmapsz);
 		close(sock_ctl[KWORKER_PARENT]);
 		close(work_dat[KWORKER_PARENT]);
 		kxwaitpid(work_pid);
@@ -567,14 +691,7 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 		return(KCGI_ENOMEM);
 	}
 
-	if (NULL == opts)
-		fcgi->opts.sndbufsz = -1;
-	else
-		memcpy(&fcgi->opts, opts, sizeof(struct kopts));
-
-	if (fcgi->opts.sndbufsz < 0)
-		fcgi->opts.sndbufsz = UINT16_MAX;
-
+	memcpy(&fcgi->opts, &kopts, sizeof(struct kopts));
 	fcgi->work_box = work_box;
 	fcgi->work_pid = work_pid;
 	fcgi->work_dat = work_dat[KWORKER_PARENT];
@@ -592,6 +709,9 @@ khttp_fcgi_initx(struct kfcgi **fcgip,
 	fcgi->pagesz = pagesz;
 	fcgi->defpage = defpage;
 	fcgi->debugging = debugging;
+	fcgi->stats = stats;
+	fcgi->statsmap = statsmap;
+	fcgi->statsmapsz = statsmapsz;
 	return(KCGI_OK);
 }
 
@@ -612,24 +732,38 @@ khttp_fcgi_init(struct kfcgi **fcgi,
  * Here we wait for the next FastCGI connection in such a way that, if
  * we're notified that we must exit via a SIGTERM, we'll properly close
  * down without spurious warnings.
+ * SIGTERM is atomically unblocked only for the duration of the wait,
+ * so we needn't wake up periodically to check for it.
+ * A hangup is reported as readable and picked up by the caller.
  */
 static int 
 fcgi_waitread(int fd)
 {
-	int		 rc;
-	struct pollfd	 pfd;
+	int		 rc, logwait;
+	fd_set		 rfds;
 	sigset_t	 mask;
+	struct timespec	 ts;
 
-again:
-	pfd.fd = fd;
-	pfd.events = POLLIN;
+	if (sigprocmask(SIG_BLOCK, NULL, &mask) < 0) {
+		XWARN("sigprocmask");
+		return(-1);
+	}
+	sigdelset(&mask, SIGTERM);
 
-	/* Unblock SIGTERM around the poll(). */
-	sigemptyset(&mask);
-	sigaddset(&mask, SIGTERM);
-	sigprocmask(SIG_UNBLOCK, &mask, NULL);
-	rc = poll(&pfd, 1, 1000);
-	sigprocmask(SIG_UNBLOCK, &mask, NULL);
+	/*
+	 * We may wait for a long time, so wake up to write out log
+	 * lines still queued when they're due.
+	 */
+	do {
+		logwait = klogbuf_idle();
+		ts.tv_sec = logwait;
+		ts.tv_nsec = 0;
+		FD_ZERO(&rfds);
+		FD_SET(fd, &rfds);
+		rc = pselect(fd + 1, &rfds, NULL, NULL, 
+			logwait ? &ts : NULL, &mask);
+	} while ((0 == rc || 
+		 (rc < 0 && EINTR == errno)) && ! sig);
 
 	/* Exit signal has been set. */
 	if (sig) {
@@ -637,21 +771,13 @@ again:
 		return(0);
 	}
 
-	/* Problems?  Exit.  Timeout?  Retry. */
 	if (rc < 0) {
-		XWARN("poll");
+		XWARN("pselect");
 		return(-1);
-	} else if (0 == rc) 
-		goto again;
-
-	/* Only POLLIN is a "good" exit from this. */
-	if (POLLIN & pfd.revents)
-		return(1);
-	else if (POLLHUP & pfd.revents)
-		return(0);
+	}
 
-	XWARNX("poll: error");
-	return(-1);
+	assert(FD_ISSET(fd, &rfds));
+	return(1);
 }
 
 enum kcgi_err
@@ -689,8 +815,8 @@ khttp_fcgi_parse(struct kfcgi *fcgi, struct kreq *req)
 	req->arg = fcgi->arg;
 	req->keys = fcgi->keys;
 	req->keysz = fcgi->keysz;
-	req->kdata = kdata_alloc(fcgi->sock_ctl, 
-		fd, rid, fcgi->debugging, &fcgi->opts);
+	req->kdata = kdata_alloc(fcgi->sock_ctl, fd, rid, 
+		fcgi->debugging, &fcgi->opts, fcgi->stats, req->timing);
 	if (NULL == req->kdata)
 		goto err;
 	fd = -1;
@@ -718,7 +844,8 @@ khttp_fcgi_parse(struct kfcgi *fcgi, struct kreq *req)
 	 * We'll wait perpetually on data until the channel closes or
 	 * until we're interrupted during a read by the parent.
 	 */
-	kerr = kworker_parent(fcgi->work_dat, req, 0, fcgi->mimesz);
+	kerr = kworker_parent(fcgi->work_dat, 
+		req, 0, fcgi->mimesz, &fcgi->opts);
 	if (sig) {
 		kerr = KCGI_OK;
 		goto err;
@@ -745,6 +872,11 @@ khttp_fcgi_parse(struct kfcgi *fcgi, struct kreq *req)
 			req->mime = fcgi->mimesz;
 	}
 
+	if (NULL != fcgi->stats) {
+		fcgi->stats->parsens += kstats_ns() - fcgi->stats->mark;
+		fcgi->stats->mark = kstats_ns();
+		fcgi->stats->state = KSTATS_HANDLE;
+	}
 	return(kerr);
 err:
 	if (-1 != fd)
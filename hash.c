@@ -0,0 +1,507 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_MD5
+# include <sys/types.h>
+# include <md5.h>
+#endif
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kcgi.h"
+#include "hash.h"
+
+/*
+ * Portable SHA-256 and SHA-512/256 as specified by FIPS 180-4.
+ * Whole blocks are compressed directly from the input; only partial
+ * blocks are buffered.
+ */
+
+#define	ROR32(_x, _n) (((_x) >> (_n)) | ((_x) << (32 - (_n))))
+#define	ROR64(_x, _n) (((_x) >> (_n)) | ((_x) << (64 - (_n))))
+
+static	const uint32_t sha256k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static	const uint64_t sha512k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL,
+	0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+	0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL,
+	0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL,
+	0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL,
+	0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL,
+	0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL,
+	0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL,
+	0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+	0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL,
+	0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL,
+	0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+	0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL,
+	0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static void
+sha256_block(uint32_t *st, const unsigned char *p)
+{
+	uint32_t	 w[64], a, b, c, d, e, f, g, h, t1, t2;
+	size_t		 i;
+
+	for (i = 0; i < 16; i++, p += 4)
+		w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+			(uint32_t)p[2] << 8 | (uint32_t)p[3];
+	for ( ; i < 64; i++)
+		w[i] = w[i - 16] + w[i - 7] +
+			(ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ 
+			 (w[i - 15] >> 3)) +
+			(ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ 
+			 (w[i - 2] >> 10));
+
+	a = st[0]; b = st[1]; c = st[2]; d = st[3];
+	e = st[4]; f = st[5]; g = st[6]; h = st[7];
+
+	for (i = 0; i < 64; i++) {
+		t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) +
+			((e & f) ^ (~e & g)) + sha256k[i] + w[i];
+		t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) +
+			((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+	st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+static void
+sha512_block(uint64_t *st, const unsigned char *p)
+{
+	uint64_t	 w[80], a, b, c, d, e, f, g, h, t1, t2;
+	size_t		 i, j;
+
+	for (i = 0; i < 16; i++, p += 8)
+		for (w[i] = 0, j = 0; j < 8; j++)
+			w[i] = w[i] << 8 | p[j];
+	for ( ; i < 80; i++)
+		w[i] = w[i - 16] + w[i - 7] +
+			(ROR64(w[i - 15], 1) ^ ROR64(w[i - 15], 8) ^ 
+			 (w[i - 15] >> 7)) +
+			(ROR64(w[i - 2], 19) ^ ROR64(w[i - 2], 61) ^ 
+			 (w[i - 2] >> 6));
+
+	a = st[0]; b = st[1]; c = st[2]; d = st[3];
+	e = st[4]; f = st[5]; g = st[6]; h = st[7];
+
+	for (i = 0; i < 80; i++) {
+		t1 = h + (ROR64(e, 14) ^ ROR64(e, 18) ^ ROR64(e, 41)) +
+			((e & f) ^ (~e & g)) + sha512k[i] + w[i];
+		t2 = (ROR64(a, 28) ^ ROR64(a, 34) ^ ROR64(a, 39)) +
+			((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+	st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+static void
+sha256_init(union khashctx *ctx)
+{
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(ctx->sha256.state, iv, sizeof(iv));
+	ctx->sha256.count = 0;
+}
+
+static void
+sha512_256_init(union khashctx *ctx)
+{
+	static const uint64_t iv[8] = {
+		0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL,
+		0x2393b86b6f53b151ULL, 0x963877195940eabdULL,
+		0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL,
+		0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL
+	};
+
+	memcpy(ctx->sha512.state, iv, sizeof(iv));
+	ctx->sha512.count = 0;
+}
+
+static void
+sha256_update(union khashctx *ctx, const void *buf, size_t sz)
+{
+	struct ksha256		*s = &ctx->sha256;
+	const unsigned char	*p = buf;
+	size_t			 have, need;
+
+	have = s->count % sizeof(s->buf);
+	s->count += sz;
+
+	if (have > 0) {
+		need = sizeof(s->buf) - have;
+		if (sz < need) {
+			memcpy(s->buf + have, p, sz);
+			return;
+		}
+		memcpy(s->buf + have, p, need);
+		sha256_block(s->state, s->buf);
+		p += need;
+		sz -= need;
+	}
+
+	for ( ; sz >= sizeof(s->buf); p += sizeof(s->buf))  {
+		sha256_block(s->state, p);
+		sz -= sizeof(s->buf);
+	}
+	memcpy(s->buf, p, sz);
+}
+
+static void
+sha512_update(union khashctx *ctx, const void *buf, size_t sz)
+{
+	struct ksha512		*s = &ctx->sha512;
+	const unsigned char	*p = buf;
+	size_t			 have, need;
+
+	have = s->count % sizeof(s->buf);
+	s->count += sz;
+
+	if (have > 0) {
+		need = sizeof(s->buf) - have;
+		if (sz < need) {
+			memcpy(s->buf + have, p, sz);
+			return;
+		}
+		memcpy(s->buf + have, p, need);
+		sha512_block(s->state, s->buf);
+		p += need;
+		sz -= need;
+	}
+
+	for ( ; sz >= sizeof(s->buf); p += sizeof(s->buf))  {
+		sha512_block(s->state, p);
+		sz -= sizeof(s->buf);
+	}
+	memcpy(s->buf, p, sz);
+}
+
+/*
+ * Pad the final block with a one bit, zeroes, and the big-endian bit
+ * count filling its last "lensz" bytes (of which we only use the last
+ * eight), compressing as necessary.
+ */
+static void
+sha_pad(unsigned char *buf, size_t bufsz, size_t lensz, uint64_t count,
+	void *st, void (*block)(void *, const unsigned char *))
+{
+	size_t		 have, i;
+	uint64_t	 bits = count << 3;
+
+	have = count % bufsz;
+	buf[have++] = 0x80;
+	if (have > bufsz - lensz) {
+		memset(buf + have, 0, bufsz - have);
+		block(st, buf);
+		have = 0;
+	}
+	memset(buf + have, 0, bufsz - have);
+	for (i = 0; i < 8; i++)
+		buf[bufsz - 1 - i] = bits >> (i * 8);
+	block(st, buf);
+}
+
+static void
+sha256_blockv(void *st, const unsigned char *p)
+{
+
+	sha256_block(st, p);
+}
+
+static void
+sha512_blockv(void *st, const unsigned char *p)
+{
+
+	sha512_block(st, p);
+}
+
+static void
+sha256_final(unsigned char *dgst, union khashctx *ctx)
+{
+	struct ksha256	*s = &ctx->sha256;
+	size_t		 i;
+
+	sha_pad(s->buf, sizeof(s->buf), 8, 
+		s->count, s->state, sha256_blockv);
+	for (i = 0; i < 32; i++)
+		dgst[i] = s->state[i / 4] >> (24 - (i % 4) * 8);
+}
+
+/*
+ * SHA-512/256 is SHA-512 with its own initial values and its digest
+ * truncated to 256 bits.
+ */
+static void
+sha512_256_final(unsigned char *dgst, union khashctx *ctx)
+{
+	struct ksha512	*s = &ctx->sha512;
+	size_t		 i;
+
+	sha_pad(s->buf, sizeof(s->buf), 16, 
+		s->count, s->state, sha512_blockv);
+	for (i = 0; i < 32; i++)
+		dgst[i] = s->state[i / 8] >> (56 - (i % 8) * 8);
+}
+
+static void
+md5_init(union khashctx *ctx)
+{
+
+	MD5Init(&ctx->md5);
+}
+
+static void
+md5_update(union khashctx *ctx, const void *buf, size_t sz)
+{
+
+	MD5Update(&ctx->md5, (const u_int8_t *)buf, sz);
+}
+
+static void
+md5_final(unsigned char *dgst, union khashctx *ctx)
+{
+
+	MD5Final(dgst, &ctx->md5);
+}
+
+static	const struct khash khashes[] = {
+	{ "MD5", MD5_DIGEST_LENGTH, 
+	  md5_init, md5_update, md5_final },
+	{ "SHA-256", 32, 
+	  sha256_init, sha256_update, sha256_final },
+	{ "SHA-512-256", 32, 
+	  sha512_256_init, sha512_update, sha512_256_final }
+};
+
+/*
+ * Return the hash function of the digest algorithm or NULL if it is
+ * unknown (KHTTPALG__MAX).
+ * Session variants use the same function as their base.
+ */
+const struct khash *
+khash_get(enum khttpalg alg)
+{
+
+	switch (alg) {
+	case (KHTTPALG_MD5):
+	case (KHTTPALG_MD5_SESS):
+		return(&khashes[0]);
+	case (KHTTPALG_SHA256):
+	case (KHTTPALG_SHA256_SESS):
+		return(&khashes[1]);
+	case (KHTTPALG_SHA512_256):
+	case (KHTTPALG_SHA512_256_SESS):
+		return(&khashes[2]);
+	default:
+		break;
+	}
+	return(NULL);
+}
+
+/*
+ * XXH64 with a zero seed, as specified by its reference implementation.
+ * Like SHA-2 above, whole stripes are consumed straight from the input.
+ */
+
+#define	XXH_P1	 0x9e3779b185ebca87ULL
+#define	XXH_P2	 0xc2b2ae3d27d4eb4fULL
+#define	XXH_P3	 0x165667b19e3779f9ULL
+#define	XXH_P4	 0x85ebca77c2b2ae63ULL
+#define	XXH_P5	 0x27d4eb2f165667c5ULL
+
+#define	ROL64(_x, _n) (((_x) << (_n)) | ((_x) >> (64 - (_n))))
+
+static uint64_t
+xxh_read64(const unsigned char *p)
+{
+	uint64_t	 v = 0;
+	size_t		 i;
+
+	for (i = 8; i > 0; i--)
+		v = v << 8 | p[i - 1];
+	return(v);
+}
+
+static uint64_t
+xxh_round(uint64_t acc, uint64_t v)
+{
+
+	acc += v * XXH_P2;
+	acc = ROL64(acc, 31);
+	return(acc * XXH_P1);
+}
+
+static uint64_t
+xxh_merge(uint64_t acc, uint64_t v)
+{
+
+	acc ^= xxh_round(0, v);
+	return(acc * XXH_P1 + XXH_P4);
+}
+
+static void
+xxh_stripe(uint64_t *v, const unsigned char *p)
+{
+
+	v[0] = xxh_round(v[0], xxh_read64(p));
+	v[1] = xxh_round(v[1], xxh_read64(p + 8));
+	v[2] = xxh_round(v[2], xxh_read64(p + 16));
+	v[3] = xxh_round(v[3], xxh_read64(p + 24));
+}
+
+void
+kxxh64_init(struct kxxh64 *s)
+{
+
+	memset(s, 0, sizeof(struct kxxh64));
+	s->v[0] = XXH_P1 + XXH_P2;
+	s->v[1] = XXH_P2;
+	s->v[2] = 0;
+	s->v[3] = -XXH_P1;
+}
+
+void
+kxxh64_update(struct kxxh64 *s, const void *buf, size_t sz)
+{
+	const unsigned char	*p = buf;
+	size_t			 have, need;
+
+	have = s->count % sizeof(s->buf);
+	s->count += sz;
+
+	if (have > 0) {
+		need = sizeof(s->buf) - have;
+		if (sz < need) {
+			memcpy(s->buf + have, p, sz);
+			return;
+		}
+		memcpy(s->buf + have, p, need);
+		xxh_stripe(s->v, s->buf);
+		p += need;
+		sz -= need;
+	}
+
+	for ( ; sz >= sizeof(s->buf); p += sizeof(s->buf)) {
+		xxh_stripe(s->v, p);
+		sz -= sizeof(s->buf);
+	}
+	memcpy(s->buf, p, sz);
+}
+
+/*
+ * Return the hash of everything so far.
+ * This doesn't modify the state, so hashing may continue.
+ */
+uint64_t
+kxxh64_final(const struct kxxh64 *s)
+{
+	uint64_t		 h;
+	const unsigned char	*p = s->buf;
+	size_t			 sz = s->count % sizeof(s->buf);
+
+	if (s->count >= sizeof(s->buf)) {
+		h = ROL64(s->v[0], 1) + ROL64(s->v[1], 7) +
+			ROL64(s->v[2], 12) + ROL64(s->v[3], 18);
+		h = xxh_merge(h, s->v[0]);
+		h = xxh_merge(h, s->v[1]);
+		h = xxh_merge(h, s->v[2]);
+		h = xxh_merge(h, s->v[3]);
+	} else
+		h = XXH_P5;
+
+	h += s->count;
+
+	for ( ; sz >= 8; p += 8, sz -= 8) {
+		h ^= xxh_round(0, xxh_read64(p));
+		h = ROL64(h, 27) * XXH_P1 + XXH_P4;
+	}
+	if (sz >= 4) {
+		h ^= (uint64_t)(p[0] | p[1] << 8 | p[2] << 16 | 
+			(uint32_t)p[3] << 24) * XXH_P1;
+		h = ROL64(h, 23) * XXH_P2 + XXH_P3;
+		p += 4;
+		sz -= 4;
+	}
+	for ( ; sz > 0; p++, sz--) {
+		h ^= *p * XXH_P5;
+		h = ROL64(h, 11) * XXH_P1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	return(h);
+}
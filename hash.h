@@ -0,0 +1,72 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef HASH_H
+#define HASH_H
+
+/*
+ * Hash functions used by HTTP digest authentication, RFC 7616, and for
+ * automatic ETags.
+ * The digest functions are used through the vtables returned by
+ * khash_get() so that an accelerated implementation may be substituted
+ * for the portable one in hash.c without touching the callers.
+ * The includer must have the MD5_CTX definition (see config.h).
+ */
+#define	KHASH_DIGEST_MAX	 32 /* largest digest in bytes */
+
+struct	ksha256 {
+	uint32_t	 state[8];
+	uint64_t	 count; /* bytes hashed */
+	unsigned char	 buf[64];
+};
+
+struct	ksha512 {
+	uint64_t	 state[8];
+	uint64_t	 count; /* bytes hashed */
+	unsigned char	 buf[128];
+};
+
+union	khashctx {
+	MD5_CTX		 md5;
+	struct ksha256	 sha256;
+	struct ksha512	 sha512;
+};
+
+struct	khash {
+	const char	*name;
+	size_t		 digestsz; /* bytes in digest */
+	void		(*init)(union khashctx *);
+	void		(*update)(union khashctx *, const void *, size_t);
+	void		(*final)(unsigned char *, union khashctx *);
+};
+
+/*
+ * XXH64, a fast non-cryptographic hash used for the automatic ETag of
+ * buffered responses (see KOPT_ETAG).
+ */
+struct	kxxh64 {
+	uint64_t	 v[4]; /* accumulators */
+	uint64_t	 count; /* bytes hashed */
+	unsigned char	 buf[32];
+};
+
+const struct khash *khash_get(enum khttpalg);
+
+void		 kxxh64_init(struct kxxh64 *);
+void		 kxxh64_update(struct kxxh64 *, const void *, size_t);
+uint64_t	 kxxh64_final(const struct kxxh64 *);
+
+#endif
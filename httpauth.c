@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "kcgi.h"
 #include "extern.h"
@@ -55,12 +56,22 @@ struct	pdigest {
 	uint32_t	 count;
 };
 
+/*
+ * Number of strings in a struct khttpdigest, passed from the child to
+ * the parent together.
+ */
+#define	KDIGEST_STRS	 7
+
 /*
  * Hash algorithm identifiers.
  */
 static	const char *const httpalgs[KHTTPALG__MAX] = {
 	"MD5", /* KHTTPALG_MD5 */
-	"MD5-sess" /* KHTTPALG_MD5_SESS */
+	"MD5-sess", /* KHTTPALG_MD5_SESS */
+	"SHA-256", /* KHTTPALG_SHA256 */
+	"SHA-256-sess", /* KHTTPALG_SHA256_SESS */
+	"SHA-512-256", /* KHTTPALG_SHA512_256 */
+	"SHA-512-256-sess" /* KHTTPALG_SHA512_256_SESS */
 };
 
 /*
@@ -263,15 +274,19 @@ khttpbasic_input(int fd, const char *cp)
 /*
  * Parse HTTP ``Digest'' authentication tokens from the NUL-terminated
  * string, which can be NULL or malformed.
+ * Returns the algorithm with which to hash the body (for "auth-int")
+ * or KHTTPALG__MAX if it needn't be hashed.
  */
-static int
+static enum khttpalg
 khttpdigest_input(int fd, const char *cp)
 {
 	enum kauth	 auth;
 	const char	*start;
+	char		*buf;
 	int		 rc, authorised;
-	size_t		 sz;
+	size_t		 i, sz, sizes[KDIGEST_STRS];
 	struct pdigest	 d;
+	struct pdigbuf	*bufs[KDIGEST_STRS];
 
 	auth = KAUTH_DIGEST;
 	fullwrite(fd, &auth, sizeof(enum kauth));
@@ -311,8 +326,11 @@ khttpdigest_input(int fd, const char *cp)
 		0 != d.response.sz &&
 		0 != d.uri.sz;
 
-	/* Additional requirements: MD5-sess. */
-	if (authorised && KHTTPALG_MD5_SESS == d.alg) 
+	/* Additional requirements: session algorithms. */
+	if (authorised && 
+	    (KHTTPALG_MD5_SESS == d.alg ||
+	     KHTTPALG_SHA256_SESS == d.alg ||
+	     KHTTPALG_SHA512_256_SESS == d.alg))
 		authorised = 0 != d.cnonce.sz;
 
 	/* Additional requirements: qop. */
@@ -326,28 +344,104 @@ khttpdigest_input(int fd, const char *cp)
 	fullwrite(fd, &authorised, sizeof(int));
 
 	if ( ! authorised)
-		return(0);
+		return(KHTTPALG__MAX);
+
+	/*
+	 * Pass the strings back as one NUL-separated block, preceded
+	 * by their lengths, so the parent can read them into a single
+	 * allocation.
+	 */
+
+	bufs[0] = &d.user;
+	bufs[1] = &d.uri;
+	bufs[2] = &d.realm;
+	bufs[3] = &d.nonce;
+	bufs[4] = &d.cnonce;
+	bufs[5] = &d.response;
+	bufs[6] = &d.opaque;
+
+	for (sz = i = 0; i < KDIGEST_STRS; i++) {
+		sizes[i] = bufs[i]->sz;
+		sz += sizes[i] + 1;
+	}
+	if (NULL == (buf = XMALLOC(sz)))
+		_exit(EXIT_FAILURE);
+	for (sz = i = 0; i < KDIGEST_STRS; i++) {
+		memcpy(buf + sz, bufs[i]->pos, sizes[i]);
+		sz += sizes[i];
+		buf[sz++] = '\0';
+	}
 
 	fullwrite(fd, &d.alg, sizeof(enum khttpalg));
 	fullwrite(fd, &d.qop, sizeof(enum khttpqop));
-	fullwrite(fd, &d.user.sz, sizeof(size_t));
-	fullwrite(fd, d.user.pos, d.user.sz);
-	fullwrite(fd, &d.uri.sz, sizeof(size_t));
-	fullwrite(fd, d.uri.pos, d.uri.sz);
-	fullwrite(fd, &d.realm.sz, sizeof(size_t));
-	fullwrite(fd, d.realm.pos, d.realm.sz);
-	fullwrite(fd, &d.nonce.sz, sizeof(size_t));
-	fullwrite(fd, d.nonce.pos, d.nonce.sz);
-	fullwrite(fd, &d.cnonce.sz, sizeof(size_t));
-	fullwrite(fd, d.cnonce.pos, d.cnonce.sz);
-	fullwrite(fd, &d.response.sz, sizeof(size_t));
-	fullwrite(fd, d.response.pos, d.response.sz);
 	fullwrite(fd, &d.count, sizeof(uint32_t));
-	fullwrite(fd, &d.opaque.sz, sizeof(size_t));
-	fullwrite(fd, d.opaque.pos, d.opaque.sz);
+	fullwrite(fd, sizes, sizeof(sizes));
+	fullwrite(fd, buf, sz);
+	free(buf);
+
+	/* Do we need to hash our contents? */
+	return(KHTTPQOP_AUTH_INT == d.qop ? d.alg : KHTTPALG__MAX);
+}
+
+/*
+ * Read the digest written by khttpdigest_input().
+ * All of its strings are in one allocation starting with "user".
+ */
+static enum kcgi_err
+kworker_auth_digest(int fd, struct khttpdigest *d)
+{
+	enum kcgi_err	 ke;
+	size_t		 i, sz, sizes[KDIGEST_STRS];
+	char		*buf;
+	char		**strs[KDIGEST_STRS];
+
+	if (fullread(fd, &d->alg, sizeof(enum khttpalg), 0, &ke) < 0)
+		return(ke);
+	if (fullread(fd, &d->qop, sizeof(enum khttpqop), 0, &ke) < 0)
+		return(ke);
+	if (fullread(fd, &d->count, sizeof(uint32_t), 0, &ke) < 0)
+		return(ke);
+	if (fullread(fd, sizes, sizeof(sizes), 0, &ke) < 0)
+		return(ke);
+
+	for (sz = i = 0; i < KDIGEST_STRS; i++) {
+		if (sizes[i] >= SIZE_MAX - sz) {
+			XWARNX("digest: size overflow");
+			return(KCGI_FORM);
+		}
+		sz += sizes[i] + 1;
+	}
+
+	if (NULL == (buf = XMALLOC(sz)))
+		return(KCGI_ENOMEM);
+	if (fullread(fd, buf, sz, 0, &ke) < 0) {
+		free(buf);
+		return(ke);
+	}
+
+	for (sz = i = 0; i < KDIGEST_STRS; i++) {
+		sz += sizes[i];
+		if ('\0' != buf[sz++]) {
+			XWARNX("digest: not NUL-terminated");
+			free(buf);
+			return(KCGI_FORM);
+		}
+	}
+
+	strs[0] = &d->user;
+	strs[1] = &d->uri;
+	strs[2] = &d->realm;
+	strs[3] = &d->nonce;
+	strs[4] = &d->cnonce;
+	strs[5] = &d->response;
+	strs[6] = &d->opaque;
+
+	for (sz = i = 0; i < KDIGEST_STRS; i++) {
+		*strs[i] = buf + sz;
+		sz += sizes[i] + 1;
+	}
 
-	/* Do we need to MD5-hash our contents? */
-	return(KHTTPQOP_AUTH_INT == d.qop);
+	return(KCGI_OK);
 }
 
 enum kcgi_err
@@ -364,25 +458,7 @@ kworker_auth_parent(int fd, struct khttpauth *auth)
 			return(ke);
 		if ( ! auth->authorised)
 			break;
-		if (fullread(fd, &auth->d.digest.alg, sizeof(enum khttpalg), 0, &ke) < 0)
-			return(ke);
-		if (fullread(fd, &auth->d.digest.qop, sizeof(enum khttpqop), 0, &ke) < 0)
-			return(ke);
-		if (KCGI_OK != (ke = fullreadword(fd, &auth->d.digest.user)))
-			return(ke);
-		if (KCGI_OK != (ke = fullreadword(fd, &auth->d.digest.uri)))
-			return(ke);
-		if (KCGI_OK != (ke = fullreadword(fd, &auth->d.digest.realm)))
-			return(ke);
-		if (KCGI_OK != (ke = fullreadword(fd, &auth->d.digest.nonce)))
-			return(ke);
-		if (KCGI_OK != (ke = fullreadword(fd, &auth->d.digest.cnonce)))
-			return(ke);
-		if (KCGI_OK != (ke = fullreadword(fd, &auth->d.digest.response)))
-			return(ke);
-		if (fullread(fd, &auth->d.digest.count, sizeof(uint32_t), 0, &ke) < 0)
-			return(ke);
-		if (KCGI_OK != (ke = fullreadword(fd, &auth->d.digest.opaque)))
+		if (KCGI_OK != (ke = kworker_auth_digest(fd, &auth->d.digest)))
 			return(ke);
 		break;
 	case (KAUTH_BASIC):
@@ -402,10 +478,10 @@ kworker_auth_parent(int fd, struct khttpauth *auth)
 
 /*
  * Parse the "basic" or "digest" authorisation from the request.
- * We return non-zero if the body of the request needs to be MD5-hashed,
- * i.e., if we have auth-int digest QOP.
+ * We return the algorithm with which the body of the request needs to
+ * be hashed if we have auth-int digest QOP, else KHTTPALG__MAX.
  */
-int
+enum khttpalg
 kworker_auth_child(int fd, const char *cp)
 {
 	const char	*start;
@@ -415,7 +491,7 @@ kworker_auth_child(int fd, const char *cp)
 	if (NULL == cp || '\0' == *cp) {
 		auth = KAUTH_NONE;
 		fullwrite(fd, &auth, sizeof(enum kauth));
-		return(0);
+		return(KHTTPALG__MAX);
 	}
 
 	start = kauth_nexttok(&cp, '\0', &sz);
@@ -423,10 +499,10 @@ kworker_auth_child(int fd, const char *cp)
 		return(khttpdigest_input(fd, cp));
 	} else if (sz == 5 && 0 == strncasecmp(start, "basic", sz)) {
 		khttpbasic_input(fd, cp);
-		return(0);
+		return(KHTTPALG__MAX);
 	}
 
 	auth = KAUTH_UNKNOWN;
 	fullwrite(fd, &auth, sizeof(enum kauth));
-	return(0);
+	return(KHTTPALG__MAX);
 }
@@ -583,21 +583,28 @@ kreq_free(struct kreq *req)
 	free(req->cookienmap);
 	free(req->fieldmap);
 	free(req->fieldnmap);
+	if (NULL != req->fieldvec)
+		for (i = 0; i < req->keysz; i++)
+			free(req->fieldvec[i].v.i);
+	free(req->fieldvec);
 	free(req->suffix);
 	free(req->pagename);
 	free(req->pname);
 	if (KAUTH_DIGEST == req->rawauth.type) {
+		/* All strings share the allocation of "user". */
 		free(req->rawauth.d.digest.user);
-		free(req->rawauth.d.digest.uri);
-		free(req->rawauth.d.digest.realm);
-		free(req->rawauth.d.digest.nonce);
-		free(req->rawauth.d.digest.cnonce);
-		free(req->rawauth.d.digest.response);
-		free(req->rawauth.d.digest.opaque);
 	} else if (KAUTH_BASIC == req->rawauth.type) 
 		free(req->rawauth.d.basic.response);
 }
 
+void
+khttp_opts_init(struct kopts *opts)
+{
+
+	memset(opts, 0, sizeof(struct kopts));
+	opts->sndbufsz = -1;
+}
+
 enum kcgi_err
 khttp_parse(struct kreq *req, 
 	const struct kvalid *keys, size_t keysz,
@@ -646,6 +653,16 @@ khttp_parsex(struct kreq *req,
 		return(KCGI_SYSTEM);
 	}
 
+	/* The child also needs our options, so set them up now. */
+
+	if (NULL == opts)
+		khttp_opts_init(&kopts);
+	else
+		memcpy(&kopts, opts, sizeof(struct kopts));
+
+	if (kopts.sndbufsz < 0)
+		kopts.sndbufsz = 1024 * 8;
+
 	if (-1 == (work_pid = fork())) {
 		er = errno;
 		XWARN("fork");
@@ -666,7 +683,7 @@ khttp_parsex(struct kreq *req,
 			XWARNX("ksandbox_init_child");
 		} else if (KCGI_OK != kworker_child
 			   (work_dat[KWORKER_CHILD], keys,
-			    keysz, mimes, mimesz, debugging)) {
+			    keysz, mimes, mimesz, debugging, &kopts)) {
 			XWARNX("kworker_child");
 		} else
 			er = EXIT_SUCCESS;
@@ -686,14 +703,6 @@ khttp_parsex(struct kreq *req,
 		goto err;
 	}
 
-	if (NULL == opts)
-		kopts.sndbufsz = -1;
-	else
-		memcpy(&kopts, opts, sizeof(struct kopts));
-
-	if (kopts.sndbufsz < 0)
-		kopts.sndbufsz = 1024 * 8;
-
 	kerr = KCGI_ENOMEM;
 
 	/*
@@ -706,7 +715,8 @@ khttp_parsex(struct kreq *req,
 	req->arg = arg;
 	req->keys = keys;
 	req->keysz = keysz;
-	req->kdata = kdata_alloc(-1, -1, 0, debugging, &kopts);
+	req->kdata = kdata_alloc(-1, -1, 0, 
+		debugging, &kopts, NULL, req->timing);
 	if (NULL == req->kdata)
 		goto err;
 
@@ -729,7 +739,8 @@ khttp_parsex(struct kreq *req,
 	 * Now read the input fields from the child and conditionally
 	 * assign them to our lookup table.
 	 */
-	kerr = kworker_parent(work_dat[KWORKER_PARENT], req, 1, mimesz);
+	kerr = kworker_parent
+		(work_dat[KWORKER_PARENT], req, 1, mimesz, &kopts);
 	if (KCGI_OK != kerr)
 		goto err;
 
@@ -859,6 +870,7 @@ khttp_free(struct kreq *req)
 	kdata_free(req->kdata, 1);
 	req->kdata = NULL;
 	kreq_free(req);
+	klogbuf_idle();
 }
 
 int
@@ -875,6 +887,15 @@ khttp_body_compress(struct kreq *req, int comp)
 	const char	*cp;
 
 	didcomp = 0;
+
+	/* 
+	 * Automatic ETags (KOPT_ETAG) are only computed for GET.
+	 * This must come before compression, which it may defer.
+	 */
+	kdata_etag(req->kdata, KMETHOD_GET == req->method,
+		NULL == req->reqmap[KREQU_IF_NONE_MATCH] ? NULL :
+		req->reqmap[KREQU_IF_NONE_MATCH]->val);
+
 	/*
 	 * First determine if the request wants HTTP compression.
 	 * Use RFC 2616 14.3 as a guide for checking this.
@@ -919,68 +940,226 @@ khttp_body_compress(struct kreq *req, int comp)
 }
 
 /*
- * Trim leading and trailing whitespace from a word.
+ * Trim leading and trailing whitespace from a word of length "*sz",
+ * which is set to the trimmed length.
  * Note that this returns a pointer within "val" and optionally sets the
  * NUL-terminator, so don't free() the returned value.
  */
 static char *
-trim(char *val)
+trimsz(char *val, size_t *sz)
 {
-	char		*cp;
+	char		*cp, *end;
 
-	if ('\0' == *val)
-		return(val);
-
-	cp = val + strlen(val) - 1;
-	while (cp > val && isspace((unsigned char)*cp))
-		*cp-- = '\0';
+	end = val + *sz;
+	while (end > val && isspace((unsigned char)end[-1]))
+		*--end = '\0';
 
 	cp = val;
-	while (isspace((unsigned char)*cp))
+	while (cp < end && isspace((unsigned char)*cp))
 		cp++;
 
+	*sz = end - cp;
 	return(cp);
 }
 
+/*
+ * Parse a decimal integer from "cp" of length "sz" into "res", making
+ * sure that it's within [minval, maxval].
+ * Like strtonum(3) on a trimmed value, this allows surrounding white
+ * space and a leading sign.
+ * Unlike it, this makes one pass over the digits, checks for overflow
+ * as it goes, and doesn't modify the input.
+ * Returns zero on failure (setting "res" to zero), non-zero on success.
+ */
+static int
+valid_int(const char *cp, size_t sz, 
+	int64_t minval, int64_t maxval, int64_t *res)
+{
+	const char	*end = cp + sz;
+	uint64_t	 v, lim, d;
+	int64_t		 val;
+	int		 neg = 0;
+
+	*res = 0;
+
+	while (cp < end && isspace((unsigned char)*cp))
+		cp++;
+	while (end > cp && isspace((unsigned char)end[-1]))
+		end--;
+
+	if (cp < end && ('-' == *cp || '+' == *cp))
+		neg = '-' == *cp++;
+	if (cp == end)
+		return(0);
+
+	lim = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+
+	for (v = 0; cp < end; cp++) {
+		if ((d = (unsigned char)*cp - '0') > 9)
+			return(0);
+		if (v > (lim - d) / 10)
+			return(0);
+		v = v * 10 + d;
+	}
+
+	if (neg && v == (uint64_t)INT64_MAX + 1)
+		val = INT64_MIN;
+	else
+		val = neg ? -(int64_t)v : (int64_t)v;
+
+	if (val < minval || val > maxval)
+		return(0);
+
+	*res = val;
+	return(1);
+}
+
+/*
+ * Try to parse a decimal number "cp" exactly without strtod(3).
+ * This is Clinger's fast path: if the decimal significand fits into 53
+ * bits and the power of ten is at most 22, both are exactly represented
+ * as doubles, so one multiplication or division is correctly rounded.
+ * This covers almost all numbers submitted by forms.
+ * Returns zero if the number isn't in this form (it might still be
+ * valid, e.g., with more digits or in hexadecimal), in which case
+ * strtod(3) must be used instead.
+ */
+static int
+valid_double_fast(const char *cp, double *res)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 
+		1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 
+		1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	uint64_t	 m;
+	int64_t		 e, ex;
+	size_t		 nd, sig;
+	int		 neg = 0, eneg, dot;
+	double		 d;
+
+	while (isspace((unsigned char)*cp))
+		cp++;
+	if ('-' == *cp || '+' == *cp)
+		neg = '-' == *cp++;
+
+	/* 
+	 * Significand, stopping if it has too many digits.
+	 * Leading zeroes aren't significant.
+	 */
+
+	for (m = 0, e = 0, nd = sig = 0, dot = 0; ; cp++) {
+		if ('.' == *cp && ! dot) {
+			dot = 1;
+			continue;
+		} else if ( ! isdigit((unsigned char)*cp))
+			break;
+		nd++;
+		e -= dot;
+		if (0 == m && '0' == *cp)
+			continue;
+		if (++sig > 19)
+			return(0);
+		m = m * 10 + (*cp - '0');
+	}
+
+	if (0 == nd)
+		return(0);
+
+	if ('e' == *cp || 'E' == *cp) {
+		cp++;
+		eneg = 0;
+		if ('-' == *cp || '+' == *cp)
+			eneg = '-' == *cp++;
+		if ( ! isdigit((unsigned char)*cp))
+			return(0);
+		for (ex = 0; isdigit((unsigned char)*cp); cp++)
+			if ((ex = ex * 10 + (*cp - '0')) > 9999)
+				return(0);
+		e += eneg ? -ex : ex;
+	}
+
+	if ('\0' != *cp)
+		return(0);
+
+	if (0 == m) {
+		*res = neg ? -0.0 : 0.0;
+		return(1);
+	} else if (m > ((uint64_t)1 << 53))
+		return(0);
+
+	/* 
+	 * Large exponents can be shifted into the significand as long as
+	 * it stays exact, e.g., 1e30 as 1e8 * 1e22.
+	 */
+
+	for ( ; e > 22; e--) {
+		if (m > ((uint64_t)1 << 53) / 10)
+			return(0);
+		m *= 10;
+	}
+
+	if (e < -22)
+		return(0);
+
+	d = (double)m;
+	d = e < 0 ? d / pow10[-e] : d * pow10[e];
+	*res = neg ? -d : d;
+	return(1);
+}
+
 /*
  * Simple email address validation: this is NOT according to the spec,
  * but a simple heuristic look at the address.
+ * The address "p" is of length "sz".
  * Note that this lowercases the mail address.
  */
 static char *
-valid_email(char *p)
+valid_email(char *p, size_t sz)
 {
-	char		*domain, *cp, *start;
-	size_t		 i, sz;
+	char		*start;
+	size_t		 i, at;
+	unsigned char	 c;
 
-	cp = start = trim(p);
+	start = trimsz(p, &sz);
 
-	if ((sz = strlen(cp)) < 5 || sz > 254)
-		return(NULL);
-	if (NULL == (domain = strchr(cp, '@')))
-		return(NULL);
-	if ((sz = domain - cp) < 1 || sz > 64)
+	if (sz < 5 || sz > 254)
 		return(NULL);
 
-	for (i = 0; i < sz; i++) {
-		if (isalnum((unsigned char)cp[i]))
+	/* 
+	 * One pass over the user part, up to the first '@', then over
+	 * the domain.
+	 */
+
+	for (i = 0; i < sz && '@' != start[i]; i++) {
+		c = start[i];
+		if (isalnum(c))
 			continue;
-		if (NULL == strchr("!#$%&'*+-/=?^_`{|}~.", cp[i]))
+		switch (c) {
+		case ('!'): case ('#'): case ('$'): case ('%'):
+		case ('&'): case ('\''): case ('*'): case ('+'):
+		case ('-'): case ('/'): case ('='): case ('?'):
+		case ('^'): case ('_'): case ('`'): case ('{'):
+		case ('|'): case ('}'): case ('~'): case ('.'):
+			break;
+		default:
 			return(NULL);
+		}
 	}
 
-	assert('@' == cp[i]);
-	cp = &cp[++i];
-	if ((sz = strlen(cp)) < 4 || sz > 254)
+	if ((at = i) == sz || at < 1 || at > 64)
+		return(NULL);
+	if (sz - at - 1 < 4)
 		return(NULL);
 
-	for (i = 0; i < sz; i++) 
-		if ( ! isalnum((unsigned char)cp[i]))
-			if (NULL == strchr("-.", cp[i]))
-				return(NULL);
+	for (i = at + 1; i < sz; i++) {
+		c = start[i];
+		if ( ! isalnum(c) && '-' != c && '.' != c)
+			return(NULL);
+	}
 
-	for (cp = start; '\0' != *cp; cp++)
-		*cp = tolower((unsigned char)*cp);
+	for (i = 0; i < sz; i++)
+		start[i] = tolower((unsigned char)start[i]);
 
 	return(start);
 }
@@ -988,29 +1167,49 @@ valid_email(char *p)
 int
 kvalid_date(struct kpair *kp)
 {
-	int		 mday, mon, year;
+	int64_t		 mday, mon, year, v;
+	const char	*cp = kp->val;
 
-	if ( ! kvalid_stringne(kp))
-		return(0);
-	else if (kp->valsz != 10)
+	/* 
+	 * Check the form YYYY-MM-DD and that we're NUL-terminated,
+	 * which is the same as kvalid_stringne() in this case.
+	 */
+
+	if (10 != kp->valsz || '\0' != cp[10] || 
+	    '-' != cp[4] || '-' != cp[7])
 		return(0);
-	else if ( ! isdigit((unsigned char)kp->val[0]) ||
-		! isdigit((unsigned char)kp->val[1]) ||
-		! isdigit((unsigned char)kp->val[2]) ||
-		! isdigit((unsigned char)kp->val[3]) ||
-		'-' != kp->val[4] || 
-		! isdigit((unsigned char)kp->val[5]) ||
-		! isdigit((unsigned char)kp->val[6]) ||
-		'-' != kp->val[7] || 
-		! isdigit((unsigned char)kp->val[8]) ||
-		! isdigit((unsigned char)kp->val[9]))
+	if ( ! isdigit((unsigned char)cp[0]) ||
+	     ! isdigit((unsigned char)cp[1]) ||
+	     ! isdigit((unsigned char)cp[2]) ||
+	     ! isdigit((unsigned char)cp[3]) ||
+	     ! isdigit((unsigned char)cp[5]) ||
+	     ! isdigit((unsigned char)cp[6]) ||
+	     ! isdigit((unsigned char)cp[8]) ||
+	     ! isdigit((unsigned char)cp[9]))
 		return(0);
 
-	year = atoi(&kp->val[0]);
-	mon = atoi(&kp->val[5]);
-	mday = atoi(&kp->val[8]);
+	year = (cp[0] - '0') * 1000 + (cp[1] - '0') * 100 +
+		(cp[2] - '0') * 10 + (cp[3] - '0');
+	mon = (cp[5] - '0') * 10 + (cp[6] - '0');
+	mday = (cp[8] - '0') * 10 + (cp[9] - '0');
+
+	/*
+	 * This is kutil_date2epoch() with the epoch's day count
+	 * (719468 days from 0000-03-01) folded in as a constant.
+	 */
 
-	kp->parsed.i = kutil_date2epoch(mday, mon, year);
+	if (year < 1970)
+		v = 0;
+	else {
+		mon = (mon + 9) % 12;
+		year = year - mon / 10;
+		v = 365 * year + year / 4 - year / 100 + 
+			year / 400 + (mon * 306 + 5) / 10 + 
+			(mday - 1) - 719468;
+		v *= 86400;
+	}
+
+	kp->parsed.i = v;
 	kp->type = KPAIR_INTEGER;
 	return(1);
 }
@@ -1051,7 +1250,7 @@ kvalid_email(struct kpair *p)
 
 	if ( ! kvalid_stringne(p))
 		return(0);
-	return(NULL != (p->parsed.s = valid_email(p->val)));
+	return(NULL != (p->parsed.s = valid_email(p->val, p->valsz)));
 }
 
 int
@@ -1073,6 +1272,13 @@ kvalid_double(struct kpair *p)
 	if ( ! kvalid_stringne(p))
 		return(0);
 
+	/* Try the exact fast path before falling back. */
+
+	if (valid_double_fast(p->val, &p->parsed.d)) {
+		p->type = KPAIR_DOUBLE;
+		return(1);
+	}
+
 	errno = 0;
 	lval = strtod(p->val, &ep);
 	if (p->val[0] == '\0' || *ep != '\0')
@@ -1087,14 +1293,12 @@ kvalid_double(struct kpair *p)
 int
 kvalid_int(struct kpair *p)
 {
-	const char	*ep;
 
 	if ( ! kvalid_stringne(p))
 		return(0);
-	p->parsed.i = strtonum
-		(trim(p->val), INT64_MIN, INT64_MAX, &ep);
 	p->type = KPAIR_INTEGER;
-	return(NULL == ep);
+	return(valid_int(p->val, p->valsz, 
+		INT64_MIN, INT64_MAX, &p->parsed.i));
 }
 
 int
@@ -1109,11 +1313,10 @@ kvalid_bit(struct kpair *p)
 int
 kvalid_uint(struct kpair *p)
 {
-	const char	*ep;
 
-	p->parsed.i = strtonum(trim(p->val), 0, INT64_MAX, &ep);
 	p->type = KPAIR_INTEGER;
-	return(NULL == ep);
+	return(valid_int(p->val, strlen(p->val), 
+		0, INT64_MAX, &p->parsed.i));
 }
 
 int
@@ -313,16 +313,17 @@ enum	kpairstate {
 
 #define KREQ_DEBUG_WRITE	  0x01
 #define KREQ_DEBUG_READ_BODY	  0x02
+#define KREQ_DEBUG_TIMING	  0x04
 
+/*
+ * Members used when looking up and reading values come first, so that
+ * they share a cache line; multipart-only members follow.
+ */
 struct	kpair {
 	char		*key; /* key name */
 	size_t		 keypos; /* bucket (if assigned) */
 	char		*val; /*  key value */
 	size_t		 valsz; /* length of "val" */
-	char		*file; /* content filename (or NULL) */
-	char		*ctype; /* content type (or NULL) */
-	size_t		 ctypepos; /* content type index */
-	char		*xcode; /* content xfer encoding (or NULL) */
 	struct kpair	*next; /* next in map entry */
 	enum kpairstate	 state; /* parse state */
 	enum kpairtype	 type; /* if parsed, the parse type */
@@ -331,6 +332,20 @@ struct	kpair {
 		const char *s; /* validated string */
 		double d; /* validated decimal */
 	} parsed;
+	char		*file; /* content filename (or NULL) */
+	char		*ctype; /* content type (or NULL) */
+	size_t		 ctypepos; /* content type index */
+	char		*xcode; /* content xfer encoding (or NULL) */
+};
+
+struct	kvec {
+	enum kpairtype	 type; /* type of all values */
+	size_t		 sz; /* number of values */
+	union kvecs {
+		int64_t *i; /* validated integers */
+		const char **s; /* validated strings */
+		double *d; /* validated decimals */
+	} v;
 };
 
 struct	kreq; /* forward declaration */
@@ -351,6 +366,10 @@ enum	kauth {
 enum	khttpalg {
 	KHTTPALG_MD5 = 0,
 	KHTTPALG_MD5_SESS,
+	KHTTPALG_SHA256,
+	KHTTPALG_SHA256_SESS,
+	KHTTPALG_SHA512_256,
+	KHTTPALG_SHA512_256_SESS,
 	KHTTPALG__MAX
 };
 
@@ -395,6 +414,21 @@ struct	khead {
 	char		*val;
 };
 
+/*
+ * Moments in the life of a request, recorded in "timing" of struct
+ * kreq as nanoseconds of the monotonic clock (or zero if not reached).
+ */
+enum	ktime {
+	KTIME_START = 0, /* fork (CGI) or accept (FastCGI) */
+	KTIME_ENV, /* child has scanned the environment */
+	KTIME_BODY, /* child has read the body */
+	KTIME_PARSE, /* child has parsed the body and query */
+	KTIME_RECV, /* parent has received all fields */
+	KTIME_HEAD, /* headers flushed by khttp_body(3) */
+	KTIME_DONE, /* output drained by khttp_free(3) */
+	KTIME__MAX
+};
+
 struct	kreq {
 	struct khead		 *reqmap[KREQU__MAX];
 	struct khead		 *reqs;
@@ -410,6 +444,7 @@ struct	kreq {
 	struct kpair		**fieldmap;
 	struct kpair		**fieldnmap;
 	size_t			  fieldsz;
+	struct kvec		 *fieldvec;
 	size_t			  mime;
 	size_t			  page;
 	enum kscheme		  scheme;
@@ -425,12 +460,33 @@ struct	kreq {
 	size_t			  keysz;
 	char			 *pname;
 	void			 *arg; 
+	uint64_t		  timing[KTIME__MAX];
 };
 
+#define	KOPT_DROPUNKNOWN	  0x01
+#define	KOPT_SERVER_TIMING	  0x02
+#define	KOPT_JSON_BODY		  0x04
+#define	KOPT_ETAG		  0x08
+
+#define	KVALID_ARRAY		  0x01
+
 struct	kopts {
 	ssize_t		  	  sndbufsz;
+	unsigned int		  flags;
+	const unsigned int	 *keyflags;
 };
 
+/*
+ * Format of lines written by the kutil_log(3) family.
+ */
+enum	klogfmt {
+	KLOGFMT_TEXT = 0, /* traditional text */
+	KLOGFMT_LOGFMT, /* key=value pairs */
+	KLOGFMT_JSON /* one JSON object per line */
+};
+
+#define	KLOG_BATCH		  0x01
+
 struct	ktemplate {
 	const char *const	 *key;
 	size_t		 	  keysz;
@@ -470,6 +526,7 @@ void		 khttp_child_free(struct kreq *);
 void		 khttp_head(struct kreq *, const char *, 
 			const char *, ...) 
 			__attribute__((format(printf, 3, 4)));
+void		 khttp_opts_init(struct kopts *);
 enum kcgi_err	 khttp_parse(struct kreq *, 
 			const struct kvalid *, size_t,
 			const char *const *, size_t, size_t);
@@ -479,6 +536,7 @@ enum kcgi_err	 khttp_parsex(struct kreq *, const struct kmimemap *,
 			const char *const *, size_t,
 			size_t, size_t, void *, void (*)(void *),
 			unsigned int, const struct kopts *);
+void		 khttp_flush(struct kreq *);
 void		 khttp_putc(struct kreq *, int);
 void		 khttp_puts(struct kreq *, const char *);
 int		 khttp_template(struct kreq *, 
@@ -488,6 +546,8 @@ int		 khttp_template_fd(struct kreq *,
 int		 khttp_template_buf(struct kreq *, 
 			const struct ktemplate *, const char *, 
 			size_t);
+double		 khttp_timing(const struct kreq *,
+			enum ktime, enum ktime);
 int		 khttp_templatex(const struct ktemplate *, 
 			const char *, const struct ktemplatex *, 
 			void *);
@@ -498,6 +558,7 @@ int		 khttp_templatex_fd(const struct ktemplate *,
 			int, const char *,
 			const struct ktemplatex *, void *);
 
+int		 khttp_writable(struct kreq *, int);
 void		 khttp_write(struct kreq *, const char *, size_t);
 
 int		 khttpdigest_validate(const struct kreq *, 
@@ -549,6 +610,7 @@ char		*kutil_epoch2utcstr(int64_t, char *, size_t);
 int64_t	 	 kutil_date2epoch(int64_t, int64_t, int64_t);
 int64_t	 	 kutil_datetime2epoch(int64_t, int64_t, int64_t,
 			int64_t, int64_t, int64_t);
+int		 kutil_str2epoch(const char *, int64_t *);
 
 char		*kutil_urlabs(enum kscheme, const char *, 
 			uint16_t, const char *);
@@ -559,7 +621,10 @@ char		*kutil_urlpartx(struct kreq *, const char *,
 char		*kutil_urlencode(const char *);
 void		 kutil_invalidate(struct kreq *, struct kpair *);
 
+void		 kutil_logaccess(const struct kreq *);
+void		 kutil_logflush(void);
 int		 kutil_openlog(const char *);
+int		 kutil_openlogx(const char *, enum klogfmt, unsigned int);
 void	 	 kutil_verr(const struct kreq *, 
 			const char *, const char *, va_list)
 			__attribute__((noreturn));
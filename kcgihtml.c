@@ -46,12 +46,39 @@ enum	htype {
 
 /*
  * A tag describes an HTML element and its properties.
+ * So that each tag may be written in as few writes as possible, we
+ * keep prebuilt strings of its opening (without attributes), whole
+ * opening (with no attributes), and closing, and their lengths.
  */
 struct	tag {
 	enum htype	 flags; 
 	const char	*name;
+	const char	*open; /* "<name" */
+	const char	*bare; /* "<name>" or "<name/>" */
+	const char	*close; /* "</name>" */
+	size_t		 namesz; /* length of "name" */
+	size_t		 baresz; /* length of "bare" */
 };
 
+#define	TAGDEF(_type, _name, _end) \
+	{ (_type), (_name), "<" _name, "<" _name _end, \
+	  "</" _name ">", sizeof(_name) - 1, \
+	  sizeof("<" _name _end) - 1 }
+#define	FLOWTAG(_name)	 TAGDEF(TAG_FLOW, _name, ">")
+#define	PHRASETAG(_name) TAGDEF(TAG_PHRASE, _name, ">")
+#define	VOIDTAG(_name)	 TAGDEF(TAG_VOID, _name, "/>")
+#define	INSTRTAG(_name)	 TAGDEF(TAG_INSTRUCTION, _name, ">")
+
+/*
+ * An attribute is written as its prebuilt " name=\"" prefix.
+ */
+struct	attr {
+	const char	*prefix; /* " name=\"" */
+	size_t		 prefixsz; /* length of "prefix" */
+};
+
+#define	ATTR(_name)	 { " " _name "=\"", sizeof(_name) + 2 }
+
 static	const uint16_t entities[KENTITY__MAX] = {
 	198, /* KENTITY_AElig */
 	193, /* KENTITY_Aacute */
@@ -187,288 +214,335 @@ static	const uint16_t entities[KENTITY__MAX] = {
 };
 
 static	const struct tag tags[KELEM__MAX] = {
-	{ TAG_PHRASE, "a" }, /* KELEM_A */ /* XXX: TRANS */
-	{ TAG_PHRASE, "abbr" }, /* KELEM_ABBR */
-	{ TAG_PHRASE, "address" }, /* KELEM_ADDRESS */
-	{ TAG_VOID, "area" }, /* KELEM_AREA */
-	{ TAG_FLOW, "article" }, /* KELEM_ARTICLE */
-	{ TAG_FLOW, "aside" }, /* KELEM_ASIDE */
-	{ TAG_FLOW, "audio" }, /* KELEM_AUDIO */ /* XXX: TRANS */
-	{ TAG_PHRASE, "b" }, /* KELEM_B */
-	{ TAG_VOID, "base" }, /* KELEM_BASE */
-	{ TAG_PHRASE, "bdi" }, /* KELEM_BDI */
-	{ TAG_PHRASE, "bdo" }, /* KELEM_BDO */
-	{ TAG_FLOW, "blockquote" }, /* KELEM_BLOCKQUOTE */
-	{ TAG_FLOW, "body" }, /* KELEM_BODY */
-	{ TAG_VOID, "br" }, /* KELEM_BR */
-	{ TAG_PHRASE, "button" }, /* KELEM_BUTTON */
-	{ TAG_FLOW, "canvas" }, /* KELEM_CANVAS */ /* XXX: TRANS */
-	{ TAG_FLOW, "caption" }, /* KELEM_CAPTION */
-	{ TAG_PHRASE, "cite" }, /* KELEM_CITE */
-	{ TAG_PHRASE, "code" }, /* KELEM_CODE */
-	{ TAG_VOID, "col" }, /* KELEM_COL */
-	{ TAG_PHRASE, "colgroup" }, /* KELEM_COLGROUP */
-	{ TAG_PHRASE, "datalist" }, /* KELEM_DATALIST */
-	{ TAG_FLOW, "dd" }, /* KELEM_DD */
-	{ TAG_PHRASE, "del" }, /* KELEM_DEL */ /* XXX: TRANS */
-	{ TAG_FLOW, "details" }, /* KELEM_DETAILS */
-	{ TAG_PHRASE, "dfn" }, /* KELEM_DFN */
-	{ TAG_FLOW, "div" }, /* KELEM_DIV */
-	{ TAG_FLOW, "dl" }, /* KELEM_DL */
-	{ TAG_INSTRUCTION, "!DOCTYPE html" }, /* KELEM_DOCTYPE */
-	{ TAG_FLOW, "dt" }, /* KELEM_DT */
-	{ TAG_PHRASE, "em" }, /* KELEM_EM */
-	{ TAG_VOID, "embed" }, /* KELEM_EMBED */
-	{ TAG_FLOW, "fieldset" }, /* KELEM_FIELDSET */
-	{ TAG_FLOW, "figcaption" }, /* KELEM_FIGCAPTION */
-	{ TAG_FLOW, "figure" }, /* KELEM_FIGURE */
-	{ TAG_FLOW, "footer" }, /* KELEM_FOOTER */
-	{ TAG_FLOW, "form" }, /* KELEM_FORM */
-	{ TAG_PHRASE, "h1" }, /* KELEM_H1 */
-	{ TAG_PHRASE, "h2" }, /* KELEM_H2 */
-	{ TAG_PHRASE, "h3" }, /* KELEM_H3 */
-	{ TAG_PHRASE, "h4" }, /* KELEM_H4 */
-	{ TAG_PHRASE, "h5" }, /* KELEM_H5 */
-	{ TAG_PHRASE, "h6" }, /* KELEM_H6 */
-	{ TAG_FLOW, "head" }, /* KELEM_HEAD */
-	{ TAG_FLOW, "header" }, /* KELEM_HEADER */
-	{ TAG_FLOW, "hgroup" }, /* KELEM_HGROUP */
-	{ TAG_VOID, "hr" }, /* KELEM_HR */
-	{ TAG_FLOW, "html" }, /* KELEM_HTML */
-	{ TAG_PHRASE, "i" }, /* KELEM_I */
-	{ TAG_PHRASE, "iframe" }, /* KELEM_IFRAME */
-	{ TAG_VOID, "img" }, /* KELEM_IMG */
-	{ TAG_VOID, "input" }, /* KELEM_INPUT */
-	{ TAG_PHRASE, "ins" }, /* KELEM_INS */ /* XXX: TRANS */
-	{ TAG_PHRASE, "kbd" }, /* KELEM_KBD */
-	{ TAG_VOID, "keygen" }, /* KELEM_KEYGEN */
-	{ TAG_PHRASE, "label" }, /* KELEM_LABEL */
-	{ TAG_PHRASE, "legend" }, /* KELEM_LEGEND */
-	{ TAG_FLOW, "li" }, /* KELEM_LI */
-	{ TAG_VOID, "link" }, /* KELEM_LINK */
-	{ TAG_FLOW, "map" }, /* KELEM_MAP */ /* XXX: TRANS */
-	{ TAG_PHRASE, "mark" }, /* KELEM_MARK */
-	{ TAG_FLOW, "menu" }, /* KELEM_MENU */
-	{ TAG_VOID, "meta" }, /* KELEM_META */
-	{ TAG_PHRASE, "meter" }, /* KELEM_METER */
-	{ TAG_FLOW, "nav" }, /* KELEM_NAV */
-	{ TAG_FLOW, "noscript" }, /* KELEM_NOSCRIPT */ /* XXX: TRANS */
-	{ TAG_FLOW, "object" }, /* KELEM_OBJECT */ /* XXX: TRANS */
-	{ TAG_FLOW, "ol" }, /* KELEM_OL */
-	{ TAG_FLOW, "optgroup" }, /* KELEM_OPTGROUP */
-	{ TAG_PHRASE, "option" }, /* KELEM_OPTION */
-	{ TAG_PHRASE, "output" }, /* KELEM_OUTPUT */
-	{ TAG_PHRASE, "p" }, /* KELEM_P */
-	{ TAG_VOID, "param" }, /* KELEM_PARAM */
-	{ TAG_PHRASE, "pre" }, /* KELEM_PRE */
-	{ TAG_PHRASE, "progress" }, /* KELEM_PROGRESS */
-	{ TAG_PHRASE, "q" }, /* KELEM_Q */
-	{ TAG_PHRASE, "rp" }, /* KELEM_RP */
-	{ TAG_PHRASE, "rt" }, /* KELEM_RT */
-	{ TAG_PHRASE, "ruby" }, /* KELEM_RUBY */
-	{ TAG_PHRASE, "s" }, /* KELEM_S */
-	{ TAG_PHRASE, "samp" }, /* KELEM_SAMP */
-	{ TAG_FLOW, "script" }, /* KELEM_SCRIPT */
-	{ TAG_FLOW, "section" }, /* KELEM_SECTION */
-	{ TAG_FLOW, "select" }, /* KELEM_SELECT */
-	{ TAG_PHRASE, "small" }, /* KELEM_SMALL */
-	{ TAG_VOID, "source" }, /* KELEM_SOURCE */
-	{ TAG_PHRASE, "span" }, /* KELEM_SPAN */
-	{ TAG_PHRASE, "strong" }, /* KELEM_STRONG */
-	{ TAG_FLOW, "style" }, /* KELEM_STYLE */
-	{ TAG_PHRASE, "sub" }, /* KELEM_SUB */
-	{ TAG_PHRASE, "summary" }, /* KELEM_SUMMARY */
-	{ TAG_PHRASE, "sup" }, /* KELEM_SUP */
-	{ TAG_FLOW, "table" }, /* KELEM_TABLE */
-	{ TAG_FLOW, "tbody" }, /* KELEM_TBODY */
-	{ TAG_FLOW, "td" }, /* KELEM_TD */
-	{ TAG_PHRASE, "textarea" }, /* KELEM_TEXTAREA */
-	{ TAG_FLOW, "tfoot" }, /* KELEM_TFOOT */
-	{ TAG_FLOW, "th" }, /* KELEM_TH */
-	{ TAG_FLOW, "thead" }, /* KELEM_THEAD */
-	{ TAG_PHRASE, "time" }, /* KELEM_TIME */
-	{ TAG_PHRASE, "title" }, /* KELEM_TITLE */
-	{ TAG_FLOW, "tr" }, /* KELEM_TR */
-	{ TAG_VOID, "track" }, /* KELEM_TRACK */
-	{ TAG_PHRASE, "u" }, /* KELEM_U */
-	{ TAG_FLOW, "ul" }, /* KELEM_UL */
-	{ TAG_PHRASE, "var" }, /* KELEM_VAR */
-	{ TAG_FLOW, "video" }, /* KELEM_VIDEO */ /* XXX: TRANS */
-	{ TAG_VOID, "wbr" }, /* KELEM_WBR */
+	PHRASETAG("a"), /* KELEM_A */ /* XXX: TRANS */
+	PHRASETAG("abbr"), /* KELEM_ABBR */
+	PHRASETAG("address"), /* KELEM_ADDRESS */
+	VOIDTAG("area"), /* KELEM_AREA */
+	FLOWTAG("article"), /* KELEM_ARTICLE */
+	FLOWTAG("aside"), /* KELEM_ASIDE */
+	FLOWTAG("audio"), /* KELEM_AUDIO */ /* XXX: TRANS */
+	PHRASETAG("b"), /* KELEM_B */
+	VOIDTAG("base"), /* KELEM_BASE */
+	PHRASETAG("bdi"), /* KELEM_BDI */
+	PHRASETAG("bdo"), /* KELEM_BDO */
+	FLOWTAG("blockquote"), /* KELEM_BLOCKQUOTE */
+	FLOWTAG("body"), /* KELEM_BODY */
+	VOIDTAG("br"), /* KELEM_BR */
+	PHRASETAG("button"), /* KELEM_BUTTON */
+	FLOWTAG("canvas"), /* KELEM_CANVAS */ /* XXX: TRANS */
+	FLOWTAG("caption"), /* KELEM_CAPTION */
+	PHRASETAG("cite"), /* KELEM_CITE */
+	PHRASETAG("code"), /* KELEM_CODE */
+	VOIDTAG("col"), /* KELEM_COL */
+	PHRASETAG("colgroup"), /* KELEM_COLGROUP */
+	PHRASETAG("datalist"), /* KELEM_DATALIST */
+	FLOWTAG("dd"), /* KELEM_DD */
+	PHRASETAG("del"), /* KELEM_DEL */ /* XXX: TRANS */
+	FLOWTAG("details"), /* KELEM_DETAILS */
+	PHRASETAG("dfn"), /* KELEM_DFN */
+	FLOWTAG("div"), /* KELEM_DIV */
+	FLOWTAG("dl"), /* KELEM_DL */
+	INSTRTAG("!DOCTYPE html"), /* KELEM_DOCTYPE */
+	FLOWTAG("dt"), /* KELEM_DT */
+	PHRASETAG("em"), /* KELEM_EM */
+	VOIDTAG("embed"), /* KELEM_EMBED */
+	FLOWTAG("fieldset"), /* KELEM_FIELDSET */
+	FLOWTAG("figcaption"), /* KELEM_FIGCAPTION */
+	FLOWTAG("figure"), /* KELEM_FIGURE */
+	FLOWTAG("footer"), /* KELEM_FOOTER */
+	FLOWTAG("form"), /* KELEM_FORM */
+	PHRASETAG("h1"), /* KELEM_H1 */
+	PHRASETAG("h2"), /* KELEM_H2 */
+	PHRASETAG("h3"), /* KELEM_H3 */
+	PHRASETAG("h4"), /* KELEM_H4 */
+	PHRASETAG("h5"), /* KELEM_H5 */
+	PHRASETAG("h6"), /* KELEM_H6 */
+	FLOWTAG("head"), /* KELEM_HEAD */
+	FLOWTAG("header"), /* KELEM_HEADER */
+	FLOWTAG("hgroup"), /* KELEM_HGROUP */
+	VOIDTAG("hr"), /* KELEM_HR */
+	FLOWTAG("html"), /* KELEM_HTML */
+	PHRASETAG("i"), /* KELEM_I */
+	PHRASETAG("iframe"), /* KELEM_IFRAME */
+	VOIDTAG("img"), /* KELEM_IMG */
+	VOIDTAG("input"), /* KELEM_INPUT */
+	PHRASETAG("ins"), /* KELEM_INS */ /* XXX: TRANS */
+	PHRASETAG("kbd"), /* KELEM_KBD */
+	VOIDTAG("keygen"), /* KELEM_KEYGEN */
+	PHRASETAG("label"), /* KELEM_LABEL */
+	PHRASETAG("legend"), /* KELEM_LEGEND */
+	FLOWTAG("li"), /* KELEM_LI */
+	VOIDTAG("link"), /* KELEM_LINK */
+	FLOWTAG("map"), /* KELEM_MAP */ /* XXX: TRANS */
+	PHRASETAG("mark"), /* KELEM_MARK */
+	FLOWTAG("menu"), /* KELEM_MENU */
+	VOIDTAG("meta"), /* KELEM_META */
+	PHRASETAG("meter"), /* KELEM_METER */
+	FLOWTAG("nav"), /* KELEM_NAV */
+	FLOWTAG("noscript"), /* KELEM_NOSCRIPT */ /* XXX: TRANS */
+	FLOWTAG("object"), /* KELEM_OBJECT */ /* XXX: TRANS */
+	FLOWTAG("ol"), /* KELEM_OL */
+	FLOWTAG("optgroup"), /* KELEM_OPTGROUP */
+	PHRASETAG("option"), /* KELEM_OPTION */
+	PHRASETAG("output"), /* KELEM_OUTPUT */
+	PHRASETAG("p"), /* KELEM_P */
+	VOIDTAG("param"), /* KELEM_PARAM */
+	PHRASETAG("pre"), /* KELEM_PRE */
+	PHRASETAG("progress"), /* KELEM_PROGRESS */
+	PHRASETAG("q"), /* KELEM_Q */
+	PHRASETAG("rp"), /* KELEM_RP */
+	PHRASETAG("rt"), /* KELEM_RT */
+	PHRASETAG("ruby"), /* KELEM_RUBY */
+	PHRASETAG("s"), /* KELEM_S */
+	PHRASETAG("samp"), /* KELEM_SAMP */
+	FLOWTAG("script"), /* KELEM_SCRIPT */
+	FLOWTAG("section"), /* KELEM_SECTION */
+	FLOWTAG("select"), /* KELEM_SELECT */
+	PHRASETAG("small"), /* KELEM_SMALL */
+	VOIDTAG("source"), /* KELEM_SOURCE */
+	PHRASETAG("span"), /* KELEM_SPAN */
+	PHRASETAG("strong"), /* KELEM_STRONG */
+	FLOWTAG("style"), /* KELEM_STYLE */
+	PHRASETAG("sub"), /* KELEM_SUB */
+	PHRASETAG("summary"), /* KELEM_SUMMARY */
+	PHRASETAG("sup"), /* KELEM_SUP */
+	FLOWTAG("table"), /* KELEM_TABLE */
+	FLOWTAG("tbody"), /* KELEM_TBODY */
+	FLOWTAG("td"), /* KELEM_TD */
+	PHRASETAG("textarea"), /* KELEM_TEXTAREA */
+	FLOWTAG("tfoot"), /* KELEM_TFOOT */
+	FLOWTAG("th"), /* KELEM_TH */
+	FLOWTAG("thead"), /* KELEM_THEAD */
+	PHRASETAG("time"), /* KELEM_TIME */
+	PHRASETAG("title"), /* KELEM_TITLE */
+	FLOWTAG("tr"), /* KELEM_TR */
+	VOIDTAG("track"), /* KELEM_TRACK */
+	PHRASETAG("u"), /* KELEM_U */
+	FLOWTAG("ul"), /* KELEM_UL */
+	PHRASETAG("var"), /* KELEM_VAR */
+	FLOWTAG("video"), /* KELEM_VIDEO */ /* XXX: TRANS */
+	VOIDTAG("wbr"), /* KELEM_WBR */
 };
 
-static	const char *const attrs[KATTR__MAX] = {
-	"accept-charset", /* KATTR_ACCEPT_CHARSET */
-	"accesskey", /* KATTR_ACCESSKEY */
-	"action", /* KATTR_ACTION */
-	"alt", /* KATTR_ALT */
-	"async", /* KATTR_ASYNC */
-	"autocomplete", /* KATTR_AUTOCOMPLETE */
-	"autofocus", /* KATTR_AUTOFOCUS */
-	"autoplay", /* KATTR_AUTOPLAY */
-	"border", /* KATTR_BORDER */
-	"challenge", /* KATTR_CHALLENGE */
-	"charset", /* KATTR_CHARSET */
-	"checked", /* KATTR_CHECKED */
-	"cite", /* KATTR_CITE */
-	"class", /* KATTR_CLASS */
-	"cols", /* KATTR_COLS */
-	"colspan", /* KATTR_COLSPAN */
-	"content", /* KATTR_CONTENT */
-	"contenteditable", /* KATTR_CONTENTEDITABLE */
-	"contextmenu", /* KATTR_CONTEXTMENU */
-	"controls", /* KATTR_CONTROLS */
-	"coords", /* KATTR_COORDS */
-	"datetime", /* KATTR_DATETIME */
-	"default", /* KATTR_DEFAULT */
-	"defer", /* KATTR_DEFER */
-	"dir", /* KATTR_DIR */
-	"dirname", /* KATTR_DIRNAME */
-	"disabled", /* KATTR_DISABLED */
-	"draggable", /* KATTR_DRAGGABLE */
-	"dropzone", /* KATTR_DROPZONE */
-	"enctype", /* KATTR_ENCTYPE */
-	"for", /* KATTR_FOR */
-	"form", /* KATTR_FORM */
-	"formaction", /* KATTR_FORMACTION */
-	"formenctype", /* KATTR_FORMENCTYPE */
-	"formmethod", /* KATTR_FORMMETHOD */
-	"formnovalidate", /* KATTR_FORMNOVALIDATE */
-	"formtarget", /* KATTR_FORMTARGET */
-	"header", /* KATTR_HEADER */
-	"height", /* KATTR_HEIGHT */
-	"hidden", /* KATTR_HIDDEN */
-	"high", /* KATTR_HIGH */
-	"href", /* KATTR_HREF */
-	"hreflang", /* KATTR_HREFLANG */
-	"http-equiv", /* KATTR_HTTP_EQUIV */
-	"icon", /* KATTR_ICON */
-	"id", /* KATTR_ID */
-	"ismap", /* KATTR_ISMAP */
-	"keytype", /* KATTR_KEYTYPE */
-	"kind", /* KATTR_KIND */
-	"label", /* KATTR_LABEL */
-	"lang", /* KATTR_LANG */
-	"language", /* KATTR_LANGUAGE */
-	"list", /* KATTR_LIST */
-	"loop", /* KATTR_LOOP */
-	"low", /* KATTR_LOW */
-	"manifest", /* KATTR_MANIFEST */
-	"max", /* KATTR_MAX */
-	"maxlength", /* KATTR_MAXLENGTH */
-	"media", /* KATTR_MEDIA */
-	"mediagroup", /* KATTR_MEDIAGROUP */
-	"method", /* KATTR_METHOD */
-	"min", /* KATTR_MIN */
-	"multiple", /* KATTR_MULTIPLE */
-	"muted", /* KATTR_MUTED */
-	"name", /* KATTR_NAME */
-	"novalidate", /* KATTR_NOVALIDATE */
-	"onabort", /* KATTR_ONABORT */
-	"onafterprint", /* KATTR_ONAFTERPRINT */
-	"onbeforeprint", /* KATTR_ONBEFOREPRINT */
-	"onbeforeunload", /* KATTR_ONBEFOREUNLOAD */
-	"onblur", /* KATTR_ONBLUR */
-	"oncanplay", /* KATTR_ONCANPLAY */
-	"oncanplaythrough", /* KATTR_ONCANPLAYTHROUGH */
-	"onchange", /* KATTR_ONCHANGE */
-	"onclick", /* KATTR_ONCLICK */
-	"oncontextmenu", /* KATTR_ONCONTEXTMENU */
-	"ondblclick", /* KATTR_ONDBLCLICK */
-	"ondrag", /* KATTR_ONDRAG */
-	"ondragend", /* KATTR_ONDRAGEND */
-	"ondragenter", /* KATTR_ONDRAGENTER */
-	"ondragleave", /* KATTR_ONDRAGLEAVE */
-	"ondragover", /* KATTR_ONDRAGOVER */
-	"ondragstart", /* KATTR_ONDRAGSTART */
-	"ondrop", /* KATTR_ONDROP */
-	"ondurationchange", /* KATTR_ONDURATIONCHANGE */
-	"onemptied", /* KATTR_ONEMPTIED */
-	"onended", /* KATTR_ONENDED */
-	"onerror", /* KATTR_ONERROR */
-	"onfocus", /* KATTR_ONFOCUS */
-	"onhashchange", /* KATTR_ONHASHCHANGE */
-	"oninput", /* KATTR_ONINPUT */
-	"oninvalid", /* KATTR_ONINVALID */
-	"onkeydown", /* KATTR_ONKEYDOWN */
-	"onkeypress", /* KATTR_ONKEYPRESS */
-	"onkeyup", /* KATTR_ONKEYUP */
-	"onload", /* KATTR_ONLOAD */
-	"onloadeddata", /* KATTR_ONLOADEDDATA */
-	"onloadedmetadata", /* KATTR_ONLOADEDMETADATA */
-	"onloadstart", /* KATTR_ONLOADSTART */
-	"onmessage", /* KATTR_ONMESSAGE */
-	"onmousedown", /* KATTR_ONMOUSEDOWN */
-	"onmousemove", /* KATTR_ONMOUSEMOVE */
-	"onmouseout", /* KATTR_ONMOUSEOUT */
-	"onmouseover", /* KATTR_ONMOUSEOVER */
-	"onmouseup", /* KATTR_ONMOUSEUP */
-	"onmousewheel", /* KATTR_ONMOUSEWHEEL */
-	"onoffline", /* KATTR_ONOFFLINE */
-	"ononline", /* KATTR_ONONLINE */
-	"onpagehide", /* KATTR_ONPAGEHIDE */
-	"onpageshow", /* KATTR_ONPAGESHOW */
-	"onpause", /* KATTR_ONPAUSE */
-	"onplay", /* KATTR_ONPLAY */
-	"onplaying", /* KATTR_ONPLAYING */
-	"onpopstate", /* KATTR_ONPOPSTATE */
-	"onprogress", /* KATTR_ONPROGRESS */
-	"onratechange", /* KATTR_ONRATECHANGE */
-	"onreadystatechange", /* KATTR_ONREADYSTATECHANGE */
-	"onreset", /* KATTR_ONRESET */
-	"onresize", /* KATTR_ONRESIZE */
-	"onscroll", /* KATTR_ONSCROLL */
-	"onseeked", /* KATTR_ONSEEKED */
-	"onseeking", /* KATTR_ONSEEKING */
-	"onselect", /* KATTR_ONSELECT */
-	"onshow", /* KATTR_ONSHOW */
-	"onstalled", /* KATTR_ONSTALLED */
-	"onstorage", /* KATTR_ONSTORAGE */
-	"onsubmit", /* KATTR_ONSUBMIT */
-	"onsuspend", /* KATTR_ONSUSPEND */
-	"ontimeupdate", /* KATTR_ONTIMEUPDATE */
-	"onunload", /* KATTR_ONUNLOAD */
-	"onvolumechange", /* KATTR_ONVOLUMECHANGE */
-	"onwaiting", /* KATTR_ONWAITING */
-	"open", /* KATTR_OPEN */
-	"optimum", /* KATTR_OPTIMUM */
-	"pattern", /* KATTR_PATTERN */
-	"placeholder", /* KATTR_PLACEHOLDER */
-	"poster", /* KATTR_POSTER */
-	"preload", /* KATTR_PRELOAD */
-	"radiogroup", /* KATTR_RADIOGROUP */
-	"readonly", /* KATTR_READONLY */
-	"rel", /* KATTR_REL */
-	"required", /* KATTR_REQUIRED */
-	"reversed", /* KATTR_REVERSED */
-	"rows", /* KATTR_ROWS */
-	"rowspan", /* KATTR_ROWSPAN */
-	"sandbox", /* KATTR_SANDBOX */
-	"scope", /* KATTR_SCOPE */
-	"seamless", /* KATTR_SEAMLESS */
-	"selected", /* KATTR_SELECTED */
-	"shape", /* KATTR_SHAPE */
-	"size", /* KATTR_SIZE */
-	"sizes", /* KATTR_SIZES */
-	"span", /* KATTR_SPAN */
-	"spellcheck", /* KATTR_SPELLCHECK */
-	"src", /* KATTR_SRC */
-	"srcdoc", /* KATTR_SRCDOC */
-	"srclang", /* KATTR_SRCLANG */
-	"start", /* KATTR_START */
-	"step", /* KATTR_STEP */
-	"style", /* KATTR_STYLE */
-	"tabindex", /* KATTR_TABINDEX */
-	"target", /* KATTR_TARGET */
-	"title", /* KATTR_TITLE */
-	"translate", /* KATTR_TRANSLATE */
-	"type", /* KATTR_TYPE */
-	"usemap", /* KATTR_USEMAP */
-	"value", /* KATTR_VALUE */
-	"width", /* KATTR_WIDTH */
-	"wrap", /* KATTR_WRAP */
+static	const struct attr attrs[KATTR__MAX] = {
+	ATTR("accept-charset"), /* KATTR_ACCEPT_CHARSET */
+	ATTR("accesskey"), /* KATTR_ACCESSKEY */
+	ATTR("action"), /* KATTR_ACTION */
+	ATTR("alt"), /* KATTR_ALT */
+	ATTR("async"), /* KATTR_ASYNC */
+	ATTR("autocomplete"), /* KATTR_AUTOCOMPLETE */
+	ATTR("autofocus"), /* KATTR_AUTOFOCUS */
+	ATTR("autoplay"), /* KATTR_AUTOPLAY */
+	ATTR("border"), /* KATTR_BORDER */
+	ATTR("challenge"), /* KATTR_CHALLENGE */
+	ATTR("charset"), /* KATTR_CHARSET */
+	ATTR("checked"), /* KATTR_CHECKED */
+	ATTR("cite"), /* KATTR_CITE */
+	ATTR("class"), /* KATTR_CLASS */
+	ATTR("cols"), /* KATTR_COLS */
+	ATTR("colspan"), /* KATTR_COLSPAN */
+	ATTR("content"), /* KATTR_CONTENT */
+	ATTR("contenteditable"), /* KATTR_CONTENTEDITABLE */
+	ATTR("contextmenu"), /* KATTR_CONTEXTMENU */
+	ATTR("controls"), /* KATTR_CONTROLS */
+	ATTR("coords"), /* KATTR_COORDS */
+	ATTR("datetime"), /* KATTR_DATETIME */
+	ATTR("default"), /* KATTR_DEFAULT */
+	ATTR("defer"), /* KATTR_DEFER */
+	ATTR("dir"), /* KATTR_DIR */
+	ATTR("dirname"), /* KATTR_DIRNAME */
+	ATTR("disabled"), /* KATTR_DISABLED */
+	ATTR("draggable"), /* KATTR_DRAGGABLE */
+	ATTR("dropzone"), /* KATTR_DROPZONE */
+	ATTR("enctype"), /* KATTR_ENCTYPE */
+	ATTR("for"), /* KATTR_FOR */
+	ATTR("form"), /* KATTR_FORM */
+	ATTR("formaction"), /* KATTR_FORMACTION */
+	ATTR("formenctype"), /* KATTR_FORMENCTYPE */
+	ATTR("formmethod"), /* KATTR_FORMMETHOD */
+	ATTR("formnovalidate"), /* KATTR_FORMNOVALIDATE */
+	ATTR("formtarget"), /* KATTR_FORMTARGET */
+	ATTR("header"), /* KATTR_HEADER */
+	ATTR("height"), /* KATTR_HEIGHT */
+	ATTR("hidden"), /* KATTR_HIDDEN */
+	ATTR("high"), /* KATTR_HIGH */
+	ATTR("href"), /* KATTR_HREF */
+	ATTR("hreflang"), /* KATTR_HREFLANG */
+	ATTR("http-equiv"), /* KATTR_HTTP_EQUIV */
+	ATTR("icon"), /* KATTR_ICON */
+	ATTR("id"), /* KATTR_ID */
+	ATTR("ismap"), /* KATTR_ISMAP */
+	ATTR("keytype"), /* KATTR_KEYTYPE */
+	ATTR("kind"), /* KATTR_KIND */
+	ATTR("label"), /* KATTR_LABEL */
+	ATTR("lang"), /* KATTR_LANG */
+	ATTR("language"), /* KATTR_LANGUAGE */
+	ATTR("list"), /* KATTR_LIST */
+	ATTR("loop"), /* KATTR_LOOP */
+	ATTR("low"), /* KATTR_LOW */
+	ATTR("manifest"), /* KATTR_MANIFEST */
+	ATTR("max"), /* KATTR_MAX */
+	ATTR("maxlength"), /* KATTR_MAXLENGTH */
+	ATTR("media"), /* KATTR_MEDIA */
+	ATTR("mediagroup"), /* KATTR_MEDIAGROUP */
+	ATTR("method"), /* KATTR_METHOD */
+	ATTR("min"), /* KATTR_MIN */
+	ATTR("multiple"), /* KATTR_MULTIPLE */
+	ATTR("muted"), /* KATTR_MUTED */
+	ATTR("name"), /* KATTR_NAME */
+	ATTR("novalidate"), /* KATTR_NOVALIDATE */
+	ATTR("onabort"), /* KATTR_ONABORT */
+	ATTR("onafterprint"), /* KATTR_ONAFTERPRINT */
+	ATTR("onbeforeprint"), /* KATTR_ONBEFOREPRINT */
+	ATTR("onbeforeunload"), /* KATTR_ONBEFOREUNLOAD */
+	ATTR("onblur"), /* KATTR_ONBLUR */
+	ATTR("oncanplay"), /* KATTR_ONCANPLAY */
+	ATTR("oncanplaythrough"), /* KATTR_ONCANPLAYTHROUGH */
+	ATTR("onchange"), /* KATTR_ONCHANGE */
+	ATTR("onclick"), /* KATTR_ONCLICK */
+	ATTR("oncontextmenu"), /* KATTR_ONCONTEXTMENU */
+	ATTR("ondblclick"), /* KATTR_ONDBLCLICK */
+	ATTR("ondrag"), /* KATTR_ONDRAG */
+	ATTR("ondragend"), /* KATTR_ONDRAGEND */
+	ATTR("ondragenter"), /* KATTR_ONDRAGENTER */
+	ATTR("ondragleave"), /* KATTR_ONDRAGLEAVE */
+	ATTR("ondragover"), /* KATTR_ONDRAGOVER */
+	ATTR("ondragstart"), /* KATTR_ONDRAGSTART */
+	ATTR("ondrop"), /* KATTR_ONDROP */
+	ATTR("ondurationchange"), /* KATTR_ONDURATIONCHANGE */
+	ATTR("onemptied"), /* KATTR_ONEMPTIED */
+	ATTR("onended"), /* KATTR_ONENDED */
+	ATTR("onerror"), /* KATTR_ONERROR */
+	ATTR("onfocus"), /* KATTR_ONFOCUS */
+	ATTR("onhashchange"), /* KATTR_ONHASHCHANGE */
+	ATTR("oninput"), /* KATTR_ONINPUT */
+	ATTR("oninvalid"), /* KATTR_ONINVALID */
+	ATTR("onkeydown"), /* KATTR_ONKEYDOWN */
+	ATTR("onkeypress"), /* KATTR_ONKEYPRESS */
+	ATTR("onkeyup"), /* KATTR_ONKEYUP */
+	ATTR("onload"), /* KATTR_ONLOAD */
+	ATTR("onloadeddata"), /* KATTR_ONLOADEDDATA */
+	ATTR("onloadedmetadata"), /* KATTR_ONLOADEDMETADATA */
+	ATTR("onloadstart"), /* KATTR_ONLOADSTART */
+	ATTR("onmessage"), /* KATTR_ONMESSAGE */
+	ATTR("onmousedown"), /* KATTR_ONMOUSEDOWN */
+	ATTR("onmousemove"), /* KATTR_ONMOUSEMOVE */
+	ATTR("onmouseout"), /* KATTR_ONMOUSEOUT */
+	ATTR("onmouseover"), /* KATTR_ONMOUSEOVER */
+	ATTR("onmouseup"), /* KATTR_ONMOUSEUP */
+	ATTR("onmousewheel"), /* KATTR_ONMOUSEWHEEL */
+	ATTR("onoffline"), /* KATTR_ONOFFLINE */
+	ATTR("ononline"), /* KATTR_ONONLINE */
+	ATTR("onpagehide"), /* KATTR_ONPAGEHIDE */
+	ATTR("onpageshow"), /* KATTR_ONPAGESHOW */
+	ATTR("onpause"), /* KATTR_ONPAUSE */
+	ATTR("onplay"), /* KATTR_ONPLAY */
+	ATTR("onplaying"), /* KATTR_ONPLAYING */
+	ATTR("onpopstate"), /* KATTR_ONPOPSTATE */
+	ATTR("onprogress"), /* KATTR_ONPROGRESS */
+	ATTR("onratechange"), /* KATTR_ONRATECHANGE */
+	ATTR("onreadystatechange"), /* KATTR_ONREADYSTATECHANGE */
+	ATTR("onreset"), /* KATTR_ONRESET */
+	ATTR("onresize"), /* KATTR_ONRESIZE */
+	ATTR("onscroll"), /* KATTR_ONSCROLL */
+	ATTR("onseeked"), /* KATTR_ONSEEKED */
+	ATTR("onseeking"), /* KATTR_ONSEEKING */
+	ATTR("onselect"), /* KATTR_ONSELECT */
+	ATTR("onshow"), /* KATTR_ONSHOW */
+	ATTR("onstalled"), /* KATTR_ONSTALLED */
+	ATTR("onstorage"), /* KATTR_ONSTORAGE */
+	ATTR("onsubmit"), /* KATTR_ONSUBMIT */
+	ATTR("onsuspend"), /* KATTR_ONSUSPEND */
+	ATTR("ontimeupdate"), /* KATTR_ONTIMEUPDATE */
+	ATTR("onunload"), /* KATTR_ONUNLOAD */
+	ATTR("onvolumechange"), /* KATTR_ONVOLUMECHANGE */
+	ATTR("onwaiting"), /* KATTR_ONWAITING */
+	ATTR("open"), /* KATTR_OPEN */
+	ATTR("optimum"), /* KATTR_OPTIMUM */
+	ATTR("pattern"), /* KATTR_PATTERN */
+	ATTR("placeholder"), /* KATTR_PLACEHOLDER */
+	ATTR("poster"), /* KATTR_POSTER */
+	ATTR("preload"), /* KATTR_PRELOAD */
+	ATTR("radiogroup"), /* KATTR_RADIOGROUP */
+	ATTR("readonly"), /* KATTR_READONLY */
+	ATTR("rel"), /* KATTR_REL */
+	ATTR("required"), /* KATTR_REQUIRED */
+	ATTR("reversed"), /* KATTR_REVERSED */
+	ATTR("rows"), /* KATTR_ROWS */
+	ATTR("rowspan"), /* KATTR_ROWSPAN */
+	ATTR("sandbox"), /* KATTR_SANDBOX */
+	ATTR("scope"), /* KATTR_SCOPE */
+	ATTR("seamless"), /* KATTR_SEAMLESS */
+	ATTR("selected"), /* KATTR_SELECTED */
+	ATTR("shape"), /* KATTR_SHAPE */
+	ATTR("size"), /* KATTR_SIZE */
+	ATTR("sizes"), /* KATTR_SIZES */
+	ATTR("span"), /* KATTR_SPAN */
+	ATTR("spellcheck"), /* KATTR_SPELLCHECK */
+	ATTR("src"), /* KATTR_SRC */
+	ATTR("srcdoc"), /* KATTR_SRCDOC */
+	ATTR("srclang"), /* KATTR_SRCLANG */
+	ATTR("start"), /* KATTR_START */
+	ATTR("step"), /* KATTR_STEP */
+	ATTR("style"), /* KATTR_STYLE */
+	ATTR("tabindex"), /* KATTR_TABINDEX */
+	ATTR("target"), /* KATTR_TARGET */
+	ATTR("title"), /* KATTR_TITLE */
+	ATTR("translate"), /* KATTR_TRANSLATE */
+	ATTR("type"), /* KATTR_TYPE */
+	ATTR("usemap"), /* KATTR_USEMAP */
+	ATTR("value"), /* KATTR_VALUE */
+	ATTR("width"), /* KATTR_WIDTH */
+	ATTR("wrap"), /* KATTR_WRAP */
 };
 
+/*
+ * All output goes through here.
+ * If we're recording a fragment, append to its buffer instead of
+ * writing to the request, noting memory failure in the fragment.
+ */
+static void
+khtml_emit(struct khtmlreq *req, const char *buf, size_t sz)
+{
+	struct khtmlfrag *f = req->frag;
+	size_t		  max;
+	char		 *pp;
+
+	if (NULL == f) {
+		khttp_write(req->req, buf, sz);
+		return;
+	} else if (f->err)
+		return;
+
+	if (f->bufsz + sz > f->bufmax) {
+		max = f->bufmax ? f->bufmax : 1024;
+		while (f->bufsz + sz > max)
+			max *= 2;
+		if (NULL == (pp = krealloc(f->buf, max))) {
+			f->err = 1;
+			return;
+		}
+		f->buf = pp;
+		f->bufmax = max;
+	}
+	memcpy(f->buf + f->bufsz, buf, sz);
+	f->bufsz += sz;
+}
+
+static void
+khtml_emitc(struct khtmlreq *req, char c)
+{
+
+	khtml_emit(req, &c, 1);
+}
+
+static void
+khtml_emits(struct khtmlreq *req, const char *cp)
+{
+
+	khtml_emit(req, cp, strlen(cp));
+}
+
 size_t
 khtml_elemat(struct khtmlreq *req)
 {
@@ -499,13 +573,13 @@ khtml_flow_open(struct khtmlreq *req, enum kelem elem)
 
 	if (TAG_FLOW == tags[elem].flags)
 		if ( ! req->newln) {
-			khttp_putc(req->req, '\n');
+			khtml_emitc(req, '\n');
 			req->newln = 1;
 		}
 
 	if (req->newln)
 		for (i = 0; i < req->elemsz; i++) 
-			khttp_puts(req->req, "  ");
+			khtml_emits(req, "  ");
 
 	req->newln = 0;
 }
@@ -523,12 +597,34 @@ khtml_flow_close(struct khtmlreq *req, enum kelem elem)
 
 	if (TAG_FLOW == tags[elem].flags ||
 		TAG_INSTRUCTION == tags[elem].flags) {
-		khttp_putc(req->req, '\n');
+		khtml_emitc(req, '\n');
 		req->newln = 1;
 	} else
 		req->newln = 0;
 }
 
+/*
+ * Finish an opening tag.
+ * If "attr" is set, we've written attributes and must close the last
+ * value and the tag itself; otherwise, we wrote the tag whole.
+ * Then push the tag onto the stack if it may have content.
+ */
+static void
+khtml_attr_end(struct khtmlreq *req, enum kelem elem, int attr)
+{
+
+	if (attr && TAG_VOID == tags[elem].flags)
+		khtml_emit(req, "\"/>", 3);
+	else if (attr)
+		khtml_emit(req, "\">", 2);
+	khtml_flow_close(req, elem);
+
+	if (TAG_VOID != tags[elem].flags &&
+		TAG_INSTRUCTION != tags[elem].flags)
+		req->elems[req->elemsz++] = elem;
+	assert(req->elemsz < KDATA_MAXELEMSZ);
+}
+
 void
 khtml_attrx(struct khtmlreq *req, enum kelem elem, ...)
 {
@@ -536,15 +632,20 @@ khtml_attrx(struct khtmlreq *req, enum kelem elem, ...)
 	enum kattr	 at;
 
 	khtml_flow_open(req, elem);
-	khttp_putc(req->req, '<');
-	khttp_puts(req->req, tags[elem].name);
 
 	va_start(ap, elem);
-	while (KATTR__MAX != (at = va_arg(ap, enum kattr))) {
-		khttp_putc(req->req, ' ');
-		khttp_puts(req->req, attrs[at]);
-		khttp_putc(req->req, '=');
-		khttp_putc(req->req, '"');
+	if (KATTR__MAX == (at = va_arg(ap, enum kattr))) {
+		va_end(ap);
+		khtml_emit(req, 
+			tags[elem].bare, tags[elem].baresz);
+		khtml_attr_end(req, elem, 0);
+		return;
+	}
+
+	khtml_emit(req, tags[elem].open, tags[elem].namesz + 1);
+	for (;;) {
+		khtml_emit(req, 
+			attrs[at].prefix, attrs[at].prefixsz);
 		switch (va_arg(ap, enum kattrx)) {
 		case (KATTRX_STRING):
 			khtml_puts(req, va_arg(ap, char *));
@@ -555,19 +656,13 @@ khtml_attrx(struct khtmlreq *req, enum kelem elem, ...)
 		case (KATTRX_DOUBLE):
 			khtml_double(req, va_arg(ap, double));
 		}
-		khttp_putc(req->req, '"');
+		if (KATTR__MAX == (at = va_arg(ap, enum kattr)))
+			break;
+		khtml_emitc(req, '"');
 	}
 	va_end(ap);
 
-	if (TAG_VOID == tags[elem].flags)
-		khttp_putc(req->req, '/');
-	khttp_putc(req->req, '>');
-	khtml_flow_close(req, elem);
-
-	if (TAG_VOID != tags[elem].flags &&
-		TAG_INSTRUCTION != tags[elem].flags)
-		req->elems[req->elemsz++] = elem;
-	assert(req->elemsz < KDATA_MAXELEMSZ);
+	khtml_attr_end(req, elem, 1);
 }
 
 void
@@ -578,38 +673,39 @@ khtml_attr(struct khtmlreq *req, enum kelem elem, ...)
 	const char	*cp;
 
 	khtml_flow_open(req, elem);
-	khttp_putc(req->req, '<');
-	khttp_puts(req->req, tags[elem].name);
+
+	/* Common case: no attributes, so one write. */
 
 	va_start(ap, elem);
-	while (KATTR__MAX != (at = va_arg(ap, enum kattr))) {
+	if (KATTR__MAX == (at = va_arg(ap, enum kattr))) {
+		va_end(ap);
+		khtml_emit(req, 
+			tags[elem].bare, tags[elem].baresz);
+		khtml_attr_end(req, elem, 0);
+		return;
+	}
+
+	khtml_emit(req, tags[elem].open, tags[elem].namesz + 1);
+	for (;;) {
 		cp = va_arg(ap, char *);
 		assert(NULL != cp);
-		khttp_putc(req->req, ' ');
-		khttp_puts(req->req, attrs[at]);
-		khttp_putc(req->req, '=');
-		khttp_putc(req->req, '"');
+		khtml_emit(req, 
+			attrs[at].prefix, attrs[at].prefixsz);
 		khtml_puts(req, cp);
-		khttp_putc(req->req, '"');
-
+		if (KATTR__MAX == (at = va_arg(ap, enum kattr)))
+			break;
+		khtml_emitc(req, '"');
 	}
 	va_end(ap);
 
-	if (TAG_VOID == tags[elem].flags)
-		khttp_putc(req->req, '/');
-	khttp_putc(req->req, '>');
-	khtml_flow_close(req, elem);
-
-	if (TAG_VOID != tags[elem].flags &&
-		TAG_INSTRUCTION != tags[elem].flags)
-		req->elems[req->elemsz++] = elem;
-	assert(req->elemsz < KDATA_MAXELEMSZ);
+	khtml_attr_end(req, elem, 1);
 }
 
 int
 khtml_closeelem(struct khtmlreq *req, size_t sz)
 {
 	size_t		 i;
+	enum kelem	 elem;
 
 	if (0 == sz)
 		sz = req->elemsz;
@@ -617,12 +713,13 @@ khtml_closeelem(struct khtmlreq *req, size_t sz)
 	for (i = 0; i < sz; i++) {
 		if (0 == req->elemsz) 
 			return(0);
-		req->elemsz--;
-		khtml_flow_open(req, req->elems[req->elemsz]);
-		khttp_puts(req->req, "</");
-		khttp_puts(req->req, tags[req->elems[req->elemsz]].name);
-		khttp_putc(req->req, '>');
-		khtml_flow_close(req, req->elems[req->elemsz]);
+		elem = req->elems[--req->elemsz];
+		if (NULL != req->frag && req->elemsz < req->frag->low)
+			req->frag->low = req->elemsz;
+		khtml_flow_open(req, elem);
+		khtml_emit(req, 
+			tags[elem].close, tags[elem].namesz + 3);
+		khtml_flow_close(req, elem);
 	}
 	return(1);
 }
@@ -650,9 +747,9 @@ khtml_ncr(struct khtmlreq *req, uint16_t ncr)
 	char	 buf[INT_MAXSZ];
 
 	(void)snprintf(buf, sizeof(buf), "%" PRIx16, ncr);
-	khttp_puts(req->req, "&#x");
-	khttp_puts(req->req, buf);
-	khttp_putc(req->req, ';');
+	khtml_emits(req, "&#x");
+	khtml_emits(req, buf);
+	khtml_emitc(req, ';');
 }
 
 void
@@ -694,7 +791,7 @@ khtml_putc(struct khtmlreq *r, char c)
 		khtml_ncr(r, 39);
 		break;
 	default:
-		khttp_putc(r->req, c);
+		khtml_emitc(r, c);
 		break;
 	}
 }
@@ -740,6 +837,128 @@ khtml_text(struct khtmlreq *req, const char *cp)
 		khtml_putc(req, *cp++);
 }
 
+/*
+ * Begin recording output into "f" instead of writing it.
+ * We note the element stack so that the fragment, when written, can
+ * close the same elements (if it closes any that it didn't open) and
+ * leave open those it opened.
+ */
+int
+khtml_frag_open(struct khtmlreq *req, struct khtmlfrag *f)
+{
+
+	if (NULL != req->frag)
+		return(0);
+	memset(f, 0, sizeof(struct khtmlfrag));
+	f->base = f->low = req->elemsz;
+	f->startnl = req->newln;
+	memcpy(f->stack, req->elems, req->elemsz * sizeof(enum kelem));
+	req->frag = f;
+	return(1);
+}
+
+/*
+ * Mark a hole in the fragment being recorded, to be filled in with a
+ * value when written.
+ */
+int
+khtml_frag_hole(struct khtmlreq *req)
+{
+	struct khtmlfrag *f = req->frag;
+	size_t		 *pp;
+
+	if (NULL == f || f->err)
+		return(0);
+	pp = kreallocarray(f->holes, f->holesz + 1, sizeof(size_t));
+	if (NULL == pp) {
+		f->err = 1;
+		return(0);
+	}
+	f->holes = pp;
+	f->holes[f->holesz++] = f->bufsz;
+	req->newln = 0;
+	return(1);
+}
+
+/*
+ * Stop recording.
+ * Note which elements below where we started were closed and which
+ * remain open.
+ * On failure, the fragment is freed.
+ */
+int
+khtml_frag_close(struct khtmlreq *req)
+{
+	struct khtmlfrag *f = req->frag;
+
+	if (NULL == f)
+		return(0);
+	req->frag = NULL;
+	if (f->err) {
+		khtml_frag_free(f);
+		return(0);
+	}
+	f->pushsz = req->elemsz - f->low;
+	memcpy(f->pushes, req->elems + f->low, 
+		f->pushsz * sizeof(enum kelem));
+	f->newln = req->newln;
+	return(1);
+}
+
+/*
+ * Write the fragment "f" with its holes filled by the text (escaped)
+ * of "vals" in order, which may be NULL if there are no holes.
+ * The elements at the top of the stack must be those the fragment
+ * closes, else nothing is written and we return zero.
+ */
+int
+khtml_frag_write(struct khtmlreq *req, 
+	const struct khtmlfrag *f, const char *const *vals)
+{
+	size_t		 i, pos, popsz;
+
+	popsz = f->base - f->low;
+	if (NULL != req->frag || req->elemsz < popsz ||
+	    req->elemsz - popsz + f->pushsz >= KDATA_MAXELEMSZ ||
+	    memcmp(req->elems + req->elemsz - popsz, 
+	     f->stack + f->low, popsz * sizeof(enum kelem)))
+		return(0);
+
+	/*
+	 * If pretty-printing, we recorded at the start of a line but
+	 * aren't there now, get there.
+	 */
+
+	if (KHTML_PRETTY & req->opts && f->startnl && ! req->newln)
+		khttp_putc(req->req, '\n');
+
+	for (pos = i = 0; i < f->holesz; i++) {
+		khttp_write(req->req, f->buf + pos, f->holes[i] - pos);
+		pos = f->holes[i];
+		if (NULL != vals[i])
+			khtml_puts(req, vals[i]);
+	}
+	khttp_write(req->req, f->buf + pos, f->bufsz - pos);
+
+	req->elemsz -= popsz;
+	memcpy(req->elems + req->elemsz, f->pushes, 
+		f->pushsz * sizeof(enum kelem));
+	req->elemsz += f->pushsz;
+	req->newln = f->newln;
+	return(1);
+}
+
+void
+khtml_frag_free(struct khtmlfrag *f)
+{
+
+	free(f->buf);
+	free(f->holes);
+	f->buf = NULL;
+	f->holes = NULL;
+	f->bufsz = f->bufmax = f->holesz = 0;
+}
+
 void
 khtml_open(struct khtmlreq *r, struct kreq *req, int opts)
 {
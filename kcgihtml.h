@@ -452,14 +452,36 @@ enum	kelem {
 	KELEM__MAX
 };
 
+#define	KDATA_MAXELEMSZ	 128
+
+/*
+ * Output recorded once by khtml_frag_open() and khtml_frag_close(),
+ * then written many times by khtml_frag_write().
+ */
+struct	khtmlfrag {
+	char		*buf; /* recorded (escaped) output */
+	size_t		 bufsz; /* length of "buf" */
+	size_t		 bufmax; /* allocated size of "buf" */
+	size_t		*holes; /* offsets of holes in "buf" */
+	size_t		 holesz; /* number of holes */
+	size_t		 base; /* stack depth when recording began */
+	size_t		 low; /* lowest stack depth while recording */
+	enum kelem	 stack[KDATA_MAXELEMSZ]; /* stack when begun */
+	enum kelem	 pushes[KDATA_MAXELEMSZ]; /* elements left open */
+	size_t		 pushsz; /* number of "pushes" */
+	int		 startnl; /* pretty-printing state at start */
+	int		 newln; /* pretty-printing state at end */
+	int		 err; /* memory failure while recording */
+};
+
 struct	khtmlreq {
 	struct kreq	*req;
-#define	KDATA_MAXELEMSZ	 128
 	enum kelem	 elems[KDATA_MAXELEMSZ];
 	size_t		 elemsz;
 	int		 newln;
 	int		 opts;
 #define	KHTML_PRETTY	 0x01
+	struct khtmlfrag *frag; /* fragment being recorded or NULL */
 };
 
 __BEGIN_DECLS
@@ -473,6 +495,12 @@ void		 khtml_double(struct khtmlreq *, double);
 void		 khtml_elem(struct khtmlreq *, enum kelem);
 size_t		 khtml_elemat(struct khtmlreq *);
 void		 khtml_entity(struct khtmlreq *, enum kentity);
+int		 khtml_frag_close(struct khtmlreq *);
+void		 khtml_frag_free(struct khtmlfrag *);
+int		 khtml_frag_hole(struct khtmlreq *);
+int		 khtml_frag_open(struct khtmlreq *, struct khtmlfrag *);
+int		 khtml_frag_write(struct khtmlreq *, 
+			const struct khtmlfrag *, const char *const *);
 void		 khtml_int(struct khtmlreq *, int64_t);
 void		 khtml_ncr(struct khtmlreq *, uint16_t);
 void		 khtml_open(struct khtmlreq *, struct kreq *, int);
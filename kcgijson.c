@@ -36,6 +36,61 @@ kjson_open(struct kjsonreq *r, struct kreq *req)
 	r->stack[0].type = KJSON_ROOT;
 }
 
+int
+kjson_stream(struct kjsonreq *r, enum kjsonstream stream,
+	size_t flushrows, int (*wouldblock)(void *), void *arg)
+{
+
+	/* Only before we've written anything. */
+	if (r->stackpos > 0 || r->stack[0].elements > 0)
+		return(0);
+
+	r->stream = stream;
+	r->flushrows = flushrows;
+	r->wouldblock = wouldblock;
+	r->arg = arg;
+	return(1);
+}
+
+/*
+ * Flush buffered output to the wire.
+ * If the wire won't accept data, let the producer do something useful
+ * (or wait) by invoking the callback until it's writable or until the
+ * callback returns zero, in which case we simply block.
+ */
+static void
+kjson_flush(struct kjsonreq *r)
+{
+
+	if (NULL != r->wouldblock)
+		while (0 == khttp_writable(r->req, 0))
+			if ( ! r->wouldblock(r->arg))
+				break;
+	khttp_flush(r->req);
+}
+
+/*
+ * Invoke after a value has been completed in the current scope.
+ * A "row" is a top-level value when streaming or a value within the
+ * outermost array or object otherwise.
+ * Streamed rows are terminated by a newline.
+ */
+static void
+kjson_row(struct kjsonreq *r)
+{
+
+	if (KJSON_STREAM_NONE != r->stream) {
+		if (r->stackpos > 0)
+			return;
+		khttp_putc(r->req, '\n');
+	} else if (1 != r->stackpos)
+		return;
+
+	r->rows++;
+	if (r->flushrows > 0 && 0 == r->rows % r->flushrows)
+		kjson_flush(r);
+}
+
 int
 kjson_close(struct kjsonreq *r)
 {
@@ -57,59 +112,121 @@ kjson_close(struct kjsonreq *r)
 			abort();
 		}
 		r->stackpos--;
+		kjson_row(r);
 	}
 
+	if (r->flushrows > 0)
+		kjson_flush(r);
 	return(i);
 }
 
+/*
+ * Return the escape sequence for a character within a JSON string or
+ * NULL if it's written as-is.
+ */
+static const char *
+kjson_escchar(int c)
+{
+
+	switch (c) {
+	case ('"'):
+		return("\\\"");
+	case ('\\'):
+		return("\\\\");
+	case ('/'):
+		return("\\/");
+	case ('\b'):
+		return("\\b");
+	case ('\f'):
+		return("\\f");
+	case ('\n'):
+		return("\\n");
+	case ('\r'):
+		return("\\r");
+	case ('\t'):
+		return("\\t");
+	default:
+		break;
+	}
+	return(NULL);
+}
+
+/*
+ * Write the escaped contents of a JSON string, writing runs of
+ * unescaped characters at once.
+ */
+static void
+kjson_escape(struct kreq *req, const char *cp, size_t sz)
+{
+	const char	*esc;
+	size_t		 i, start;
+
+	for (start = i = 0; i < sz; i++) {
+		if (NULL == (esc = kjson_escchar(cp[i])))
+			continue;
+		khttp_write(req, cp + start, i - start);
+		khttp_puts(req, esc);
+		start = i + 1;
+	}
+	khttp_write(req, cp + start, i - start);
+}
+
 /*
  * Put a quoted JSON string into the output stream.
  */
 static void
 kjson_puts(struct kjsonreq *r, const char *cp)
 {
-	int	 c;
 
 	khttp_putc(r->req, '"');
+	kjson_escape(r->req, cp, strlen(cp));
+	khttp_putc(r->req, '"');
+}
 
-	while ('\0' != (c = *cp++))
-		switch (c) {
-		case ('"'):
-		case ('\\'):
-		case ('/'):
-			khttp_putc(r->req, '\\');
-			khttp_putc(r->req, c);
-			break;
-		case ('\b'):
-			khttp_puts(r->req, "\\b");
-			break;
-		case ('\f'):
-			khttp_puts(r->req, "\\f");
-			break;
-		case ('\n'):
-			khttp_puts(r->req, "\\n");
-			break;
-		case ('\r'):
-			khttp_puts(r->req, "\\r");
-			break;
-		case ('\t'):
-			khttp_puts(r->req, "\\t");
-			break;
-		default:
-			khttp_putc(r->req, c);
-			break;
-		}
+int
+kjson_key_init(struct kjsonkey *k, const char *key)
+{
+	const char	*esc;
+	size_t		 sz;
 
-	khttp_putc(r->req, '"');
+	/* Worst case: every character becomes two, plus quotes. */
+
+	memset(k, 0, sizeof(struct kjsonkey));
+	if (NULL == (k->buf = kmalloc(strlen(key) * 2 + 5)))
+		return(0);
+
+	k->buf[k->bufsz++] = '"';
+	for ( ; '\0' != *key; key++) 
+		if (NULL != (esc = kjson_escchar(*key))) {
+			sz = strlen(esc);
+			memcpy(k->buf + k->bufsz, esc, sz);
+			k->bufsz += sz;
+		} else
+			k->buf[k->bufsz++] = *key;
+	memcpy(k->buf + k->bufsz, "\": ", 4);
+	k->bufsz += 3;
+	return(1);
+}
+
+void
+kjson_key_free(struct kjsonkey *k)
+{
+
+	free(k->buf);
+	memset(k, 0, sizeof(struct kjsonkey));
 }
 
+/*
+ * Check that we can write a value into the current scope, with or
+ * without a key, and write the separator from any prior value.
+ */
 static int
-kjson_check(struct kjsonreq *r, const char *key)
+kjson_scope(struct kjsonreq *r, int haskey)
 {
 
 	/* We should never be in a string context. */
 	if (KJSON_STRING == r->stack[r->stackpos].type)
-		goto out;
+		return(0);
 
 	/*
 	 * Check the parent of a new JSON value.
@@ -117,18 +234,26 @@ kjson_check(struct kjsonreq *r, const char *key)
 	 * (KJSON_ROOT) or an array (KJSON_ARRAY), both of which accept
 	 * only values.
 	 */
-	if (NULL != key && KJSON_OBJECT == r->stack[r->stackpos].type)
-		goto out;
-	if (NULL == key && KJSON_ARRAY == r->stack[r->stackpos].type)
-		goto out;
-	if (NULL == key && KJSON_ROOT == r->stack[r->stackpos].type)
-		goto out;
-
-	return(0);
-out:
-	if (r->stack[r->stackpos].elements++ > 0) 
+	if (haskey && KJSON_OBJECT != r->stack[r->stackpos].type)
+		return(0);
+	if ( ! haskey && KJSON_OBJECT == r->stack[r->stackpos].type)
+		return(0);
+
+	if (0 == r->stackpos && KJSON_STREAM_NONE != r->stream) {
+		r->stack[r->stackpos].elements++;
+		if (KJSON_STREAM_SEQ == r->stream)
+			khttp_putc(r->req, 0x1e);
+	} else if (r->stack[r->stackpos].elements++ > 0) 
 		khttp_puts(r->req, ", ");
+	return(1);
+}
+
+static int
+kjson_check(struct kjsonreq *r, const char *key)
+{
 
+	if ( ! kjson_scope(r, NULL != key))
+		return(0);
 	if (NULL != key) {
 		kjson_puts(r, key);
 		khttp_puts(r->req, ": ");
@@ -136,6 +261,103 @@ out:
 	return(1);
 }
 
+/*
+ * Like kjson_check() but with a pre-serialised key.
+ */
+static int
+kjson_checkk(struct kjsonreq *r, const struct kjsonkey *key)
+{
+
+	if ( ! kjson_scope(r, NULL != key))
+		return(0);
+	if (NULL != key)
+		khttp_write(r->req, key->buf, key->bufsz);
+	return(1);
+}
+
+/*
+ * Open a new scope of the given type after its key has been written.
+ */
+static void
+kjson_push(struct kjsonreq *r, enum kjsontype type, int c)
+{
+
+	r->stack[r->stackpos].elements++;
+	r->stack[++r->stackpos].elements = 0;
+	r->stack[r->stackpos].type = type;
+	assert(r->stackpos < 128);
+	khttp_putc(r->req, c);
+}
+
+static int
+kjson_putnumberk(struct kjsonreq *r, 
+	const struct kjsonkey *key, const char *val)
+{
+
+	if ( ! kjson_checkk(r, key))
+		return(0);
+	khttp_puts(r->req, val);
+	kjson_row(r);
+	return(1);
+}
+
+int
+kjson_putstringk(struct kjsonreq *r, 
+	const struct kjsonkey *key, const char *val)
+{
+
+	if ( ! kjson_checkk(r, key))
+		return(0);
+	kjson_puts(r, val);
+	kjson_row(r);
+	return(1);
+}
+
+int
+kjson_putdoublek(struct kjsonreq *r, 
+	const struct kjsonkey *key, double val)
+{
+	char	buf[256];
+
+	(void)snprintf(buf, sizeof(buf), "%g", val);
+	return(kjson_putnumberk(r, key, buf));
+}
+
+int
+kjson_putintk(struct kjsonreq *r, 
+	const struct kjsonkey *key, int64_t val)
+{
+	char	buf[22];
+
+	(void)snprintf(buf, sizeof(buf), "%" PRId64, val);
+	return(kjson_putnumberk(r, key, buf));
+}
+
+int
+kjson_putintstrk(struct kjsonreq *r, 
+	const struct kjsonkey *key, int64_t val)
+{
+	char	buf[22];
+
+	(void)snprintf(buf, sizeof(buf), "%" PRId64, val);
+	return(kjson_putstringk(r, key, buf));
+}
+
+int
+kjson_putboolk(struct kjsonreq *r, 
+	const struct kjsonkey *key, int val)
+{
+
+	return(kjson_putnumberk(r, key, val ? "true" : "false"));
+}
+
+int
+kjson_putnullk(struct kjsonreq *r, const struct kjsonkey *key)
+{
+
+	return(kjson_putnumberk(r, key, "null"));
+}
+
 static int
 kjson_putnumberp(struct kjsonreq *r, const char *key, const char *val)
 {
@@ -143,6 +365,7 @@ kjson_putnumberp(struct kjsonreq *r, const char *key, const char *val)
 	if ( ! kjson_check(r, key))
 		return(0);
 	khttp_puts(r->req, val);
+	kjson_row(r);
 	return(1);
 }
 
@@ -160,6 +383,7 @@ kjson_putstringp(struct kjsonreq *r, const char *key, const char *val)
 	if ( ! kjson_check(r, key))
 		return(0);
 	kjson_puts(r, val);
+	kjson_row(r);
 	return(1);
 }
 
@@ -200,6 +424,7 @@ kjson_putnullp(struct kjsonreq *r, const char *key)
 	if ( ! kjson_check(r, key))
 		return(0);
 	khttp_puts(r->req, "null");
+	kjson_row(r);
 	return(1);
 }
 
@@ -210,6 +435,7 @@ kjson_putboolp(struct kjsonreq *r, const char *key, int val)
 	if ( ! kjson_check(r, key))
 		return(0);
 	khttp_puts(r->req, val ? "true" : "false");
+	kjson_row(r);
 	return(1);
 }
 
@@ -259,12 +485,17 @@ kjson_arrayp_open(struct kjsonreq *r, const char *key)
 
 	if ( ! kjson_check(r, key))
 		return(0);
+	kjson_push(r, KJSON_ARRAY, '[');
+	return(1);
+}
 
-	r->stack[r->stackpos].elements++;
-	r->stack[++r->stackpos].elements = 0;
-	r->stack[r->stackpos].type = KJSON_ARRAY;
-	assert(r->stackpos < 128);
-	khttp_putc(r->req, '[');
+int
+kjson_arrayk_open(struct kjsonreq *r, const struct kjsonkey *key)
+{
+
+	if ( ! kjson_checkk(r, key))
+		return(0);
+	kjson_push(r, KJSON_ARRAY, '[');
 	return(1);
 }
 
@@ -278,6 +509,7 @@ kjson_array_close(struct kjsonreq *r)
 		return(0);
 	khttp_putc(r->req, ']');
 	r->stackpos--;
+	kjson_row(r);
 	return(1);
 }
 
@@ -285,39 +517,11 @@ int
 kjson_string_write(const char *p, size_t sz, void *arg)
 {
 	struct kjsonreq	*r = arg;
-	size_t		 i;
 
 	if (KJSON_STRING != r->stack[r->stackpos].type)
 		return(0);
 
-	for (i = 0; i < sz; i++) 
-		switch (p[i]) {
-		case ('"'):
-		case ('\\'):
-		case ('/'):
-			khttp_putc(r->req, '\\');
-			khttp_putc(r->req, p[i]);
-			break;
-		case ('\b'):
-			khttp_puts(r->req, "\\b");
-			break;
-		case ('\f'):
-			khttp_puts(r->req, "\\f");
-			break;
-		case ('\n'):
-			khttp_puts(r->req, "\\n");
-			break;
-		case ('\r'):
-			khttp_puts(r->req, "\\r");
-			break;
-		case ('\t'):
-			khttp_puts(r->req, "\\t");
-			break;
-		default:
-			khttp_putc(r->req, p[i]);
-			break;
-		}
-
+	kjson_escape(r->req, p, sz);
 	return(1);
 }
 
@@ -359,12 +563,17 @@ kjson_stringp_open(struct kjsonreq *r, const char *key)
 
 	if ( ! kjson_check(r, key))
 		return(0);
+	kjson_push(r, KJSON_STRING, '"');
+	return(1);
+}
 
-	r->stack[r->stackpos].elements++;
-	r->stack[++r->stackpos].elements = 0;
-	r->stack[r->stackpos].type = KJSON_STRING;
-	assert(r->stackpos < 128);
-	khttp_putc(r->req, '"');
+int
+kjson_stringk_open(struct kjsonreq *r, const struct kjsonkey *key)
+{
+
+	if ( ! kjson_checkk(r, key))
+		return(0);
+	kjson_push(r, KJSON_STRING, '"');
 	return(1);
 }
 
@@ -378,6 +587,7 @@ kjson_string_close(struct kjsonreq *r)
 		return(0);
 	khttp_putc(r->req, '"');
 	r->stackpos--;
+	kjson_row(r);
 	return(1);
 }
 
@@ -394,12 +604,17 @@ kjson_objp_open(struct kjsonreq *r, const char *key)
 
 	if ( ! kjson_check(r, key))
 		return(0);
+	kjson_push(r, KJSON_OBJECT, '{');
+	return(1);
+}
 
-	r->stack[r->stackpos].elements++;
-	r->stack[++r->stackpos].elements = 0;
-	r->stack[r->stackpos].type = KJSON_OBJECT;
-	assert(r->stackpos < 128);
-	khttp_putc(r->req, '{');
+int
+kjson_objk_open(struct kjsonreq *r, const struct kjsonkey *key)
+{
+
+	if ( ! kjson_checkk(r, key))
+		return(0);
+	kjson_push(r, KJSON_OBJECT, '{');
 	return(1);
 }
 
@@ -413,5 +628,6 @@ kjson_obj_close(struct kjsonreq *r)
 		return(0);
 	khttp_putc(r->req, '}');
 	r->stackpos--;
+	kjson_row(r);
 	return(1);
 }
@@ -39,21 +39,47 @@ enum	kjsontype {
 	KJSON_STRING
 };
 
+/*
+ * How top-level values are written: comma-separated (the default),
+ * newline-delimited (NDJSON), or as RFC 7464 JSON text sequences.
+ */
+enum	kjsonstream {
+	KJSON_STREAM_NONE = 0,
+	KJSON_STREAM_NDJSON,
+	KJSON_STREAM_SEQ
+};
+
 struct	kjsonscope {
 	size_t		  elements;
 	enum kjsontype	  type;
 };
 
+/*
+ * A key serialised (quoted, escaped, and with its trailing colon) once
+ * for use in many objects.
+ */
+struct	kjsonkey {
+	char		 *buf;
+	size_t		  bufsz;
+};
+
 struct	kjsonreq {
 	struct kreq	 *req;
 	size_t		  stackpos;
 	struct kjsonscope stack[128];
+	enum kjsonstream  stream;
+	size_t		  rows; /* rows written */
+	size_t		  flushrows; /* flush every so many rows or 0 */
+	int		(*wouldblock)(void *);
+	void		 *arg; /* passed to wouldblock */
 };
 
 __BEGIN_DECLS
 
 void	kjson_open(struct kjsonreq *, struct kreq *);
 int	kjson_close(struct kjsonreq *);
+int	kjson_stream(struct kjsonreq *, enum kjsonstream,
+		size_t, int (*)(void *), void *);
 
 int	kjson_putdoublep(struct kjsonreq *, const char *, double);
 int	kjson_putintp(struct kjsonreq *, const char *, int64_t);
@@ -62,6 +88,21 @@ int	kjson_putstringp(struct kjsonreq *, const char *, const char *);
 int	kjson_putboolp(struct kjsonreq *, const char *, int);
 int	kjson_putnullp(struct kjsonreq *, const char *);
 
+int	kjson_key_init(struct kjsonkey *, const char *);
+void	kjson_key_free(struct kjsonkey *);
+
+int	kjson_putdoublek(struct kjsonreq *, 
+		const struct kjsonkey *, double);
+int	kjson_putintk(struct kjsonreq *, 
+		const struct kjsonkey *, int64_t);
+int	kjson_putintstrk(struct kjsonreq *, 
+		const struct kjsonkey *, int64_t);
+int	kjson_putstringk(struct kjsonreq *, 
+		const struct kjsonkey *, const char *);
+int	kjson_putboolk(struct kjsonreq *, 
+		const struct kjsonkey *, int);
+int	kjson_putnullk(struct kjsonreq *, const struct kjsonkey *);
+
 int	kjson_putdouble(struct kjsonreq *, double);
 int	kjson_putint(struct kjsonreq *, int64_t);
 int	kjson_putintstr(struct kjsonreq *, int64_t);
@@ -70,14 +111,17 @@ int	kjson_putbool(struct kjsonreq *, int);
 int	kjson_putnull(struct kjsonreq *);
 
 int	kjson_objp_open(struct kjsonreq *, const char *);
+int	kjson_objk_open(struct kjsonreq *, const struct kjsonkey *);
 int	kjson_obj_open(struct kjsonreq *);
 int	kjson_obj_close(struct kjsonreq *);
 
 int	kjson_arrayp_open(struct kjsonreq *, const char *);
+int	kjson_arrayk_open(struct kjsonreq *, const struct kjsonkey *);
 int	kjson_array_open(struct kjsonreq *);
 int	kjson_array_close(struct kjsonreq *);
 
 int	kjson_stringp_open(struct kjsonreq *, const char *);
+int	kjson_stringk_open(struct kjsonreq *, const struct kjsonkey *);
 int	kjson_string_open(struct kjsonreq *);
 int	kjson_string_close(struct kjsonreq *);
 int	kjson_string_write(const char *, size_t, void *);
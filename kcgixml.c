@@ -27,6 +27,123 @@
 #include "kcgi.h"
 #include "kcgixml.h"
 
+/*
+ * Write "<name", followed by ">" if "close" is set.
+ * The tag is built on the stack and written at once if it fits.
+ */
+static void
+kxml_tagopen(struct kxmlreq *r, size_t elem, int close)
+{
+	char	 buf[64];
+	size_t	 sz;
+
+	sz = strlen(r->elems[elem]);
+	if (sz + 2 > sizeof(buf)) {
+		khttp_putc(r->req, '<');
+		khttp_write(r->req, r->elems[elem], sz);
+		if (close)
+			khttp_putc(r->req, '>');
+		return;
+	}
+	buf[0] = '<';
+	memcpy(buf + 1, r->elems[elem], sz);
+	buf[sz + 1] = '>';
+	khttp_write(r->req, buf, sz + 1 + (0 != close));
+}
+
+/*
+ * Write "</name>", likewise.
+ */
+static void
+kxml_tagclose(struct kxmlreq *r, size_t elem)
+{
+	char	 buf[64];
+	size_t	 sz;
+
+	sz = strlen(r->elems[elem]);
+	if (sz + 3 > sizeof(buf)) {
+		khttp_write(r->req, "</", 2);
+		khttp_write(r->req, r->elems[elem], sz);
+		khttp_putc(r->req, '>');
+		return;
+	}
+	buf[0] = '<';
+	buf[1] = '/';
+	memcpy(buf + 2, r->elems[elem], sz);
+	buf[sz + 2] = '>';
+	khttp_write(r->req, buf, sz + 3);
+}
+
+/*
+ * Push "elem" onto the stack of open elements.
+ * The first KXML_STACKSZ are kept in the context itself; only deeper
+ * documents spill onto the heap, which is freed by kxml_close().
+ */
+static int
+kxml_stackpush(struct kxmlreq *r, size_t elem)
+{
+	size_t	*pp, max;
+
+	if (r->stackpos < KXML_STACKSZ) {
+		r->stack[r->stackpos++] = elem;
+		return(1);
+	}
+	if (r->stackpos - KXML_STACKSZ >= r->deepmax) {
+		max = 0 == r->deepmax ? KXML_STACKSZ : r->deepmax * 2;
+		pp = kreallocarray(r->deep, max, sizeof(size_t));
+		if (NULL == pp)
+			return(0);
+		r->deep = pp;
+		r->deepmax = max;
+	}
+	r->deep[r->stackpos++ - KXML_STACKSZ] = elem;
+	return(1);
+}
+
+/*
+ * Pop the innermost open element, which must exist.
+ */
+static size_t
+kxml_stackpop(struct kxmlreq *r)
+{
+
+	assert(r->stackpos > 0);
+	if (--r->stackpos < KXML_STACKSZ)
+		return(r->stack[r->stackpos]);
+	return(r->deep[r->stackpos - KXML_STACKSZ]);
+}
+
+/*
+ * Write the attributes in "ap", which are key-value pairs terminated
+ * by a NULL key.
+ * Each prefix " key=\"" is written at once if it fits our buffer.
+ */
+static void
+kxml_attrs(struct kxmlreq *r, va_list ap)
+{
+	const char	*key, *val;
+	char		 buf[64];
+	size_t		 sz;
+
+	while (NULL != (key = va_arg(ap, char *))) {
+		val = va_arg(ap, char *);
+		sz = strlen(key);
+		if (sz + 3 <= sizeof(buf)) {
+			buf[0] = ' ';
+			memcpy(buf + 1, key, sz);
+			buf[sz + 1] = '=';
+			buf[sz + 2] = '"';
+			khttp_write(r->req, buf, sz + 3);
+		} else {
+			khttp_putc(r->req, ' ');
+			khttp_write(r->req, key, sz);
+			khttp_write(r->req, "=\"", 2);
+		}
+		kxml_write(val, strlen(val), r);
+		khttp_putc(r->req, '"');
+	}
+}
+
 void
 kxml_open(struct kxmlreq *r, struct kreq *req,
 	const char *const *elems, size_t elemsz)
@@ -48,6 +165,9 @@ kxml_close(struct kxmlreq *r)
 
 	i = r->stackpos > 0;
 	kxml_popall(r);
+	free(r->deep);
+	r->deep = NULL;
+	r->deepmax = 0;
 	return(i);
 }
 
@@ -55,13 +175,10 @@ int
 kxml_push(struct kxmlreq *r, size_t elem)
 {
 
-	if (r->stackpos >= 128) 
+	if ( ! kxml_stackpush(r, elem))
 		return(0);
 
-	khttp_putc(r->req, '<');
-	khttp_puts(r->req, r->elems[elem]);
-	khttp_putc(r->req, '>');
-	r->stack[r->stackpos++] = elem;
+	kxml_tagopen(r, elem, 1);
 	return(1);
 }
 
@@ -69,42 +186,64 @@ void
 kxml_pushnull(struct kxmlreq *r, size_t elem)
 {
 
-	khttp_putc(r->req, '<');
-	khttp_puts(r->req, r->elems[elem]);
-	khttp_puts(r->req, " />");
+	kxml_tagopen(r, elem, 0);
+	khttp_write(r->req, " />", 3);
 }
 
-void
-kxml_putc(struct kxmlreq *r, char c)
+/*
+ * Return the escape sequence for "c", or NULL if it needn't be escaped.
+ */
+static const char *
+kxml_escape(char c)
 {
 
 	switch (c) {
 	case ('<'):
-		khttp_puts(r->req, "&lt;");
-		break;
+		return("&lt;");
 	case ('>'):
-		khttp_puts(r->req, "&gt;");
-		break;
+		return("&gt;");
 	case ('"'):
-		khttp_puts(r->req, "&quot;");
-		break;
+		return("&quot;");
 	case ('&'):
-		khttp_puts(r->req, "&amp;");
-		break;
+		return("&amp;");
 	default:
-		khttp_putc(r->req, c);
 		break;
 	}
+	return(NULL);
 }
 
+void
+kxml_putc(struct kxmlreq *r, char c)
+{
+	const char	*cp;
+
+	if (NULL != (cp = kxml_escape(c)))
+		khttp_puts(r->req, cp);
+	else
+		khttp_putc(r->req, c);
+}
+
+/*
+ * Write "p" escaped, as runs of unescaped characters between escape
+ * sequences.
+ */
 int
 kxml_write(const char *p, size_t sz, void *arg)
 {
 	struct kxmlreq 	*r = arg;
-	size_t	 	 i;
+	const char	*cp;
+	size_t	 	 i, start;
 
-	for (i = 0; i < sz; i++)
-		kxml_putc(r, p[i]);
+	for (start = i = 0; i < sz; i++) {
+		if (NULL == (cp = kxml_escape(p[i])))
+			continue;
+		if (i > start)
+			khttp_write(r->req, p + start, i - start);
+		khttp_puts(r->req, cp);
+		start = i + 1;
+	}
+	if (i > start)
+		khttp_write(r->req, p + start, i - start);
 
 	return(1);
 }
@@ -113,36 +252,22 @@ void
 kxml_puts(struct kxmlreq *r, const char *p)
 {
 
-	for ( ; '\0' != *p; p++)
-		kxml_putc(r, *p);
+	kxml_write(p, strlen(p), r);
 }
 
 int
 kxml_pushattrs(struct kxmlreq *r, size_t elem, ...)
 {
 	va_list	 	 ap;
-	const char	*key, *val;
 
-	if (r->stackpos >= 128) 
+	if ( ! kxml_stackpush(r, elem))
 		return(0);
 
-	khttp_putc(r->req, '<');
-	khttp_puts(r->req, r->elems[elem]);
+	kxml_tagopen(r, elem, 0);
 	va_start(ap, elem);
-	for (;;) {
-		if (NULL == (key = va_arg(ap, char *)))
-			break;
-		val = va_arg(ap, char *);
-		khttp_putc(r->req, ' ');
-		khttp_puts(r->req, key);
-		khttp_putc(r->req, '=');
-		khttp_putc(r->req, '"');
-		kxml_puts(r, val);
-		khttp_putc(r->req, '"');
-	}
+	kxml_attrs(r, ap);
 	va_end(ap);
 	khttp_putc(r->req, '>');
-	r->stack[r->stackpos++] = elem;
 	return(1);
 }
 
@@ -150,24 +275,12 @@ void
 kxml_pushnullattrs(struct kxmlreq *r, size_t elem, ...)
 {
 	va_list	 	 ap;
-	const char	*key, *val;
 
-	khttp_putc(r->req, '<');
-	khttp_puts(r->req, r->elems[elem]);
+	kxml_tagopen(r, elem, 0);
 	va_start(ap, elem);
-	for (;;) {
-		if (NULL == (key = va_arg(ap, char *)))
-			break;
-		val = va_arg(ap, char *);
-		khttp_putc(r->req, ' ');
-		khttp_puts(r->req, key);
-		khttp_putc(r->req, '=');
-		khttp_putc(r->req, '"');
-		kxml_puts(r, val);
-		khttp_putc(r->req, '"');
-	}
+	kxml_attrs(r, ap);
 	va_end(ap);
-	khttp_puts(r->req, " />");
+	khttp_write(r->req, " />", 3);
 }
 
 void
@@ -185,9 +298,6 @@ kxml_pop(struct kxmlreq *r)
 	if (0 == r->stackpos)
 		return(0);
 
-	khttp_puts(r->req, "</");
-	khttp_puts(r->req, r->elems[r->stack[--r->stackpos]]);
-	khttp_putc(r->req, '>');
+	kxml_tagclose(r, kxml_stackpop(r));
 	return(1);
-
 }
@@ -32,12 +32,16 @@
 #  endif
 #endif
 
+#define	KXML_STACKSZ	   128
+
 struct	kxmlreq {
 	struct kreq	  *req;
 	const char *const *elems;
 	size_t		   elemsz;
-	size_t	 	   stack[128];
-	size_t		   stackpos;
+	size_t	 	   stack[KXML_STACKSZ]; /* open elements */
+	size_t		   stackpos; /* number of open elements */
+	size_t		  *deep; /* open elements past "stack" */
+	size_t		   deepmax; /* allocated size of "deep" */
 };
 
 __BEGIN_DECLS
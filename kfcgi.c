@@ -16,20 +16,32 @@
  */
 #include "config.h"
 
+#if defined(__linux__)
+# include <sys/epoll.h>
+# include <sys/signalfd.h>
+# include <sys/syscall.h>
+# include <sched.h>
+#endif
+#include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
 #include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <netdb.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -38,6 +50,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "stats.h"
+
 /*
  * This is used by the "variable pool" implementation to keep track of
  * children, their input descriptor, and their active work.
@@ -47,26 +61,98 @@ struct	worker {
 	int	 ctrl; /* control socket */
 	pid_t	 pid; /* process */
 	time_t	 last; /* last deschedule or 0 if never */
+	double	 start; /* when last scheduled (monotonic) */
+	int	 old; /* from before a restart: retire when done */
+	int	 unit; /* placement unit (see "-a") or -1 */
 	uint64_t cookie;
 };
 
+#if defined(__linux__)
+/*
+ * A unit of worker placement: either a single CPU or all of the CPUs
+ * of a NUMA node.
+ * Workers are assigned to units round-robin by their slot.
+ */
+struct	unit {
+	cpu_set_t set; /* CPUs of the unit */
+	int	 id; /* CPU or node number */
+};
+
+static	struct unit *units = NULL;
+static	size_t unitsz = 0;
+static	int unitnode = 0; /* units are NUMA nodes */
+#endif
+
+/*
+ * Load estimate used by the "variable pool" to start workers ahead of
+ * demand.
+ * These are exponentially-weighted moving averages of the time between
+ * connections and of the time a worker takes to serve one.
+ * By Little's law, their ratio is the number of busy workers expected.
+ */
+struct	load {
+	double	 last; /* last arrival (monotonic) or 0 */
+	double	 arrival; /* mean time between arrivals or 0 */
+	double	 service; /* mean service time or 0 */
+};
+
+#define	LOAD_ALPHA 0.2
+
+/*
+ * Tunables for TCP listeners (see "-o").
+ * These are set on the listening socket and inherited by accepted
+ * connections.
+ * Zero means that the system default is used.
+ */
+struct	tcpopts {
+	int	 nodelay; /* disable Nagle's algorithm */
+	int	 defer; /* seconds to wait for data before accept */
+	int	 sndbuf; /* SO_SNDBUF */
+	int	 rcvbuf; /* SO_RCVBUF */
+};
+
 /*
- * Whether we're supposed to stop or whether we've had a child exit.
+ * Whether we're supposed to stop or restart, whether we've had a child
+ * exit, and whether old workers have run out of time to drain.
  */
 static	volatile sig_atomic_t stop = 0;
 static	volatile sig_atomic_t chld = 0;
 static	volatile sig_atomic_t hup = 0;
+static	volatile sig_atomic_t alrm = 0;
 
 static	int verbose = 0;
 
+/*
+ * Shared statistics (see "-M") or NULL and their file descriptor,
+ * which is inherited by workers.
+ * Workers may write anywhere in the map, so we only ever write to it:
+ * the number of slots, the worker in each, and our counters are kept
+ * in our own memory.
+ */
+static	volatile struct kstats_hdr *stats = NULL;
+static	int statsfd = -1;
+static	size_t statsslots = 0;
+static	pid_t *statspids = NULL; /* worker in each slot or 0 */
+static	uint64_t statsaccepted = 0;
+
 static 	void dbg(const char *fmt, ...) 
 		__attribute__((format(printf, 1, 2)));
+static	void sigwake(void);
 
 static void
 sighandlehup(int sig)
 {
 
 	hup = 1;
+	sigwake();
+}
+
+static void
+sighandlealrm(int sig)
+{
+
+	alrm = 1;
+	sigwake();
 }
 
 static void
@@ -74,6 +160,7 @@ sighandlestop(int sig)
 {
 
 	stop = 1;
+	sigwake();
 }
 
 static void
@@ -81,6 +168,7 @@ sighandlechld(int sig)
 {
 
 	chld = 1;
+	sigwake();
 }
 
 static void
@@ -244,191 +332,1239 @@ xsocketpair(int *sock)
 }
 
 /*
- * Start a worker for the variable pool.
+ * Event loop used by the variable pool.
+ * It watches the listening socket, the control sockets of working
+ * workers, and our signals, each source being identified by a number
+ * less than "maxid".
+ * On Linux, this uses epoll(7) and signalfd(2), so a wait costs the
+ * same regardless of the number of workers and signals need not be
+ * unblocked.
+ * Elsewhere, it uses poll(2) over a compact array, with signals
+ * delivered over a self-pipe so that waits needn't time out in order
+ * to see them.
+ */
+struct	evt {
+	size_t		  id; /* source identifier */
+	int		  in; /* readable */
+	int		  err; /* hangup or error */
+};
+
+struct	evloop {
+	size_t		  maxid; /* also the signal identifier */
+	struct evt	 *out; /* events from last wait */
+#if defined(__linux__)
+	int		  epfd; /* epoll descriptor */
+	int		  sigfd; /* signalfd descriptor */
+	struct epoll_event *evs; /* events from epoll_wait */
+#else
+	sigset_t	  set; /* signals unblocked whilst waiting */
+	int		  sigpipe[2]; /* signal self-pipe */
+	struct pollfd	 *pfd; /* descriptors, [0] is sigpipe */
+	size_t		 *pfdid; /* identifier of each in pfd */
+	size_t		 *pos; /* position of each identifier in pfd */
+	size_t		  pfdsz; /* number of pfd */
+#endif
+};
+
+#if ! defined(__linux__)
+/*
+ * Write side of the signal self-pipe or -1.
+ */
+static	int sigpipe = -1;
+#endif
+
+/*
+ * Wake up the event loop after a signal.
+ */
+static void
+sigwake(void)
+{
+#if ! defined(__linux__)
+	int	 er;
+
+	if (-1 == sigpipe)
+		return;
+	er = errno;
+	(void)write(sigpipe, "", 1);
+	errno = er;
+#endif
+}
+
+static void
+ev_free(struct evloop *ev)
+{
+
+#if defined(__linux__)
+	if (-1 != ev->epfd)
+		close(ev->epfd);
+	if (-1 != ev->sigfd)
+		close(ev->sigfd);
+	free(ev->evs);
+#else
+	sigpipe = -1;
+	if (-1 != ev->sigpipe[0])
+		close(ev->sigpipe[0]);
+	if (-1 != ev->sigpipe[1])
+		close(ev->sigpipe[1]);
+	free(ev->pfd);
+	free(ev->pfdid);
+	free(ev->pos);
+#endif
+	free(ev->out);
+}
+
+/*
+ * Prepare an event loop for identifiers less than "maxid".
+ * The signals in "set" must be blocked.
+ * Returns 0 on failure (the loop must still be freed), 1 on success.
  */
 static int
-varpool_start(struct worker *w, const struct worker *ws, 
-	size_t wsz, int fd, char **nargv)
+ev_alloc(struct evloop *ev, size_t maxid, const sigset_t *set)
 {
-	int	 pair[2];
-	char	 buf[64];
-	size_t	 i;
+#if defined(__linux__)
+	struct epoll_event e;
+#else
+	int		 i, fl;
+#endif
 
-	w->ctrl = w->fd = -1;
-	w->pid = -1;
+	memset(ev, 0, sizeof(struct evloop));
+	ev->maxid = maxid;
+#if defined(__linux__)
+	ev->epfd = ev->sigfd = -1;
+	ev->evs = calloc(maxid + 1, sizeof(struct epoll_event));
+#else
+	ev->sigpipe[0] = ev->sigpipe[1] = -1;
+	ev->set = *set;
+	ev->pfd = calloc(maxid + 1, sizeof(struct pollfd));
+	ev->pfdid = calloc(maxid + 1, sizeof(size_t));
+	ev->pos = calloc(maxid, sizeof(size_t));
+#endif
+	ev->out = calloc(maxid, sizeof(struct evt));
 
-	if ( ! xsocketpair(pair))
+#if defined(__linux__)
+	if (NULL == ev->evs || NULL == ev->out) {
+		syslog(LOG_ERR, "calloc: event loop: %m");
 		return(0);
-	w->ctrl = pair[0];
-
-	if (-1 == (w->pid = fork())) {
-		syslog(LOG_ERR, "fork: worker: %m");
-		close(pair[0]);
-		close(pair[1]);
-		w->ctrl = -1;
+	}
+	ev->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (-1 == ev->epfd) {
+		syslog(LOG_ERR, "epoll_create1: %m");
 		return(0);
-	} else if (0 == w->pid) {
-		/* 
-		 * Close out all current descriptors.
-		 * Note that we're a "new-mode" FastCGI manager to the
-		 * child via our environment variable.
-		 */
-		for (i = 0; i < wsz; i++)
-			if (-1 != ws[i].ctrl && 
-			    -1 == close(ws[i].ctrl))
-				syslog(LOG_ERR, "close: "
-					"worker cleanup: %m");
+	}
+	ev->sigfd = signalfd(-1, set, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (-1 == ev->sigfd) {
+		syslog(LOG_ERR, "signalfd: %m");
+		return(0);
+	}
+	memset(&e, 0, sizeof(struct epoll_event));
+	e.events = EPOLLIN;
+	e.data.u64 = maxid;
+	if (-1 == epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->sigfd, &e)) {
+		syslog(LOG_ERR, "epoll_ctl: signals: %m");
+		return(0);
+	}
+#else
+	if (NULL == ev->pfd || NULL == ev->pfdid ||
+	    NULL == ev->pos || NULL == ev->out) {
+		syslog(LOG_ERR, "calloc: event loop: %m");
+		return(0);
+	}
+	if (-1 == pipe(ev->sigpipe)) {
+		syslog(LOG_ERR, "pipe: signals: %m");
+		return(0);
+	}
+	for (i = 0; i < 2; i++) {
+		if (-1 == (fl = fcntl(ev->sigpipe[i], F_GETFL, 0)) ||
+		    -1 == fcntl(ev->sigpipe[i], F_SETFL, fl | O_NONBLOCK) ||
+		    -1 == fcntl(ev->sigpipe[i], F_SETFD, FD_CLOEXEC)) {
+			syslog(LOG_ERR, "fcntl: signals: %m");
+			return(0);
+		}
+	}
+	ev->pfd[0].fd = ev->sigpipe[0];
+	ev->pfd[0].events = POLLIN;
+	ev->pfdid[0] = maxid;
+	ev->pfdsz = 1;
+	sigpipe = ev->sigpipe[1];
+#endif
+	return(1);
+}
 
-		close(fd);
-		snprintf(buf, sizeof(buf), "%d", pair[1]);
-		setenv("FCGI_LISTENSOCK_DESCRIPTORS", buf, 1);
-		execv(nargv[0], nargv);
-		syslog(LOG_ERR, "execv: %s: %m", nargv[0]);
-		_exit(EXIT_FAILURE);
+/*
+ * Start watching "fd" for reading as "id".
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+ev_add(struct evloop *ev, int fd, size_t id)
+{
+#if defined(__linux__)
+	struct epoll_event e;
+
+	assert(id < ev->maxid);
+	memset(&e, 0, sizeof(struct epoll_event));
+	e.events = EPOLLIN;
+	e.data.u64 = id;
+	if (-1 == epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &e)) {
+		syslog(LOG_ERR, "epoll_ctl: add: %m");
+		return(0);
 	}
+#else
+	assert(id < ev->maxid);
+	assert(ev->pfdsz <= ev->maxid);
+	ev->pos[id] = ev->pfdsz;
+	ev->pfd[ev->pfdsz].fd = fd;
+	ev->pfd[ev->pfdsz].events = POLLIN;
+	ev->pfd[ev->pfdsz].revents = 0;
+	ev->pfdid[ev->pfdsz] = id;
+	ev->pfdsz++;
+#endif
+	return(1);
+}
 
-	/* Close the child descriptor. */
-	if (-1 == close(pair[1])) {
-		syslog(LOG_ERR, "close: worker-%u pipe: %m", w->pid);
+/*
+ * Stop watching "fd", previously added as "id".
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+ev_del(struct evloop *ev, int fd, size_t id)
+{
+#if defined(__linux__)
+	struct epoll_event e;
+
+	memset(&e, 0, sizeof(struct epoll_event));
+	if (-1 == epoll_ctl(ev->epfd, EPOLL_CTL_DEL, fd, &e)) {
+		syslog(LOG_ERR, "epoll_ctl: delete: %m");
 		return(0);
 	}
+#else
+	size_t	 i;
 
-	dbg("worker-%u: started", w->pid);
+	/* Flip the last entry into our slot. */
+	i = ev->pos[id];
+	assert(i > 0 && i < ev->pfdsz);
+	assert(ev->pfd[i].fd == fd);
+	if (i != ev->pfdsz - 1) {
+		ev->pfd[i] = ev->pfd[ev->pfdsz - 1];
+		ev->pfdid[i] = ev->pfdid[ev->pfdsz - 1];
+		ev->pos[ev->pfdid[i]] = i;
+	}
+	ev->pfdsz--;
+#endif
 	return(1);
 }
 
 /*
- * A variable-sized pool of web application clients.
- * A minimum of "wsz" applications are always running, and will grow to
- * "maxwsz" at which point no new connections are accepted.
- * This is an EXPERIMENTAL extension.
+ * Wait for events for at most "timeout" milliseconds (or forever, if
+ * negative).
+ * Signals set the global flags and aren't reported as events.
+ * Returns the number of events in "out", which may be zero, or -1 on
+ * failure.
  */
 static int
-varpool(size_t wsz, size_t maxwsz, time_t waittime,
-	int fd, const char *sockpath, char *argv[])
+ev_wait(struct evloop *ev, int timeout)
 {
-	struct worker	*ws;
-	struct worker	*slough;
-	size_t		 pfdsz, opfdsz, pfdmaxsz, i, j, minwsz,
-			 sloughsz, sloughmaxsz;
-	int		 rc, exitcode, afd, accepting;
-	struct pollfd	*pfd, *opfd;
-	struct sockaddr_storage ss;
-	socklen_t	 sslen;
-	void		*pp;
-	time_t		 t;
-	sigset_t	 set;
-	uint64_t	 cookie;
+	size_t		 i, outsz;
+	int		 rc;
+#if defined(__linux__)
+	struct signalfd_siginfo si;
+	ssize_t		 ssz;
+	size_t		 id;
+
+	rc = epoll_wait(ev->epfd, ev->evs, ev->maxid + 1, timeout);
+	if (rc < 0) {
+		if (EINTR == errno)
+			return(0);
+		syslog(LOG_ERR, "epoll_wait: %m");
+		return(-1);
+	}
 
-	dbg("YOU ARE RUNNING VARIABLE MODE AT YOUR OWN RISK.");
+	for (outsz = 0, i = 0; i < (size_t)rc; i++) {
+		id = ev->evs[i].data.u64;
+		if (id != ev->maxid) {
+			ev->out[outsz].id = id;
+			ev->out[outsz].in = 
+				EPOLLIN & ev->evs[i].events;
+			ev->out[outsz].err = 
+				(EPOLLHUP | EPOLLERR) & ev->evs[i].events;
+			outsz++;
+			continue;
+		}
+		while ((ssz = read(ev->sigfd, &si, sizeof(si))) > 0) {
+			if (SIGCHLD == si.ssi_signo)
+				chld = 1;
+			else if (SIGTERM == si.ssi_signo)
+				stop = 1;
+			else if (SIGHUP == si.ssi_signo)
+				hup = 1;
+		}
+		if (ssz < 0 && EAGAIN != errno) {
+			syslog(LOG_ERR, "read: signals: %m");
+			return(-1);
+		}
+	}
+#else
+	char		 buf[64];
+	int		 er;
 
-	signal(SIGCHLD, sighandlechld);
-	signal(SIGTERM, sighandlestop);
-	signal(SIGHUP, sighandlehup);
-	sigemptyset(&set);
-	sigaddset(&set, SIGCHLD);
-	sigaddset(&set, SIGTERM);
-	sigaddset(&set, SIGHUP);
-	sigprocmask(SIG_BLOCK, &set, NULL);
+	sigprocmask(SIG_UNBLOCK, &ev->set, NULL);
+	rc = poll(ev->pfd, ev->pfdsz, timeout);
+	er = errno;
+	sigprocmask(SIG_BLOCK, &ev->set, NULL);
 
-again:
-	stop = chld = hup = 0;
+	if (rc < 0) {
+		if (EINTR == er)
+			return(0);
+		errno = er;
+		syslog(LOG_ERR, "poll: main event: %m");
+		return(-1);
+	}
 
-	/* 
-	 * Allocate worker array, polling descriptor array, and slough
-	 * array (exiting workers).
-	 * Set our initial exit code and our acceptance status.
-	 */
-	minwsz = wsz;
-	ws = calloc(wsz, sizeof(struct worker));
-	sloughmaxsz = (maxwsz - minwsz) * 2;
-	slough = calloc(sloughmaxsz, sizeof(struct worker));
-	pfdmaxsz = wsz + 1;
-	pfd = calloc(pfdmaxsz, sizeof(struct pollfd));
-	exitcode = 0;
+	if (POLLIN & ev->pfd[0].revents)
+		while (read(ev->sigpipe[0], buf, sizeof(buf)) > 0)
+			continue;
 
-	if (NULL == ws || NULL == pfd || NULL == slough) {
-		/* Serious problems. */
-		syslog(LOG_ERR, "calloc: initialisation: %m");
-		close(fd);
-		unlink(sockpath);
-		free(ws);
-		free(slough);
-		free(pfd);
+	for (outsz = 0, i = 1; i < ev->pfdsz; i++) {
+		if (0 == ev->pfd[i].revents)
+			continue;
+		ev->out[outsz].id = ev->pfdid[i];
+		ev->out[outsz].in = POLLIN & ev->pfd[i].revents;
+		ev->out[outsz].err = 
+			(POLLHUP | POLLERR) & ev->pfd[i].revents;
+		outsz++;
+	}
+#endif
+	return((int)outsz);
+}
+
+#if defined(__linux__)
+/*
+ * Parse a sysfs CPU list such as "0-3,8,10-11" into "set".
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+place_cpulist(const char *buf, cpu_set_t *set)
+{
+	char	*ep;
+	long	 lo, hi;
+
+	CPU_ZERO(set);
+	while ('\0' != *buf && '\n' != *buf) {
+		lo = hi = strtol(buf, &ep, 10);
+		if (ep == buf)
+			return(0);
+		if ('-' == *ep) {
+			buf = ep + 1;
+			hi = strtol(buf, &ep, 10);
+			if (ep == buf)
+				return(0);
+		}
+		if (lo < 0 || hi >= CPU_SETSIZE)
+			return(0);
+		for ( ; lo <= hi; lo++)
+			CPU_SET(lo, set);
+		buf = ',' == *ep ? ep + 1 : ep;
+	}
+	return(1);
+}
+#endif
+
+/*
+ * Create the statistics file "path" with "slots" worker slots and map
+ * it into "stats".
+ * Returns 0 on failure (reported on stderr), 1 on success.
+ */
+static int
+stats_open(const char *path, size_t slots)
+{
+	size_t	 sz;
+	void	*p;
+
+	sz = sizeof(struct kstats_hdr) + 
+		slots * sizeof(struct kstats_slot);
+
+	if (NULL == (statspids = calloc(slots, sizeof(pid_t)))) {
+		perror(NULL);
 		return(0);
 	}
 
-	/* Zeroth pfd is always the domain socket. */
-	pfd[0].fd = fd;
-	pfd[0].events = POLLIN;
+	statsfd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (-1 == statsfd) {
+		perror(path);
+		return(0);
+	} else if (-1 == ftruncate(statsfd, sz)) {
+		perror(path);
+		close(statsfd);
+		return(0);
+	}
 
-	/* Guard against bad de-allocation. */
-	for (i = 0; i < wsz; i++) {
-		ws[i].ctrl = ws[i].fd = -1;
-		ws[i].pid = -1;
+	p = mmap(NULL, sz, PROT_READ | PROT_WRITE, 
+		MAP_SHARED, statsfd, 0);
+	if (MAP_FAILED == p) {
+		perror(path);
+		close(statsfd);
+		return(0);
 	}
 
-	sloughsz = 0;
-	accepting = 1;
-	pfdsz = 1;
+	/* The file is zeroed by ftruncate(2). */
+	stats = p;
+	statsslots = slots;
+	stats->slots = slots;
+	stats->start = time(NULL);
+	stats->magic = KSTATS_MAGIC;
+	return(1);
+}
 
-	/*
-	 * Start up the [initial] worker processes.
-	 * We'll later spin up workers when we need them.
-	 * If these die immediately, we'll find out below when we
-	 * unblock our signals.
-	 */
-	for (i = 0; i < wsz; i++)
-		if ( ! varpool_start(&ws[i], ws, wsz, fd, argv))
-			goto out;
-pollagain:
-	/*
-	 * Main part.
-	 * Poll on our control socket (pfd[0]) and the children that
-	 * have active connections.
-	 * If we're not accepting new connections, avoid polling on the
-	 * first entry by offsetting.
-	 * We have a timeout if we get a termination signal whilst
-	 * waiting.
-	 */
-	opfd = accepting ? pfd : pfd + 1;
-	opfdsz = accepting ? pfdsz : pfdsz - 1;
+/*
+ * Statistics slot "slot" or NULL if we're not keeping statistics.
+ */
+static volatile struct kstats_slot *
+stats_slot(size_t slot)
+{
 
-	sigprocmask(SIG_UNBLOCK, &set, NULL);
-	rc = poll(opfd, opfdsz, 1000);
-	sigprocmask(SIG_BLOCK, &set, NULL);
+	if (NULL == stats)
+		return(NULL);
+	assert(slot < statsslots);
+	return((volatile struct kstats_slot *)(stats + 1) + slot);
+}
 
-	/* Did an error occur? */
-	if (rc < 0 && EINTR != errno) {
-		syslog(LOG_ERR, "poll: main event: %m");
-		goto out;
-	} 
+/*
+ * Called in a freshly-forked worker to tell it (in its environment) of
+ * its statistics slot "slot", if any.
+ */
+static void
+stats_child(size_t slot)
+{
+	char	 buf[32];
 
-	if (stop) {
-		/* 
-		 * If we're being requested to stop, go to exit now. 
-		 * We'll immediately kill off our children and wait.
-		 */
-		dbg("servicing exit request");
-		exitcode = 1;
-		goto out;
-	} else if (chld) {
-		/*
-		 * A child has exited.
-		 * This can mean one of two things: either a worker has
-		 * exited abnormally or one of the "sloughed" workers
-		 * has finished its exit.
-		 */
-		if (0 == sloughsz) {
-			syslog(LOG_ERR, "worker unexpectedly exited");
-			goto out;
-		}
+	if (NULL == stats)
+		return;
+	snprintf(buf, sizeof(buf), "%d", statsfd);
+	setenv("KFCGI_STATS_FD", buf, 1);
+	snprintf(buf, sizeof(buf), "%zu", slot);
+	setenv("KFCGI_STATS_SLOT", buf, 1);
+}
 
-		/* Look at the running children. */
-		for (i = 0; i < wsz; i++) {
-			assert(-1 != ws[i].pid);
-			rc = waitpid(ws[i].pid, NULL, WNOHANG);
-			if (rc < 0) {
+/*
+ * Reset statistics slot "slot" for a new worker "pid" or, if zero, to
+ * being empty.
+ */
+static void
+stats_reset(size_t slot, pid_t pid)
+{
+	volatile struct kstats_slot *s;
+
+	if (NULL == (s = stats_slot(slot)))
+		return;
+	statspids[slot] = pid;
+	s->pid = 0;
+	s->state = KSTATS_IDLE;
+	s->requests = s->bytesin = s->bytesout = 0;
+	s->parsens = s->handlens = s->mark = s->last = 0;
+	s->pid = pid;
+}
+
+/*
+ * Find an empty statistics slot for a new worker.
+ * Slots are only emptied once their workers have been reaped, as
+ * exiting workers may still be writing to them, so there must be a
+ * slot for every worker that may not yet have been reaped.
+ * Returns the slot or zero if we're not keeping statistics.
+ */
+static size_t
+stats_alloc(void)
+{
+	size_t	 i;
+
+	if (NULL == stats)
+		return(0);
+	for (i = 0; i < statsslots; i++)
+		if (0 == statspids[i])
+			break;
+	assert(i < statsslots);
+	return(i);
+}
+
+/*
+ * Empty the statistics slot of the reaped worker "pid", if any.
+ */
+static void
+stats_release(pid_t pid)
+{
+	size_t	 i;
+
+	if (NULL == stats)
+		return;
+	for (i = 0; i < statsslots; i++)
+		if (pid == statspids[i]) {
+			stats_reset(i, 0);
+			break;
+		}
+}
+
+/*
+ * Print the statistics file "path" to stdout, either as text ("fmt" is
+ * "text") or in the Prometheus text exposition format ("prometheus").
+ * Returns 0 on failure (reported on stderr), 1 on success.
+ */
+static int
+stats_dump(const char *path, const char *fmt)
+{
+	static const struct {
+		const char	*name;
+		const char	*help;
+		size_t		 off;
+		double		 div;
+	} ms[] = {
+		{ "requests_total", "Requests served.",
+		  offsetof(struct kstats_slot, requests), 1.0 },
+		{ "received_bytes_total", "Bytes read.",
+		  offsetof(struct kstats_slot, bytesin), 1.0 },
+		{ "sent_bytes_total", "Bytes written.",
+		  offsetof(struct kstats_slot, bytesout), 1.0 },
+		{ "parse_seconds_total", "Time parsing requests.",
+		  offsetof(struct kstats_slot, parsens), 1e9 },
+		{ "handler_seconds_total", "Time in handlers.",
+		  offsetof(struct kstats_slot, handlens), 1e9 },
+		{ "last_request_timestamp_seconds", 
+		  "When the last request finished.",
+		  offsetof(struct kstats_slot, last), 1.0 },
+	};
+	static const char *const states[] = {
+		"idle", "parse", "handle" };
+	const volatile struct kstats_hdr *hdr;
+	const volatile struct kstats_slot *s;
+	struct stat	 st;
+	size_t		 i, j;
+	int		 fd, prom;
+	void		*p;
+	time_t		 t;
+	uint64_t	 v;
+
+	if (0 == strcmp(fmt, "prometheus"))
+		prom = 1;
+	else if (0 == strcmp(fmt, "text"))
+		prom = 0;
+	else {
+		fprintf(stderr, "-x must be "
+			"\"text\" or \"prometheus\"\n");
+		return(0);
+	}
+
+	if (-1 == (fd = open(path, O_RDONLY))) {
+		perror(path);
+		return(0);
+	} else if (-1 == fstat(fd, &st)) {
+		perror(path);
+		close(fd);
+		return(0);
+	} else if ((size_t)st.st_size < sizeof(struct kstats_hdr)) {
+		fprintf(stderr, "%s: not a statistics file\n", path);
+		close(fd);
+		return(0);
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == p) {
+		perror(path);
+		return(0);
+	}
+
+	hdr = p;
+	if (KSTATS_MAGIC != hdr->magic || 
+	    sizeof(struct kstats_hdr) + hdr->slots * 
+	    sizeof(struct kstats_slot) > (size_t)st.st_size) {
+		fprintf(stderr, "%s: not a statistics file\n", path);
+		munmap(p, st.st_size);
+		return(0);
+	}
+	s = (const volatile struct kstats_slot *)(hdr + 1);
+
+	if (prom) {
+		printf("# HELP kfcgi_workers Running workers.\n"
+		       "# TYPE kfcgi_workers gauge\n"
+		       "kfcgi_workers %" PRIu64 "\n"
+		       "# HELP kfcgi_busy Workers with a connection.\n"
+		       "# TYPE kfcgi_busy gauge\n"
+		       "kfcgi_busy %" PRIu64 "\n"
+		       "# HELP kfcgi_queued Connections waiting.\n"
+		       "# TYPE kfcgi_queued gauge\n"
+		       "kfcgi_queued %" PRIu64 "\n"
+		       "# HELP kfcgi_accepted_total "
+		        "Connections accepted.\n"
+		       "# TYPE kfcgi_accepted_total counter\n"
+		       "kfcgi_accepted_total %" PRIu64 "\n",
+		       hdr->workers, hdr->busy, 
+		       hdr->queued, hdr->accepted);
+		printf("# HELP kfcgi_worker_busy "
+		        "Whether the worker has a request.\n"
+		       "# TYPE kfcgi_worker_busy gauge\n");
+		for (i = 0; i < hdr->slots; i++)
+			if (0 != s[i].pid)
+				printf("kfcgi_worker_busy{slot=\"%zu\","
+				       "pid=\"%" PRIu64 "\"} %d\n", 
+				       i, s[i].pid, 
+				       KSTATS_IDLE != s[i].state);
+		for (j = 0; j < sizeof(ms) / sizeof(ms[0]); j++) {
+			printf("# HELP kfcgi_worker_%s %s\n"
+			       "# TYPE kfcgi_worker_%s %s\n",
+			       ms[j].name, ms[j].help, ms[j].name,
+			       NULL != strstr(ms[j].name, "_total") ?
+			       "counter" : "gauge");
+			for (i = 0; i < hdr->slots; i++) {
+				if (0 == s[i].pid)
+					continue;
+				v = *(const volatile uint64_t *)
+					((const volatile char *)
+					 &s[i] + ms[j].off);
+				printf("kfcgi_worker_%s{slot=\"%zu\","
+				       "pid=\"%" PRIu64 "\"} %.15g\n", 
+				       ms[j].name, i, s[i].pid, 
+				       v / ms[j].div);
+			}
+		}
+	} else {
+		printf("workers %" PRIu64 ", busy %" PRIu64 
+		       ", queued %" PRIu64 ", accepted %" PRIu64 "\n",
+		       hdr->workers, hdr->busy, 
+		       hdr->queued, hdr->accepted);
+		printf("%4s %8s %-6s %10s %12s %12s %10s %10s %6s\n",
+		       "slot", "pid", "state", "requests", "bytes-in",
+		       "bytes-out", "parse-ms", "handle-ms", "idle-s");
+		t = time(NULL);
+		for (i = 0; i < hdr->slots; i++) {
+			if (0 == s[i].pid)
+				continue;
+			printf("%4zu %8" PRIu64 " %-6s %10" PRIu64 
+			       " %12" PRIu64 " %12" PRIu64 
+			       " %10.3f %10.3f ", i, s[i].pid, 
+			       s[i].state < 3 ? 
+			       states[s[i].state] : "?",
+			       s[i].requests, s[i].bytesin, 
+			       s[i].bytesout, s[i].parsens / 1e6, 
+			       s[i].handlens / 1e6);
+			if (0 == s[i].last)
+				printf("%6s\n", "-");
+			else
+				printf("%6lld\n", 
+				       (long long)(t - s[i].last));
+		}
+	}
+
+	munmap(p, st.st_size);
+	return(1);
+}
+
+/*
+ * Set up worker placement for "-a": "cpu" assigns each worker to one
+ * of the CPUs we're allowed to run on, "node" to one of the system's
+ * NUMA nodes.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+place_init(const char *how)
+{
+#if defined(__linux__)
+	cpu_set_t	 set;
+	struct unit	*u;
+	FILE		*f;
+	char		 path[64], buf[BUFSIZ];
+	int		 i;
+
+	if (-1 == sched_getaffinity(0, sizeof(cpu_set_t), &set)) {
+		fprintf(stderr, "sched_getaffinity: %s\n", 
+			strerror(errno));
+		return(0);
+	}
+
+	if (0 == strcmp(how, "cpu")) {
+		for (i = 0; i < CPU_SETSIZE; i++) {
+			if ( ! CPU_ISSET(i, &set))
+				continue;
+			u = reallocarray(units, 
+				unitsz + 1, sizeof(struct unit));
+			if (NULL == u) {
+				perror(NULL);
+				return(0);
+			}
+			units = u;
+			CPU_ZERO(&units[unitsz].set);
+			CPU_SET(i, &units[unitsz].set);
+			units[unitsz++].id = i;
+		}
+	} else if (0 == strcmp(how, "node")) {
+		unitnode = 1;
+		for (i = 0; ; i++) {
+			snprintf(path, sizeof(path), 
+				"/sys/devices/system/node"
+				"/node%d/cpulist", i);
+			if (NULL == (f = fopen(path, "r")))
+				break;
+			if (NULL == fgets(buf, sizeof(buf), f)) {
+				fclose(f);
+				break;
+			}
+			fclose(f);
+			u = reallocarray(units, 
+				unitsz + 1, sizeof(struct unit));
+			if (NULL == u) {
+				perror(NULL);
+				return(0);
+			}
+			units = u;
+			if ( ! place_cpulist(buf, &units[unitsz].set)) {
+				fprintf(stderr, "%s: bad "
+					"CPU list\n", path);
+				return(0);
+			}
+			/* Only keep the CPUs we may run on. */
+			CPU_AND(&units[unitsz].set, 
+				&units[unitsz].set, &set);
+			if (0 == CPU_COUNT(&units[unitsz].set))
+				continue;
+			units[unitsz++].id = i;
+		}
+	} else {
+		fprintf(stderr, "-a must be \"cpu\" or \"node\"\n");
+		return(0);
+	}
+
+	if (0 == unitsz) {
+		fprintf(stderr, "-a: no usable %ss\n", how);
+		return(0);
+	}
+	return(1);
+#else
+	(void)how;
+	fprintf(stderr, "-a: not supported on this system\n");
+	return(0);
+#endif
+}
+
+/*
+ * The placement unit of the worker in slot "slot" or -1 if workers
+ * aren't placed.
+ */
+static int
+place_unit(size_t slot)
+{
+
+#if defined(__linux__)
+	if (unitsz > 0)
+		return((int)(slot % unitsz));
+#endif
+	(void)slot;
+	return(-1);
+}
+
+/*
+ * Called in a freshly-forked worker to bind it to its placement unit
+ * "unit", if any, and export the unit in its environment as
+ * KFCGI_CPU or KFCGI_NODE.
+ * For NUMA nodes, memory is also preferably allocated on the node.
+ * Failure is not fatal: the worker simply runs anywhere.
+ */
+static void
+place_child(int unit)
+{
+#if defined(__linux__)
+	char		 buf[32];
+	unsigned long	 mask;
+
+	if (unit < 0)
+		return;
+
+	if (-1 == sched_setaffinity(0, 
+	    sizeof(cpu_set_t), &units[unit].set))
+		syslog(LOG_WARNING, "sched_setaffinity: %m");
+
+	snprintf(buf, sizeof(buf), "%d", units[unit].id);
+	setenv(unitnode ? "KFCGI_NODE" : "KFCGI_CPU", buf, 1);
+
+# if defined(SYS_set_mempolicy)
+	/* This is MPOL_PREFERRED from <numaif.h>. */
+	if (unitnode && units[unit].id < 
+	    (int)(sizeof(unsigned long) * CHAR_BIT)) {
+		mask = 1UL << units[unit].id;
+		if (-1 == syscall(SYS_set_mempolicy, 1, 
+		    &mask, sizeof(unsigned long) * CHAR_BIT))
+			syslog(LOG_WARNING, "set_mempolicy: %m");
+	}
+# else
+	(void)mask;
+# endif
+#else
+	(void)unit;
+#endif
+}
+
+/*
+ * The CPU on which the connection "afd" arrived or -1 if unknown.
+ * We use the CPU that processed the connection's packets if the system
+ * tells us, else the CPU we're currently running on.
+ */
+static int
+place_cpu(int afd)
+{
+#if defined(__linux__)
+	int		 cpu;
+# if defined(SO_INCOMING_CPU)
+	socklen_t	 sz;
+
+	sz = sizeof(int);
+	if (0 == getsockopt(afd, SOL_SOCKET, 
+	    SO_INCOMING_CPU, &cpu, &sz) && cpu >= 0)
+		return(cpu);
+# endif
+	(void)afd;
+	cpu = sched_getcpu();
+	return(cpu < CPU_SETSIZE ? cpu : -1);
+#else
+	(void)afd;
+	return(-1);
+#endif
+}
+
+/*
+ * Whether "cpu" (which may be -1) belongs to placement unit "unit".
+ */
+static int
+place_local(int cpu, int unit)
+{
+
+#if defined(__linux__)
+	if (unit >= 0 && cpu >= 0)
+		return(CPU_ISSET(cpu, &units[unit].set));
+#endif
+	(void)cpu;
+	(void)unit;
+	return(0);
+}
+
+/*
+ * Start a worker for the variable pool.
+ */
+static int
+varpool_start(struct worker *w, const struct worker *ws, 
+	size_t wsz, int fd, char **nargv)
+{
+	int	 pair[2];
+	char	 buf[64];
+	size_t	 i, slot;
+
+	w->ctrl = w->fd = -1;
+	w->pid = -1;
+	w->unit = place_unit((size_t)(w - ws));
+	slot = stats_alloc();
+
+	if ( ! xsocketpair(pair))
+		return(0);
+	w->ctrl = pair[0];
+
+	if (-1 == (w->pid = fork())) {
+		syslog(LOG_ERR, "fork: worker: %m");
+		close(pair[0]);
+		close(pair[1]);
+		w->ctrl = -1;
+		return(0);
+	} else if (0 == w->pid) {
+		/* 
+		 * Close out all current descriptors.
+		 * Note that we're a "new-mode" FastCGI manager to the
+		 * child via our environment variable.
+		 */
+		for (i = 0; i < wsz; i++)
+			if (-1 != ws[i].ctrl && 
+			    -1 == close(ws[i].ctrl))
+				syslog(LOG_ERR, "close: "
+					"worker cleanup: %m");
+
+		close(fd);
+		place_child(w->unit);
+		stats_child(slot);
+		snprintf(buf, sizeof(buf), "%d", pair[1]);
+		setenv("FCGI_LISTENSOCK_DESCRIPTORS", buf, 1);
+		execv(nargv[0], nargv);
+		syslog(LOG_ERR, "execv: %s: %m", nargv[0]);
+		_exit(EXIT_FAILURE);
+	}
+
+	stats_reset(slot, w->pid);
+
+	/* Close the child descriptor. */
+	if (-1 == close(pair[1])) {
+		syslog(LOG_ERR, "close: worker-%u pipe: %m", w->pid);
+		return(0);
+	}
+
+	dbg("worker-%u: started", w->pid);
+	return(1);
+}
+
+/*
+ * Monotonic time in seconds.
+ */
+static double
+mono(void)
+{
+	struct timespec	 ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*
+ * Account for a new connection.
+ */
+static void
+load_arrive(struct load *l)
+{
+	double	 t;
+
+	t = mono();
+	if (l->last > 0.0)
+		l->arrival = 0.0 == l->arrival ? t - l->last :
+			l->arrival + LOAD_ALPHA * 
+			(t - l->last - l->arrival);
+	l->last = t;
+}
+
+/*
+ * Account for a connection served by a worker since "start".
+ */
+static void
+load_serve(struct load *l, double start)
+{
+	double	 t;
+
+	t = mono() - start;
+	l->service = 0.0 == l->service ? t :
+		l->service + LOAD_ALPHA * (t - l->service);
+}
+
+/*
+ * The number of workers wanted for the current load: those expected
+ * to be busy plus "spare".
+ * If connections have stopped arriving, the time since the last one
+ * stands in for the mean, letting the estimate decay.
+ */
+static size_t
+load_want(const struct load *l, size_t spare)
+{
+	double	 arrival, busy;
+	size_t	 n;
+
+	if (0.0 == l->arrival || 0.0 == l->service)
+		return(spare);
+	arrival = mono() - l->last;
+	if (arrival < l->arrival)
+		arrival = l->arrival;
+	busy = l->service / arrival;
+	if (busy >= (double)INT_MAX)
+		return(INT_MAX);
+	n = (size_t)busy;
+	if ((double)n < busy)
+		n++;
+	return(n + spare);
+}
+
+/*
+ * Start a worker in the first empty slot of "ws" and push it onto the
+ * idle stack.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+varpool_grow(struct worker *ws, size_t maxwsz, size_t *wsz, 
+	size_t *idle, size_t *idlesz, int fd, char **argv)
+{
+	size_t	 j;
+
+	for (j = 0; j < maxwsz; j++)
+		if (-1 == ws[j].pid)
+			break;
+	assert(j < maxwsz);
+	if ( ! varpool_start(&ws[j], ws, maxwsz, fd, argv))
+		return(0);
+	ws[j].last = time(NULL);
+	idle[(*idlesz)++] = j;
+	(*wsz)++;
+	return(1);
+}
+
+/*
+ * Retire the worker in slot "j", which mustn't be holding a
+ * connection, by closing its control socket and asking it to exit.
+ * It's appended to the "slough" array until it has exited and its slot
+ * is emptied.
+ * If the slough is full (several restarts in a row with workers slow
+ * to exit), its oldest worker is killed outright and reaped to make
+ * room: a restart mustn't bring down the pool.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+varpool_retire(struct worker *ws, size_t j, struct worker *slough, 
+	size_t *sloughsz, size_t sloughmaxsz)
+{
+	struct worker	*w = &ws[j];
+
+	assert(-1 != w->ctrl);
+	assert(-1 != w->pid);
+	assert(-1 == w->fd);
+
+	if (*sloughsz >= sloughmaxsz) {
+		assert(*sloughsz > 0);
+		syslog(LOG_WARNING, "slough pool maximum size "
+			"reached: killing worker-%u", slough[0].pid);
+		if (-1 == kill(slough[0].pid, SIGKILL) && 
+		    ESRCH != errno) {
+			syslog(LOG_ERR, "kill: sloughed "
+				"worker-%u: %m", slough[0].pid);
+			return(0);
+		} else if (-1 == waitpid(slough[0].pid, NULL, 0)) {
+			syslog(LOG_ERR, "wait: sloughed "
+				"worker-%u: %m", slough[0].pid);
+			return(0);
+		}
+		stats_release(slough[0].pid);
+		memmove(slough, slough + 1, 
+			--(*sloughsz) * sizeof(struct worker));
+	}
+	
+	/* Close down the worker in the usual way. */
+	if (-1 == close(w->ctrl)) {
+		syslog(LOG_ERR, "close: worker-%u "
+			"control socket: %m", w->pid);
+		return(0);
+	} 
+	if (-1 == kill(w->pid, SIGTERM)) {
+		syslog(LOG_ERR, "kill: worker-%u: %m", w->pid);
+		return(0);
+	}
+
+	/* 
+	 * Append the dying client to the slough array, since workers
+	 * may take time to die.
+	 * Then empty its slot.
+	 */
+	dbg("slough: acquiring worker-%u\n", w->pid);
+	slough[(*sloughsz)++] = *w;
+	w->ctrl = w->fd = -1;
+	w->pid = -1;
+	w->old = 0;
+	return(1);
+}
+
+/*
+ * Give the connection "afd" to the idle worker "w" in slot "id".
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+varpool_hand(struct evloop *ev, struct worker *w, size_t id, int afd)
+{
+
+	w->fd = afd;
+	w->start = mono();
+#if HAVE_ARC4RANDOM
+	w->cookie = arc4random();
+#else
+	w->cookie = random();
+#endif
+	if ( ! ev_add(ev, w->ctrl, id))
+		return(0);
+	return(fullwritefd(w->ctrl, w->fd, &w->cookie, sizeof(uint64_t)));
+}
+
+/*
+ * Hand queued connections, oldest first, to the most recently used idle
+ * workers until either runs out.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+varpool_drain(struct evloop *ev, struct worker *ws, size_t *idle, 
+	size_t *idlesz, int *q, size_t *qfirst, size_t *qsz, size_t qmax)
+{
+	size_t	 j;
+	int	 afd;
+
+	while (*qsz > 0 && *idlesz > 0) {
+		j = idle[--(*idlesz)];
+		afd = q[*qfirst];
+		*qfirst = (*qfirst + 1) % qmax;
+		(*qsz)--;
+		dbg("worker-%u: acquire %d (queued %zu/%zu)", 
+			ws[j].pid, afd, *qsz, qmax);
+		if ( ! varpool_hand(ev, &ws[j], j, afd))
+			return(0);
+	}
+	return(1);
+}
+
+/*
+ * A variable-sized pool of web application clients.
+ * A minimum of "minwsz" applications are always running, and will grow
+ * to "maxwsz".
+ * Workers are started ahead of demand to keep "spare" of them idle and
+ * to cover the expected load.
+ * When all workers are busy, up to "qmax" accepted connections wait in
+ * a queue; beyond that, no new connections are accepted.
+ * On SIGHUP, idle workers are retired and busy ones marked as old, to
+ * be retired when they finish or after "draintime" seconds (if
+ * non-zero); new workers replace them as usual, so the socket is
+ * always served.
+ * All arrays are allocated to "maxwsz" up front; workers occupy slots
+ * in "ws", with a pid of -1 marking an empty slot.
+ * Idle workers are kept on a stack so that the most recently used (and
+ * thus warmest) worker is handed the next connection, while the least
+ * recently used is at the bottom for retirement.
+ * Events for working workers are identified by their slot; the
+ * listening socket is identified by "maxwsz".
+ * This is an EXPERIMENTAL extension.
+ */
+static int
+varpool(size_t minwsz, size_t maxwsz, size_t spare, size_t qmax,
+	time_t waittime, time_t draintime, 
+	int fd, const char *sockpath, char *argv[])
+{
+	struct worker	*ws;
+	struct worker	*slough;
+	struct load	 load;
+	size_t		*idle;
+	size_t		 idlesz, i, j, wsz, sloughsz, sloughmaxsz,
+			 qsz, qfirst, oldsz;
+	int		 rc, evsz, exitcode, afd, accepting, 
+			 timeout, listening, cpu;
+	int		*q;
+	struct evloop	 ev;
+	struct sockaddr_storage ss;
+	socklen_t	 sslen;
+	time_t		 t, drainby;
+	sigset_t	 set;
+	uint64_t	 cookie;
+
+	dbg("YOU ARE RUNNING VARIABLE MODE AT YOUR OWN RISK.");
+
+	signal(SIGCHLD, sighandlechld);
+	signal(SIGTERM, sighandlestop);
+	signal(SIGHUP, sighandlehup);
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGHUP);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	stop = chld = hup = 0;
+
+	/* 
+	 * Allocate worker array, idle stack, event loop, connection
+	 * queue, and slough array (exiting workers).
+	 * Set our initial exit code and our acceptance status.
+	 */
+	ws = calloc(maxwsz, sizeof(struct worker));
+	idle = calloc(maxwsz, sizeof(size_t));
+	q = calloc(0 == qmax ? 1 : qmax, sizeof(int));
+	sloughmaxsz = maxwsz * 2;
+	slough = calloc(sloughmaxsz, sizeof(struct worker));
+	exitcode = 0;
+
+	if ( ! ev_alloc(&ev, maxwsz + 1, &set) ||
+	    ! ev_add(&ev, fd, maxwsz) ||
+	    NULL == ws || NULL == idle || NULL == q ||
+	    (sloughmaxsz && NULL == slough)) {
+		/* Serious problems. */
+		syslog(LOG_ERR, "initialisation failed");
+		close(fd);
+		if (NULL != sockpath)
+			unlink(sockpath);
+		free(ws);
+		free(idle);
+		free(q);
+		free(slough);
+		ev_free(&ev);
+		return(0);
+	}
+
+	/* Guard against bad de-allocation. */
+	for (i = 0; i < maxwsz; i++) {
+		ws[i].ctrl = ws[i].fd = -1;
+		ws[i].pid = -1;
+	}
+
+	sloughsz = idlesz = wsz = qsz = qfirst = oldsz = 0;
+	drainby = 0;
+	accepting = 1;
+	memset(&load, 0, sizeof(struct load));
+
+	/*
+	 * Start up the [initial] worker processes.
+	 * We'll later spin up workers when we need them.
+	 * If these die immediately, we'll find out below when we
+	 * unblock our signals.
+	 */
+	t = time(NULL);
+	for (i = 0; i < minwsz; i++) {
+		if ( ! varpool_start(&ws[i], ws, maxwsz, fd, argv))
+			goto out;
+		ws[i].last = t;
+		idle[idlesz++] = i;
+		wsz++;
+	}
+pollagain:
+	if (NULL != stats) {
+		stats->workers = wsz;
+		stats->busy = wsz - idlesz;
+		stats->queued = qsz;
+	}
+
+	/*
+	 * Main part.
+	 * Wait on our control socket (unless we're not accepting new
+	 * connections) and the children that have active connections.
+	 * We only time out when the least recently used idle worker
+	 * is due to be released or old workers are due to have
+	 * drained; signals wake us up regardless.
+	 */
+	t = 0;
+	if (wsz - oldsz > minwsz && idlesz > spare)
+		t = ws[idle[0]].last + waittime + 1;
+	if (oldsz > 0 && draintime > 0 && (0 == t || drainby < t))
+		t = drainby;
+	timeout = -1;
+	if (t > 0) {
+		t -= time(NULL);
+		timeout = t <= 0 ? 0 : 
+			t >= INT_MAX / 1000 ? INT_MAX : (int)t * 1000;
+	}
+
+	/* Don't sleep on signals we've yet to service. */
+	if (stop || chld || hup)
+		timeout = 0;
+
+	if ((evsz = ev_wait(&ev, timeout)) < 0)
+		goto out;
+
+	if (stop) {
+		/* 
+		 * If we're being requested to stop, go to exit now. 
+		 * We'll immediately kill off our children and wait.
+		 */
+		dbg("servicing exit request");
+		exitcode = 1;
+		goto out;
+	} else if (chld) {
+		/*
+		 * A child has exited.
+		 * This can mean one of two things: either a worker has
+		 * exited abnormally or one of the "sloughed" workers
+		 * has finished its exit.
+		 * It may also be stale, having been raised by workers
+		 * reaped before a restart.
+		 */
+		/* Look at the running children. */
+		for (i = 0; i < maxwsz; i++) {
+			if (-1 == ws[i].pid)
+				continue;
+			rc = waitpid(ws[i].pid, NULL, WNOHANG);
+			if (rc < 0) {
 				syslog(LOG_ERR, "wait: worker-%u "
 					"check: %m", ws[i].pid);
 				goto out;
@@ -444,7 +1580,7 @@ pollagain:
 			if (-1 == close(ws[i].ctrl))
 				syslog(LOG_ERR, "close: worker-%u "
 					"control socket: %m",
-					ws[wsz - 1].pid);
+					ws[i].pid);
 			ws[i].pid = -1;
 			goto out;
 		}
@@ -464,120 +1600,110 @@ pollagain:
 			}
 			dbg("slough: releasing worker-%u\n", 
 				slough[i].pid);
-			if (i < sloughsz - 1)
-				slough[i] = slough[sloughsz - 1];
-			sloughsz--;
+			stats_release(slough[i].pid);
+			/* Keep oldest first for varpool_retire(). */
+			memmove(slough + i, slough + i + 1, 
+				(--sloughsz - i) * sizeof(struct worker));
 		}
-	} else if (hup) {
-		dbg("servicing restart request");
-		goto out;
 	}
 
 	/*
-	 * See if we should reduce our pool size.
-	 * We only do this if we've grown beyond the minimum.
+	 * This isn't an "else": both may have been raised by the same
+	 * wakeup, and nothing else may wake us up again.
 	 */
-	if (wsz > minwsz) {
-		t = time(NULL);
+	if (hup) {
 		/*
-		 * We only reduce if the last worker is (1) not running
-		 * and (2) was last descheduled a while ago.
+		 * Rolling restart.
+		 * Idle workers are retired now; working ones are marked
+		 * as old and retired when they've finished.
+		 * Replacements are started below.
 		 */
-		assert(-1 != ws[wsz - 1].fd || ws[wsz - 1].last);
-		assert(wsz > 1);
-
-		if (-1 == ws[wsz - 1].fd &&
-		    t - ws[wsz - 1].last > waittime) {
-			assert(-1 != ws[wsz - 1].ctrl);
-			assert(-1 != ws[wsz - 1].pid);
-			assert(-1 == ws[wsz - 1].fd);
-			assert(-1 == pfd[pfdmaxsz - 1].fd);
-
-			if (sloughsz >= sloughmaxsz) {
-				syslog(LOG_ERR, "slough pool "
-					"maximum size reached");
-				goto out;
-			}
-			
-			/* Close down the worker in the usual way. */
-			if (-1 == close(ws[wsz - 1].ctrl)) {
-				syslog(LOG_ERR, "close: worker-%u "
-					"control socket: %m",
-					ws[wsz - 1].pid);
-				goto out;
-			} 
-			if (-1 == kill(ws[wsz - 1].pid, SIGTERM)) {
-				syslog(LOG_ERR, "kill: worker-%u: %m",
-					ws[wsz - 1].pid);
+		hup = 0;
+		dbg("servicing restart request");
+		while (idlesz > 0) {
+			j = idle[--idlesz];
+			if ( ! varpool_retire(ws, j, 
+			    slough, &sloughsz, sloughmaxsz))
 				goto out;
+			wsz--;
+		}
+		for (i = 0; i < maxwsz; i++)
+			if (-1 != ws[i].pid && ! ws[i].old) {
+				ws[i].old = 1;
+				oldsz++;
 			}
+		drainby = time(NULL) + draintime;
+	}
 
-			/* 
-			 * Append the dying client to the slough array,
-			 * since workers may take time to die.
-			 */
-			dbg("slough: acquiring worker-%u\n", 
-				ws[wsz - 1].pid);
-			slough[sloughsz++] = ws[wsz - 1];
-
-			/* Reallocations. */
-			pp = reallocarray(ws, wsz - 1, 
-				sizeof(struct worker));
-			if (NULL == pp) {
-				syslog(LOG_ERR, "reallocarray: "
-					"worker array: %m");
+	/*
+	 * Old workers that haven't finished in time are abandoned:
+	 * their connections are closed and they are retired.
+	 */
+	if (oldsz > 0 && draintime > 0 && time(NULL) >= drainby)
+		for (i = 0; i < maxwsz; i++) {
+			if (-1 == ws[i].pid || ! ws[i].old)
+				continue;
+			syslog(LOG_WARNING, "worker-%u: drain "
+				"time exceeded", ws[i].pid);
+			close(ws[i].fd);
+			ws[i].fd = -1;
+			if ( ! ev_del(&ev, ws[i].ctrl, i))
 				goto out;
-			}
-			ws = pp;
-			wsz--;
-			pp = reallocarray(pfd, pfdmaxsz - 1,
-				sizeof(struct pollfd));
-			if (NULL == pp) {
-				syslog(LOG_ERR, "reallocarray: "
-					"descriptor array: %m");
+			if ( ! varpool_retire(ws, i, 
+			    slough, &sloughsz, sloughmaxsz))
 				goto out;
-			}
-			pfd = pp;
-			pfdmaxsz--;
+			oldsz--;
+			wsz--;
 		}
+
+	/*
+	 * See if we should reduce our pool size.
+	 * We only do this if we've grown beyond the minimum, have more
+	 * than our spare idle workers, and the least recently used idle
+	 * worker (at the bottom of the idle stack) was last descheduled
+	 * a while ago.
+	 */
+	if (wsz - oldsz > minwsz && idlesz > spare &&
+	    time(NULL) - ws[idle[0]].last > waittime) {
+		if ( ! varpool_retire(ws, idle[0], 
+		    slough, &sloughsz, sloughmaxsz))
+			goto out;
+		memmove(idle, idle + 1, --idlesz * sizeof(size_t));
+		wsz--;
 	}
 	
-	if (0 == rc)
-		goto pollagain;
-
 	/*
 	 * Now we see which of the workers has exited.
 	 * We do this until we've processed all of them.
+	 * Note whether the control socket has a connection for us.
 	 */
-	assert(rc > 0);
-	for (i = 1; i < pfdsz && rc > 0; ) {
-		if (POLLHUP & pfd[i].revents ||
-		    POLLERR & pfd[i].revents) {
+	listening = 0;
+	for (i = 0; i < (size_t)evsz; i++) {
+		if (maxwsz == ev.out[i].id) {
+			if (ev.out[i].err) {
+				syslog(LOG_ERR, "poll: control "
+					"hangup or error");
+				goto out;
+			}
+			listening = ev.out[i].in;
+			continue;
+		} else if (ev.out[i].err) {
 			syslog(LOG_ERR, "poll: worker disconnect");
 			goto out;
-		} else if ( ! (POLLIN & pfd[i].revents)) {
-			i++;
+		} else if ( ! ev.out[i].in)
 			continue;
-		} 
 
 		/* 
 		 * Read the "identifier" that the child process gives
 		 * to us.
+		 * The worker is known from the descriptor it arrived
+		 * on, so the cookie is only used to check it.
 		 */
-		if ( ! fullread(pfd[i].fd, &cookie, sizeof(uint64_t)))
+		j = ev.out[i].id;
+		if ( ! fullread(ws[j].ctrl, &cookie, sizeof(uint64_t)))
 			goto out;
 
-		/*
-		 * First, look up the worker that's now free.
-		 * Mark its active descriptor as free.
-		 * TODO: use a queue of "working" processes to prevent
-		 * this from being so expensive.
-		 */
-		for (j = 0; j < wsz; j++)
-			if (ws[j].cookie == cookie)
-				break;
-
-		if (j == wsz) {
+		if (ws[j].cookie != cookie) {
 			syslog(LOG_ERR, "poll: bad worker response");
 			goto out;
 		}
@@ -585,78 +1711,89 @@ pollagain:
 		dbg("worker-%u: release %d", ws[j].pid, ws[j].fd);
 
 		/*
-		 * Close the descriptor (that we still hold) and mark
-		 * this worker as no longer working.
+		 * Close the descriptor (that we still hold).
+		 * Then either retire an old worker or mark it as no
+		 * longer working by pushing it onto the idle stack,
+		 * whence it's given any queued connection below.
 		 */
-		rc--;
+		load_serve(&load, ws[j].start);
 		close(ws[j].fd);
+		ws[j].fd = -1;
+		ws[j].last = time(NULL);
+		if ( ! ev_del(&ev, ws[j].ctrl, j))
+			goto out;
+		if (ws[j].old) {
+			if ( ! varpool_retire(ws, j, 
+			    slough, &sloughsz, sloughmaxsz))
+				goto out;
+			oldsz--;
+			wsz--;
+		} else
+			idle[idlesz++] = j;
 		if (0 == accepting) {
+			if ( ! ev_add(&ev, fd, maxwsz))
+				goto out;
 			accepting = 1;
 			dbg("rate-limiting: disabled");
 		}
-		ws[j].fd = -1;
-		ws[j].last = time(NULL);
-
-		/*
-		 * Now, clear the active descriptor from the file
-		 * descriptor array.
-		 * Do so by flipping it into the last slot then
-		 * truncating the array size.
-		 * Obviously, we only do this if we're not the current
-		 * end of array...
-		 */
-		if (pfdsz - 1 != i)
-			pfd[i] = pfd[pfdsz - 1];
-		pfd[pfdsz - 1].fd = -1;
-		pfdsz--;
 	}
 
-	if (0 == accepting)
-		goto pollagain;
-
-	if (POLLHUP & pfd[0].revents) {
-		syslog(LOG_ERR, "poll: control hangup");
+	/*
+	 * Give queued connections to idle workers, including those
+	 * just released: retired old workers don't take any.
+	 */
+	if ( ! varpool_drain(&ev, ws, idle, 
+	    &idlesz, q, &qfirst, &qsz, qmax))
 		goto out;
-	} else if (POLLERR & pfd[0].revents) {
-		syslog(LOG_ERR, "poll: control error?");
+
+	/*
+	 * Start workers ahead of demand: keep at least our minimum
+	 * and spare number idle, enough to serve the expected load,
+	 * and enough for whatever is queued.
+	 * Old workers don't count, as they're on their way out.
+	 */
+	while (wsz < maxwsz && (idlesz < spare || wsz - oldsz < minwsz ||
+	       wsz - oldsz < load_want(&load, spare) || idlesz < qsz)) {
+		if ( ! varpool_grow(ws, maxwsz, 
+		    &wsz, idle, &idlesz, fd, argv))
+			goto out;
+		dbg("scaling: workers %zu/%zu (idle %zu)", 
+			wsz, maxwsz, idlesz);
+	}
+
+	/* New workers take queued connections first. */
+	if ( ! varpool_drain(&ev, ws, idle, 
+	    &idlesz, q, &qfirst, &qsz, qmax))
 		goto out;
-	} else if ( ! (POLLIN & pfd[0].revents))
+
+	if (0 == accepting || 0 == listening)
 		goto pollagain;
 
 	/* 
 	 * We have a new request.
-	 * First, see if we need to allocate more workers.
+	 * First, see if we need to start another worker in the first
+	 * empty slot.
+	 * If we can't, and our queue is full, stop accepting.
 	 */
-	if (pfdsz == pfdmaxsz) {
-		if (wsz + 1 > maxwsz) {
-			accepting = 0;
-			dbg("rate-limiting: enabled");
-			goto pollagain;
-		}
-		pp = reallocarray(pfd, pfdmaxsz + 1,
-			sizeof(struct pollfd));
-		if (NULL == pp) {
-			syslog(LOG_ERR, "reallocarray: workers: %m");
+	if (0 == idlesz && wsz < maxwsz) {
+		if ( ! varpool_grow(ws, maxwsz, 
+		    &wsz, idle, &idlesz, fd, argv))
 			goto out;
-		}
-		pfd = pp;
-		memset(&pfd[pfdmaxsz], 0, sizeof(struct pollfd));
-		pfd[pfdmaxsz].fd = -1;
-
-		pp = reallocarray(ws, wsz + 1,
-			sizeof(struct worker));
-		if (NULL == pp) {
-			syslog(LOG_ERR, "reallocarray: descriptors: %m");
+	} else if (0 == idlesz && qsz == qmax) {
+		if ( ! ev_del(&ev, fd, maxwsz))
 			goto out;
-		}
-		ws = pp;
-		memset(&ws[wsz], 0, sizeof(struct worker));
+		accepting = 0;
+		dbg("rate-limiting: enabled");
+		goto pollagain;
+	}
 
-		if ( ! varpool_start(&ws[wsz], ws, wsz + 1, fd, argv))
-			goto out;
-		pfdmaxsz++;
-		wsz++;
-	} 
+	/* 
+	 * Queued connections go before this one, so a worker we've
+	 * just started must take them first.
+	 */
+	if ( ! varpool_drain(&ev, ws, idle, 
+	    &idlesz, q, &qfirst, &qsz, qmax))
+		goto out;
 
 	/*
 	 * Actually accept the socket.
@@ -673,47 +1810,62 @@ pollagain:
 	} 
 
 	/*
-	 * Look up the next unavailable worker.
+	 * Workers may be forked while this sits in the queue or is
+	 * held by a busy worker: don't let them inherit it.
 	 */
-	for (i = 0; i < wsz; i++)
-		if (-1 == ws[i].fd) 
-			break;
+	if (-1 == fcntl(afd, F_SETFD, FD_CLOEXEC)) {
+		syslog(LOG_ERR, "fcntl: new connection: %m");
+		close(afd);
+		goto pollagain;
+	}
 
-	assert(i < wsz);
-	ws[i].fd = afd;
-#if HAVE_ARC4RANDOM
-	ws[i].cookie = arc4random();
-#else
-	ws[i].cookie = random();
-#endif
-	dbg("worker-%u: acquire %d "
-		"(pollers %zu/%zu: workers %zu/%zu)", 
-		ws[i].pid, afd, pfdsz, pfdmaxsz, wsz, maxwsz);
-	pfd[pfdsz].events = POLLIN;
-	pfd[pfdsz].fd = ws[i].ctrl;
-	pfdsz++;
+	load_arrive(&load);
+	if (NULL != stats)
+		stats->accepted = ++statsaccepted;
+
+	/* All workers are busy: queue the connection. */
+	if (0 == idlesz) {
+		assert(qsz < qmax);
+		q[(qfirst + qsz++) % qmax] = afd;
+		dbg("queue: %zu/%zu", qsz, qmax);
+		goto pollagain;
+	}
 
-	if (fullwritefd(ws[i].ctrl, ws[i].fd, &ws[i].cookie, sizeof(uint64_t)))
+	/* 
+	 * Take the most recently used idle worker.
+	 * If workers are placed, prefer the most recently used one
+	 * local to the connection.
+	 */
+	j = idlesz - 1;
+	if (place_unit(0) >= 0 && (cpu = place_cpu(afd)) >= 0)
+		for (i = idlesz; i > 0; i--)
+			if (place_local(cpu, ws[idle[i - 1]].unit)) {
+				j = i - 1;
+				break;
+			}
+	i = idle[j];
+	memmove(idle + j, idle + j + 1, 
+		(--idlesz - j) * sizeof(size_t));
+	dbg("worker-%u: acquire %d "
+		"(idle %zu: workers %zu/%zu)", 
+		ws[i].pid, afd, idlesz, wsz, maxwsz);
+	if (varpool_hand(&ev, &ws[i], i, afd))
 		goto pollagain;
 
 out:
-	if ( ! hup) {
-		/*
-		 * If we're not going to restart, then close the FastCGI
-		 * file descriptor as soon as possible.
-		 */
-		dbg("closing control socket");
-		if (-1 == close(fd))
-			syslog(LOG_ERR, "close: control: %m");
-		fd = -1;
-	}
+	/*
+	 * Close the FastCGI file descriptor as soon as possible.
+	 */
+	dbg("closing control socket");
+	if (-1 == close(fd))
+		syslog(LOG_ERR, "close: control: %m");
 
 	/*
 	 * Close the application's control socket; then, if that doesn't
 	 * make it exit (kcgi(3) will, but other applications may not),
 	 * we also deliver a SIGTERM.
 	 */
-	for (i = 0; i < wsz; i++) {
+	for (i = 0; i < maxwsz; i++) {
 		if (-1 == ws[i].pid)
 			continue;
 		dbg("worker-%u: terminating", ws[i].pid);
@@ -725,49 +1877,284 @@ out:
 				"worker-%u: %m", ws[i].pid);
 	}
 
-	/*
-	 * Now wait for the children and pending children.
-	 */
-	for (i = 0; i < wsz; i++) {
-		if (-1 == ws[i].pid)
-			continue;
-		dbg("worker-%u: reaping", ws[i].pid);
-		if (-1 == waitpid(ws[i].pid, NULL, 0))
-			syslog(LOG_ERR, "wait: "
-				"worker-%u: %m", ws[i].pid);
+	/*
+	 * Now wait for the children and pending children.
+	 */
+	for (i = 0; i < maxwsz; i++) {
+		if (-1 == ws[i].pid)
+			continue;
+		dbg("worker-%u: reaping", ws[i].pid);
+		if (-1 == waitpid(ws[i].pid, NULL, 0))
+			syslog(LOG_ERR, "wait: "
+				"worker-%u: %m", ws[i].pid);
+	}
+
+	for (i = 0; i < sloughsz; i++) {
+		dbg("sloughed worker-%u: reaping", slough[i].pid);
+		if (-1 == waitpid(slough[i].pid, NULL, 0))
+			syslog(LOG_ERR, "wait: sloughed "
+				"worker-%u: %m", slough[i].pid);
+	}
+
+	/* Drop connections we never handed out. */
+	for (i = 0; i < qsz; i++)
+		close(q[(qfirst + i) % qmax]);
+
+	free(ws);
+	free(idle);
+	free(q);
+	free(slough);
+	ev_free(&ev);
+	return(exitcode);
+}
+
+/*
+ * Close the "fdsz" listening sockets "fds".
+ */
+static void
+sock_close(const int *fds, size_t fdsz)
+{
+	size_t	 i;
+
+	for (i = 0; i < fdsz; i++)
+		if (-1 != fds[i] && -1 == close(fds[i]))
+			syslog(LOG_ERR, "close: control: %m");
+}
+
+/*
+ * Open a UNIX socket listening on "sockpath" with a backlog of "lsz",
+ * replacing any existing socket and, if "sockuser" is set, owned by
+ * "sockuid" and "sockgid".
+ * Returns the socket or -1 on failure (reported on stderr).
+ */
+static int
+sock_unix(const char *sockpath, const char *sockuser, 
+	uid_t sockuid, gid_t sockgid, size_t lsz)
+{
+	int			 fd;
+	size_t			 sz;
+	struct sockaddr_un	 sun;
+	mode_t			 old_umask;
+
+	/* Do the usual dance to set up UNIX sockets. */
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	sz = strlcpy(sun.sun_path, sockpath, sizeof(sun.sun_path));
+	if (sz >= sizeof(sun.sun_path)) {
+		fprintf(stderr, "socket path to long\n");
+		return(-1);
+	}
+#ifndef __linux__
+	sun.sun_len = sz;
+#endif
+
+	/*
+	 * Prepare the socket then unlink any dead existing ones.
+	 * This is because we want to control the socket.
+	 */
+	if (-1 == (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+		perror("socket");
+		return(-1);
+	} else if (-1 == unlink(sockpath)) {
+		if (ENOENT != errno) {
+			perror(sockpath);
+			close(fd);
+			return(-1);
+		}
+	}
+
+	old_umask = umask(S_IXUSR|S_IXGRP|S_IWOTH|S_IROTH|S_IXOTH);
+
+	/* 
+	 * Now actually bind to the FastCGI socket set up our
+	 * listeners, and make sure that we're not blocking.
+	 * If necessary, change the file's ownership.
+	 * We buffer up to the number of available workers.
+	 */
+	if (-1 == bind(fd, (struct sockaddr *)&sun, sizeof(sun))) {
+		perror("bind");
+		close(fd);
+		return(-1);
+	}
+	umask(old_umask);
+
+	if (NULL != sockuser) 
+		if (chown(sockpath, sockuid, sockgid) == -1) {
+			perror(sockpath);
+			close(fd);
+			return(-1);
+		}
+
+	if (-1 == listen(fd, lsz)) {
+		perror(sockpath);
+		close(fd);
+		return(-1);
+	}
+	return(fd);
+}
+
+/*
+ * Apply the tunables "opts" to the TCP socket "fd".
+ * Returns 0 on failure (reported on stderr), 1 on success.
+ */
+static int
+sock_tcpopts(int fd, const struct tcpopts *opts)
+{
+
+	if (opts->nodelay && -1 == setsockopt(fd, IPPROTO_TCP, 
+	    TCP_NODELAY, &opts->nodelay, sizeof(int))) {
+		perror("setsockopt: TCP_NODELAY");
+		return(0);
+	}
+	if (opts->sndbuf && -1 == setsockopt(fd, SOL_SOCKET, 
+	    SO_SNDBUF, &opts->sndbuf, sizeof(int))) {
+		perror("setsockopt: SO_SNDBUF");
+		return(0);
+	}
+	if (opts->rcvbuf && -1 == setsockopt(fd, SOL_SOCKET, 
+	    SO_RCVBUF, &opts->rcvbuf, sizeof(int))) {
+		perror("setsockopt: SO_RCVBUF");
+		return(0);
+	}
+	if (0 == opts->defer)
+		return(1);
+#if defined(TCP_DEFER_ACCEPT)
+	if (-1 == setsockopt(fd, IPPROTO_TCP, 
+	    TCP_DEFER_ACCEPT, &opts->defer, sizeof(int))) {
+		perror("setsockopt: TCP_DEFER_ACCEPT");
+		return(0);
 	}
+	return(1);
+#else
+	fprintf(stderr, "TCP_DEFER_ACCEPT: "
+		"not supported on this system\n");
+	return(0);
+#endif
+}
 
-	for (i = 0; i < sloughsz; i++) {
-		dbg("sloughed worker-%u: reaping", slough[i].pid);
-		if (-1 == waitpid(slough[i].pid, NULL, 0))
-			syslog(LOG_ERR, "wait: sloughed "
-				"worker-%u: %m", slough[i].pid);
+/*
+ * Open a TCP socket listening on the first usable address of "res"
+ * with a backlog of "lsz" and tunables "opts".
+ * If "reuseport" is set, other sockets may be bound to the same
+ * address with SO_REUSEPORT and the kernel will balance connections
+ * between them.
+ * Returns the socket or -1 on failure (reported on stderr).
+ */
+static int
+sock_tcp(const struct addrinfo *res, int reuseport, 
+	const struct tcpopts *opts, size_t lsz)
+{
+	const struct addrinfo *ai;
+	int	 fd, opt, er;
+
+	er = 0;
+	for (ai = res; NULL != ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, 
+			ai->ai_socktype, ai->ai_protocol);
+		if (-1 == fd) {
+			er = errno;
+			continue;
+		}
+		opt = 1;
+		if (-1 == setsockopt(fd, SOL_SOCKET, 
+		    SO_REUSEADDR, &opt, sizeof(opt))) {
+			er = errno;
+			close(fd);
+			continue;
+		}
+		if (reuseport) {
+#if defined(SO_REUSEPORT)
+			if (-1 == setsockopt(fd, SOL_SOCKET, 
+			    SO_REUSEPORT, &opt, sizeof(opt))) {
+				er = errno;
+				close(fd);
+				continue;
+			}
+#else
+			close(fd);
+			fprintf(stderr, "SO_REUSEPORT: "
+				"not supported on this system\n");
+			return(-1);
+#endif
+		}
+		/* Buffer sizes must be set before listen(2). */
+		if ( ! sock_tcpopts(fd, opts)) {
+			close(fd);
+			return(-1);
+		}
+		if (-1 == bind(fd, ai->ai_addr, ai->ai_addrlen) ||
+		    -1 == listen(fd, lsz)) {
+			er = errno;
+			close(fd);
+			continue;
+		}
+		return(fd);
 	}
 
-	free(ws);
-	free(slough);
-	free(pfd);
+	fprintf(stderr, "bind: %s\n", strerror(er));
+	return(-1);
+}
 
-	if (hup)
-		goto again;
+/*
+ * Start the "wsz" workers of a fixed pool into "ws", each accepting
+ * directly on one of the "fdsz" listening sockets "fds", round-robin.
+ * Returns 0 on failure (some workers may have started), 1 on success.
+ */
+static int
+fixedpool_start(pid_t *ws, size_t wsz, 
+	const int *fds, size_t fdsz, char *argv[])
+{
+	size_t	 i, j, slot;
 
-	/* 
-	 * Now we're really exiting.
-	 * Do our final cleanup if we didn't already...
-	 */
-	if (-1 != fd) {
-		dbg("closing control socket");
-		if (-1 == close(fd))
-			syslog(LOG_ERR, "close: control: %m");
+	for (i = 0; i < wsz; i++) {
+		slot = stats_alloc();
+		if (-1 == (ws[i] = fork())) {
+			syslog(LOG_ERR, "fork: worker: %m");
+			return(0);
+		} else if (0 == ws[i]) {
+			/*
+			 * Assign stdin to be the socket over which
+			 * we're going to transfer request descriptors
+			 * when we get them.
+			 */
+			if (-1 == dup2(fds[i % fdsz], STDIN_FILENO)) {
+				syslog(LOG_ERR, "dup2: worker: %m");
+				_exit(EXIT_FAILURE);
+			}
+			for (j = 0; j < fdsz; j++)
+				close(fds[j]);
+			place_child(place_unit(i));
+			stats_child(slot);
+			execv(argv[0], argv);
+			syslog(LOG_ERR, "execve: %s: %m", argv[0]);
+			_exit(EXIT_FAILURE);
+		}
+		stats_reset(slot, ws[i]);
 	}
-	return(exitcode);
+	if (NULL != stats)
+		stats->workers = wsz;
+	return(1);
 }
 
+/*
+ * A fixed-size pool of web application clients, each accepting on the
+ * FastCGI socket itself.
+ * There's either one socket shared by all workers or, with "-R", one
+ * per worker, all bound to the same address, so that the kernel
+ * balances connections between them.
+ * On SIGHUP, a new generation of workers is started before the old
+ * generation is sent a SIGTERM, so the socket is always served.
+ * Old workers finish their current request (kcgi(3) workers exit when
+ * next waiting for one) and are killed if they take more than
+ * "draintime" seconds (if non-zero).
+ */
 static int
-fixedpool(size_t wsz, int fd, const char *sockpath, char *argv[])
+fixedpool(size_t wsz, time_t draintime, 
+	int *fds, size_t fdsz, const char *sockpath, char *argv[])
 {
-	pid_t		 *ws;
-	size_t		  i;
+	pid_t		 *ws, *old;
+	pid_t		  pid;
+	size_t		  i, oldsz;
 	sigset_t	  set, oset;
 	void 		(*sigfp)(int);
 
@@ -779,20 +2166,26 @@ fixedpool(size_t wsz, int fd, const char *sockpath, char *argv[])
 	signal(SIGTERM, sighandlestop);
 	signal(SIGCHLD, sighandlechld);
 	signal(SIGHUP, sighandlehup);
+	signal(SIGALRM, sighandlealrm);
 	sigemptyset(&set);
 	sigaddset(&set, SIGCHLD);
 	sigaddset(&set, SIGTERM);
 	sigaddset(&set, SIGHUP);
+	sigaddset(&set, SIGALRM);
 	sigprocmask(SIG_BLOCK, &set, &oset);
 
-again:
-	hup = stop = chld = 0;
+	hup = stop = chld = alrm = 0;
 
-	/* Allocate worker array. */
-	if (NULL == (ws = calloc(wsz, sizeof(pid_t)))) {
+	/* Allocate worker and old worker arrays. */
+	ws = calloc(wsz, sizeof(pid_t));
+	old = calloc(wsz, sizeof(pid_t));
+	if (NULL == ws || NULL == old) {
 		syslog(LOG_ERR, "calloc: initialisation: %m");
-		close(fd);
-		unlink(sockpath);
+		sock_close(fds, fdsz);
+		if (NULL != sockpath)
+			unlink(sockpath);
+		free(ws);
+		free(old);
 		return(0);
 	}
 
@@ -801,91 +2194,152 @@ again:
 	 * This is in case the initialisation fails.
 	 */
 	for (i = 0; i < wsz; i++)
-		ws[i] = -1;
+		ws[i] = old[i] = -1;
+	oldsz = 0;
 
-	for (i = 0; i < wsz; i++) {
-		if (-1 == (ws[i] = fork())) {
-			syslog(LOG_ERR, "fork: worker: %m");
-			goto out;
-		} else if (0 == ws[i]) {
-			/*
-			 * Assign stdin to be the socket over which
-			 * we're going to transfer request descriptors
-			 * when we get them.
-			 */
-			if (-1 == dup2(fd, STDIN_FILENO)) {
-				syslog(LOG_ERR, "dup2: worker: %m");
-				_exit(EXIT_FAILURE);
+	if ( ! fixedpool_start(ws, wsz, fds, fdsz, argv))
+		goto out;
+
+	for (;;) {
+		sigsuspend(&oset);
+
+		if (stop) {
+			dbg("servicing exit request");
+			break;
+		}
+
+		/*
+		 * Reap exited children.
+		 * Old workers are expected to exit; current ones are
+		 * not, and cause us to exit.
+		 */
+		if (chld) {
+			chld = 0;
+			while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+				for (i = 0; i < wsz; i++)
+					if (pid == old[i])
+						break;
+				if (i < wsz) {
+					dbg("worker-%u: drained", pid);
+					stats_release(pid);
+					old[i] = -1;
+					if (0 == --oldsz)
+						alarm(0);
+					continue;
+				}
+				for (i = 0; i < wsz; i++)
+					if (pid == ws[i])
+						ws[i] = -1;
+				syslog(LOG_ERR, "worker unexpectedly exited");
+				goto out;
 			}
-			close(fd);
-			execv(argv[0], argv);
-			syslog(LOG_ERR, "execve: %s: %m", argv[0]);
-			_exit(EXIT_FAILURE);
 		}
-	}
 
-	sigsuspend(&oset);
+		/* Old workers didn't finish draining in time. */
+		if (alrm) {
+			alrm = 0;
+			for (i = 0; i < wsz; i++) {
+				if (-1 == old[i])
+					continue;
+				syslog(LOG_WARNING, "worker-%u: drain "
+					"time exceeded", old[i]);
+				if (-1 == kill(old[i], SIGKILL))
+					syslog(LOG_ERR, "kill: "
+						"worker-%u: %m", old[i]);
+			}
+		}
+
+		if ( ! hup)
+			continue;
 
-	if (stop)
-		dbg("servicing exit request");
-	else if (chld)
-		syslog(LOG_ERR, "worker unexpectedly exited");
-	else 
-		dbg("servicing restart request");
-out:
-	if ( ! hup) {
 		/*
-		 * If we're not going to restart, then close the FastCGI
-		 * file descriptor as soon as possible.
+		 * Rolling restart.
+		 * Kill off any stragglers from an earlier restart, then
+		 * make the current workers old, start new ones, and only
+		 * then ask the old ones to exit.
 		 */
-		if (-1 == close(fd))
-			syslog(LOG_ERR, "close: control: %m");
-		fd = -1;
+		hup = 0;
+		dbg("servicing restart request");
+		for (i = 0; i < wsz; i++) {
+			if (-1 == old[i])
+				continue;
+			if (-1 == kill(old[i], SIGKILL))
+				syslog(LOG_ERR, "kill: "
+					"worker-%u: %m", old[i]);
+			if (-1 == waitpid(old[i], NULL, 0))
+				syslog(LOG_ERR, "wait: "
+					"worker-%u: %m", old[i]);
+			stats_release(old[i]);
+			old[i] = -1;
+		}
+
+		memcpy(old, ws, wsz * sizeof(pid_t));
+		oldsz = wsz;
+		for (i = 0; i < wsz; i++)
+			ws[i] = -1;
+		if ( ! fixedpool_start(ws, wsz, fds, fdsz, argv))
+			goto out;
+
+		for (i = 0; i < wsz; i++)
+			if (-1 == kill(old[i], SIGTERM))
+				syslog(LOG_ERR, "kill: "
+					"worker-%u: %m", old[i]);
+		if (draintime > 0)
+			alarm(draintime);
 	}
+out:
+	/*
+	 * Close the FastCGI file descriptors as soon as possible.
+	 */
+	sock_close(fds, fdsz);
 
 	/* Suppress child exit signals whilst we kill them. */
 	sigfp = signal(SIGCHLD, SIG_DFL);
+	alarm(0);
 
 	/*
 	 * Now wait on the children.
 	 * This can take forever, but properly-written children will
 	 * exit when receiving SIGTERM.
 	 */
-	for (i = 0; i < wsz; i++)
+	for (i = 0; i < wsz; i++) {
 		if (-1 != ws[i] && -1 == kill(ws[i], SIGTERM))
 			syslog(LOG_ERR, "kill: worker-%u: %m", ws[i]);
+		if (-1 != old[i] && -1 == kill(old[i], SIGTERM))
+			syslog(LOG_ERR, "kill: worker-%u: %m", old[i]);
+	}
 
-	for (i = 0; i < wsz; i++)
+	for (i = 0; i < wsz; i++) {
 		if (-1 != ws[i] && -1 == waitpid(ws[i], NULL, 0))
 			syslog(LOG_ERR, "wait: worker-%u: %m", ws[i]);
+		if (-1 != old[i] && -1 == waitpid(old[i], NULL, 0))
+			syslog(LOG_ERR, "wait: worker-%u: %m", old[i]);
+	}
 
 	signal(SIGCHLD, sigfp);
 
 	free(ws);
-
-	if (hup)
-		goto again;
-
-	/* 
-	 * Now we're really exiting.
-	 * Do our final cleanup if we didn't already...
-	 */
-	if (-1 != fd && -1 == close(fd))
-		syslog(LOG_ERR, "close: control: %m");
+	free(old);
 	return(1);
 }
 
 int
 main(int argc, char *argv[])
 {
-	int			  c, fd, varp, usemax, useq, nod;
+	int			  c, fd, varp, usemax, useq, nod,
+				  reuseport, useopts;
+	int			 *fds;
 	struct passwd		 *pw;
-	size_t			  i, wsz, sz, lsz, maxwsz;
-	time_t			  waittime;
+	size_t			  i, wsz, sz, lsz, maxwsz, spare, qmax,
+				  fdsz;
+	time_t			  waittime, draintime;
 	const char		 *pname, *sockpath, *chpath,
 	      			 *sockuser, *procuser, *errstr;
-	struct sockaddr_un	  sun;
-	mode_t			  old_umask;
+	char			 *tcpaddr, *host, *port, *opts, *val,
+				 *cp;
+	const char		 *statspath, *dumpfmt;
+	struct addrinfo		  hints, *res;
+	struct tcpopts		  tcpopts;
 	uid_t		 	  sockuid, procuid;
 	gid_t			  sockgid, procgid;
 	char			**nargv;
@@ -895,11 +2349,6 @@ main(int argc, char *argv[])
 	else
 		++pname;
 
-	if (0 != geteuid()) {
-		fprintf(stderr, "%s: need root privileges\n", pname);
-		return(EXIT_FAILURE);
-	}
-
 	sockuid = procuid = sockgid = procgid = -1;
 	wsz = 5;
 	usemax = useq = 0;
@@ -908,11 +2357,21 @@ main(int argc, char *argv[])
 	sockuser = procuser = NULL;
 	varp = 0;
 	nod = 0;
+	reuseport = useopts = 0;
+	tcpaddr = NULL;
+	statspath = dumpfmt = NULL;
+	memset(&tcpopts, 0, sizeof(struct tcpopts));
 	maxwsz = lsz = 0;
+	spare = 1;
+	qmax = SIZE_MAX;
 	waittime = 60 * 5;
+	draintime = 60;
 
-	while (-1 != (c = getopt(argc, argv, "l:p:n:N:s:u:U:rvdw:")))
+	while (-1 != (c = getopt(argc, argv, "a:b:l:M:m:o:p:n:N:q:s:t:u:U:Rrvdw:x:")))
 		switch (c) {
+		case ('b'):
+			tcpaddr = optarg;
+			break;
 		case ('l'):
 			useq = 1;
 			lsz = strtonum(optarg, 1, INT_MAX, &errstr);
@@ -921,6 +2380,21 @@ main(int argc, char *argv[])
 			fprintf(stderr, "-l must be "
 				"between 1 and %d\n", INT_MAX);
 			return(EXIT_FAILURE);	
+		case ('a'):
+			/* Before chroot(2): this reads sysfs. */
+			if ( ! place_init(optarg))
+				return(EXIT_FAILURE);
+			break;
+		case ('M'):
+			statspath = optarg;
+			break;
+		case ('m'):
+			spare = strtonum(optarg, 0, INT_MAX, &errstr);
+			if (NULL == errstr)
+				break;
+			fprintf(stderr, "-m must be "
+				"between 0 and %d\n", INT_MAX);
+			return(EXIT_FAILURE);	
 		case ('n'):
 			wsz = strtonum(optarg, 0, INT_MAX, &errstr);
 			if (NULL == errstr)
@@ -936,12 +2410,58 @@ main(int argc, char *argv[])
 			fprintf(stderr, "-N must be "
 				"between 0 and %d\n", INT_MAX);
 			return(EXIT_FAILURE);	
+		case ('o'):
+			opts = optarg;
+			while (NULL != (val = strsep(&opts, ","))) {
+				if (0 == strcmp(val, "nodelay")) {
+					tcpopts.nodelay = 1;
+					continue;
+				} else if (NULL == (cp = strchr(val, '='))) {
+					fprintf(stderr, "-o: %s: bad "
+						"option\n", val);
+					return(EXIT_FAILURE);
+				}
+				*cp++ = '\0';
+				c = strtonum(cp, 0, INT_MAX, &errstr);
+				if (NULL != errstr) {
+					fprintf(stderr, "-o: %s: %s\n", 
+						val, errstr);
+					return(EXIT_FAILURE);
+				}
+				if (0 == strcmp(val, "defer"))
+					tcpopts.defer = c;
+				else if (0 == strcmp(val, "sndbuf"))
+					tcpopts.sndbuf = c;
+				else if (0 == strcmp(val, "rcvbuf"))
+					tcpopts.rcvbuf = c;
+				else {
+					fprintf(stderr, "-o: %s: bad "
+						"option\n", val);
+					return(EXIT_FAILURE);
+				}
+			}
+			useopts = 1;
+			break;
 		case ('p'):
 			chpath = optarg;
 			break;	
+		case ('q'):
+			qmax = strtonum(optarg, 0, INT_MAX, &errstr);
+			if (NULL == errstr)
+				break;
+			fprintf(stderr, "-q must be "
+				"between 0 and %d\n", INT_MAX);
+			return(EXIT_FAILURE);	
 		case ('s'):
 			sockpath = optarg;
 			break;	
+		case ('t'):
+			draintime = strtonum(optarg, 0, INT_MAX, &errstr);
+			if (NULL == errstr)
+				break;
+			fprintf(stderr, "-t must be "
+				"between 0 and %d\n", INT_MAX);
+			return(EXIT_FAILURE);	
 		case ('u'):
 			sockuser = optarg;
 			break;	
@@ -951,6 +2471,9 @@ main(int argc, char *argv[])
 		case ('r'):
 			varp = 1;
 			break;	
+		case ('R'):
+			reuseport = 1;
+			break;	
 		case ('v'):
 			verbose = 1;
 			break;	
@@ -964,6 +2487,9 @@ main(int argc, char *argv[])
 			fprintf(stderr, "-w must be "
 				"between 0 and %d\n", INT_MAX);
 			return(EXIT_FAILURE);	
+		case ('x'):
+			dumpfmt = optarg;
+			break;
 		default:
 			goto usage;
 		}
@@ -971,6 +2497,19 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	/* Dumping statistics needs neither privileges nor a program. */
+	if (NULL != dumpfmt) {
+		if (NULL == statspath)
+			goto usage;
+		return(stats_dump(statspath, dumpfmt) ? 
+			EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	if (0 != geteuid()) {
+		fprintf(stderr, "%s: need root privileges\n", pname);
+		return(EXIT_FAILURE);
+	}
+
 	if (0 == argc) 
 		goto usage;
 
@@ -984,9 +2523,33 @@ main(int argc, char *argv[])
 
 	if (0 == useq)
 		lsz = (varp ? maxwsz : wsz) * 2;
+	if (SIZE_MAX == qmax)
+		qmax = maxwsz;
 
 	assert(lsz);
 
+	/* 
+	 * One socket per worker only makes sense if the workers accept
+	 * connections themselves, and UNIX sockets can't share a path.
+	 */
+	if (reuseport && (varp || NULL == tcpaddr)) {
+		fprintf(stderr, "-R requires -b and a fixed pool\n");
+		return(EXIT_FAILURE);
+	} else if (useopts && NULL == tcpaddr) {
+		fprintf(stderr, "-o requires -b\n");
+		return(EXIT_FAILURE);
+	}
+
+	/* 
+	 * Outside of the jail, like the socket.
+	 * Workers keep their slots until reaped, so leave room for
+	 * those exiting: a restarted fixed pool's old generation or a
+	 * variable pool's sloughed workers (twice the maximum).
+	 */
+	if (NULL != statspath && 
+	    ! stats_open(statspath, varp ? maxwsz * 3 : wsz * 2))
+		return(EXIT_FAILURE);
+
 	pw = NULL;
 	if (NULL != procuser && NULL == (pw = getpwnam(procuser))) { 
 		fprintf(stderr, "%s: no such user\n", procuser);
@@ -1005,59 +2568,71 @@ main(int argc, char *argv[])
 		sockgid = pw->pw_gid;
 	}
 
-	/* Do the usual dance to set up UNIX sockets. */
-	memset(&sun, 0, sizeof(sun));
-	sun.sun_family = AF_UNIX;
-	sz = strlcpy(sun.sun_path, sockpath, sizeof(sun.sun_path));
-	if (sz >= sizeof(sun.sun_path)) {
-		fprintf(stderr, "socket path to long\n");
-		return(EXIT_FAILURE);
-	}
-#ifndef __linux__
-	sun.sun_len = sz;
-#endif
-
-	/*
-	 * Prepare the socket then unlink any dead existing ones.
-	 * This is because we want to control the socket.
-	 */
-	if (-1 == (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
-		perror("socket");
-		return(EXIT_FAILURE);
-	} else if (-1 == unlink(sockpath)) {
-		if (ENOENT != errno) {
-			perror(sockpath);
-			close(fd);
+	if (NULL != tcpaddr) {
+		/*
+		 * Split "[host:]port", where the host may be in
+		 * brackets (for IPv6) and defaults to all addresses.
+		 */
+		host = NULL;
+		if (NULL != (port = strrchr(tcpaddr, ':'))) {
+			*port++ = '\0';
+			host = tcpaddr;
+			if ('[' == host[0] && 
+			    (sz = strlen(host)) > 1 && 
+			    ']' == host[sz - 1]) {
+				host[sz - 1] = '\0';
+				host++;
+			}
+			if ('\0' == host[0] || 0 == strcmp(host, "*"))
+				host = NULL;
+		} else
+			port = tcpaddr;
+
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_PASSIVE;
+		if (0 != (c = getaddrinfo(host, port, &hints, &res))) {
+			fprintf(stderr, "%s: %s\n", 
+				NULL == host ? port : host, 
+				gai_strerror(c));
 			return(EXIT_FAILURE);
 		}
-	}
-
-	old_umask = umask(S_IXUSR|S_IXGRP|S_IWOTH|S_IROTH|S_IXOTH);
-
-	/* 
-	 * Now actually bind to the FastCGI socket set up our
-	 * listeners, and make sure that we're not blocking.
-	 * If necessary, change the file's ownership.
-	 * We buffer up to the number of available workers.
-	 */
-	if (-1 == bind(fd, (struct sockaddr *)&sun, sizeof(sun))) {
-		perror("bind");
-		close(fd);
-		return(EXIT_FAILURE);
-	}
-	umask(old_umask);
 
-	if (NULL != sockuser) 
-		if (chown(sockpath, sockuid, sockgid) == -1) {
-			perror(sockpath);
+		/*
+		 * With SO_REUSEPORT, each worker has its own socket.
+		 * These are all bound now, as we'll shortly lose the
+		 * privileges to do so.
+		 */
+		fdsz = reuseport ? wsz : 1;
+		if (NULL == (fds = calloc(fdsz, sizeof(int)))) {
+			perror(NULL);
+			freeaddrinfo(res);
+			return(EXIT_FAILURE);
+		}
+		for (i = 0; i < fdsz; i++)
+			fds[i] = -1;
+		for (i = 0; i < fdsz; i++)
+			if (-1 == (fds[i] = sock_tcp(res, reuseport, &tcpopts, lsz)))
+				break;
+		freeaddrinfo(res);
+		if (i < fdsz) {
+			sock_close(fds, fdsz);
+			free(fds);
+			return(EXIT_FAILURE);
+		}
+		sockpath = NULL;
+	} else {
+		if (-1 == (fd = sock_unix(sockpath, 
+		    sockuser, sockuid, sockgid, lsz)))
+			return(EXIT_FAILURE);
+		fdsz = 1;
+		if (NULL == (fds = calloc(fdsz, sizeof(int)))) {
+			perror(NULL);
 			close(fd);
 			return(EXIT_FAILURE);
 		}
-
-	if (-1 == listen(fd, lsz)) {
-		perror(sockpath);
-		close(fd);
-		return(EXIT_FAILURE);
+		fds[0] = fd;
 	}
 
 	/* 
@@ -1065,28 +2640,34 @@ main(int argc, char *argv[])
 	 */
 	if (-1 == chroot(chpath)) {
 		perror("chroot");
-		close(fd);
+		sock_close(fds, fdsz);
+		free(fds);
 		return(EXIT_FAILURE);
 	} else if (-1 == chdir("/")) {
 		perror("chdir");
-		close(fd);
-		unlink(sockpath);
+		sock_close(fds, fdsz);
+		free(fds);
+		if (NULL != sockpath)
+			unlink(sockpath);
 		return(EXIT_FAILURE);
 	}
 
 	if (NULL != procuser)  {
 		if (0 != setgid(procgid)) {
 			perror(procuser);
-			close(fd);
+			sock_close(fds, fdsz);
+			free(fds);
 			return(EXIT_FAILURE);
 		} else if (0 != setuid(procuid)) {
 			perror(procuser);
-			close(fd);
+			sock_close(fds, fdsz);
+			free(fds);
 			return(EXIT_FAILURE);
 		} else if (-1 != setuid(0)) {
 			fprintf(stderr, "%s: managed to regain "
 				"root privileges: aborting\n", pname);
-			close(fd);
+			sock_close(fds, fdsz);
+			free(fds);
 			return(EXIT_FAILURE);
 		}
 	}
@@ -1094,7 +2675,8 @@ main(int argc, char *argv[])
 	nargv = calloc(argc + 1, sizeof(char *));
 	if (NULL == nargv) {
 		perror(NULL);
-		close(fd);
+		sock_close(fds, fdsz);
+		free(fds);
 		return(EXIT_FAILURE);
 	}
 
@@ -1103,8 +2685,10 @@ main(int argc, char *argv[])
 
 	if ( ! nod && -1 == daemon(1, 0)) {
 		perror("daemon");
-		close(fd);
-		unlink(sockpath);
+		sock_close(fds, fdsz);
+		free(fds);
+		if (NULL != sockpath)
+			unlink(sockpath);
 		free(nargv);
 		return(EXIT_FAILURE);
 	} 
@@ -1115,19 +2699,33 @@ main(int argc, char *argv[])
 		openlog(pname, LOG_PID, LOG_DAEMON);
 
 	c = varp ?
-		varpool(wsz, maxwsz, waittime, fd, sockpath, nargv) :
-		fixedpool(wsz, fd, sockpath, nargv);
+		varpool(wsz, maxwsz, spare, qmax, 
+			waittime, draintime, fds[0], sockpath, nargv) :
+		fixedpool(wsz, draintime, fds, fdsz, sockpath, nargv);
 
+	free(fds);
 	free(nargv);
 	return(c ? EXIT_SUCCESS : EXIT_FAILURE);
 usage:
 	fprintf(stderr, "usage: %s "
+		"[-dRrv] "
+		"[-a placement] "
+		"[-b [host:]port] "
 		"[-l backlog] "
+		"[-M statsfile] "
+		"[-m spare] "
 		"[-n workers] "
+		"[-N maxworkers] "
+		"[-o opts] "
 		"[-p chroot] "
+		"[-q queue] "
 		"[-s sockpath] "
+		"[-t draintime] "
 		"[-u sockuser] "
 		"[-U procuser] "
-		"-- prog [arg1...]\n", pname);
+		"[-w waittime] "
+		"-- prog [arg1...]\n"
+		"       %s -M statsfile -x format\n", 
+		pname, pname);
 	return(EXIT_FAILURE);
 }
@@ -16,16 +16,23 @@
  */
 #include "config.h"
 
+#include <sys/types.h>
+
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "kcgi.h"
+#include "extern.h"
 
 enum	llevel {
 	LLEVEL_INFO,
@@ -40,86 +47,483 @@ static	const char *llevels[LLEVEL__MAX] = {
 	"ERROR", /* LLEVEL_ERROR */
 };
 
+#define	LOGBUFSZ (64 * 1024)
+
 /*
- * Actual logging function.
- * This works best if stderr is line buffered, otherwise we may clobber
- * other message who are writing at the same time.
- * All strings are trusted to have "good" characters except for the
- * variable array, which may contain anything and is filtered.
- *
- * FIXME: don't use fixed-length buffer.
- * FIXME: don't trust "lvl" and "ident".
+ * Log lines are queued in a per-process buffer and written to stderr
+ * only when it won't block, so a slow log pipe never stalls a request.
+ * Queued lines are written at once unless we're batching, in which case
+ * they're written when the buffer is half full, when the oldest line is
+ * a second old, on kutil_logflush(), or on exit.
+ * Lines left over are retried with the next line and at request
+ * boundaries, FastCGI workers waiting for a request waking up to do so
+ * (see klogbuf_idle()).
+ * If the buffer fills, new lines are dropped and counted.
+ */
+struct	logbuf {
+	char		 buf[LOGBUFSZ];
+	size_t		 head; /* first unwritten byte */
+	size_t		 tail; /* end of queued bytes */
+	size_t		 dropped; /* lines dropped since last queued */
+	pid_t		 pid; /* owning process */
+	time_t		 since; /* when head was queued */
+	int		 exitreg; /* registered atexit(3) handler */
+	enum klogfmt	 fmt; /* line format */
+	unsigned int	 flags; /* KLOG_xxx flags */
+	time_t		 datesec; /* second of "date" or -1 */
+	char		 date[64]; /* cached date for "fmt" */
+	char		*msg; /* formatted message scratch */
+	size_t		 msgsz; /* size of "msg" */
+};
+
+static	struct logbuf lb = { .datesec = -1 };
+
+/*
+ * Write as much of the queue as we can.
+ * Unless "block" is set, only write when the descriptor is ready and at
+ * most PIPE_BUF at a time, which a ready pipe accepts in full.
+ * A process that inherited the queue across fork(2) discards it.
  */
 static void
-logmsg(const struct kreq *r, const char *err, const char *lvl, 
-	const char *ident, const char *fmt, va_list ap)
+logbuf_flush(int block)
 {
-	int		 i, sz;
-	char		 date[64];
-	char		 msg[1024];
+	struct pollfd	 pfd;
+	ssize_t		 ssz;
+	size_t		 sz;
+	int		 er = errno;
+
+	if (lb.pid != getpid()) {
+		lb.pid = getpid();
+		lb.head = lb.tail = lb.dropped = 0;
+		return;
+	}
 
-	/* 
-	 * Convert to GMT.
-	 * We can't use localtime because we're probably going to be
-	 * chrooted, and maybe sandboxed, and touching our timezone
-	 * files will crash us (or at least not be applicable).
-	 */
+	/* Keep the order of stdio(3) writes to stderr. */
 
-	kutil_epoch2str(time(NULL), date, sizeof(date));
+	fflush(stderr);
+	pfd.fd = fileno(stderr);
+	pfd.events = POLLOUT;
 
-	/* Everything up to the message itself. */
+	while (lb.head < lb.tail) {
+		sz = lb.tail - lb.head;
+		if ( ! block) {
+			if (poll(&pfd, 1, 0) <= 0 || 
+			    ! (POLLOUT & pfd.revents))
+				break;
+			if (sz > PIPE_BUF)
+				sz = PIPE_BUF;
+		}
+		if ((ssz = write(pfd.fd, lb.buf + lb.head, sz)) < 0) {
+			if (EINTR == errno)
+				continue;
+			if (EAGAIN != errno)
+				lb.head = lb.tail;
+			break;
+		}
+		lb.head += ssz;
+	}
 
-	fprintf(stderr, "%s %s [%s] %s ", r->remote, 
-		NULL == ident ? "-" : ident, date, 
-		NULL == lvl ? "-" : lvl);
+	if (lb.head == lb.tail)
+		lb.head = lb.tail = 0;
+	lb.since = time(NULL);
+	errno = er;
+}
 
-	/*
-	 * Now format the message itself.
-	 * Assume that the message is UNTRUSTED, and filter the contents
-	 * of each character to see if it's a valid printable.
-	 */
+static void
+logbuf_exit(void)
+{
 
-	sz = vsnprintf(msg, sizeof(msg), fmt, ap);
-	for (i = 0; i < sz; i++)
-		switch (msg[i]) {
+	logbuf_flush(1);
+}
+
+/*
+ * Append to the line begun at "start", noting an overflow by moving
+ * the tail past the buffer.
+ */
+static void
+logbuf_put(const char *cp, size_t sz)
+{
+
+	if (lb.tail > LOGBUFSZ || LOGBUFSZ - lb.tail < sz) {
+		lb.tail = LOGBUFSZ + 1;
+		return;
+	}
+	memcpy(lb.buf + lb.tail, cp, sz);
+	lb.tail += sz;
+}
+
+static void
+logbuf_puts(const char *cp)
+{
+
+	logbuf_put(cp, strlen(cp));
+}
+
+/*
+ * Append a string of UNTRUSTED contents, escaping it for the format.
+ * Text has control characters escaped or replaced with a question mark;
+ * logfmt and JSON are quoted, JSON escaping as in RFC 8259, section 7,
+ * and passing through bytes of multi-byte (UTF-8) characters.
+ */
+static void
+logbuf_putesc(const char *cp)
+{
+	char	 buf[8];
+
+	if (KLOGFMT_TEXT != lb.fmt)
+		logbuf_put("\"", 1);
+
+	for ( ; '\0' != *cp; cp++)
+		switch (*cp) {
 		case ('\n'):
-			fputs("\\n", stderr);
+			logbuf_put("\\n", 2);
 			break;
 		case ('\r'):
-			fputs("\\r", stderr);
+			logbuf_put("\\r", 2);
 			break;
 		case ('\t'):
-			fputs("\\t", stderr);
+			logbuf_put("\\t", 2);
+			break;
+		case ('"'):
+		case ('\\'):
+			if (KLOGFMT_TEXT != lb.fmt)
+				logbuf_put("\\", 1);
+			logbuf_put(cp, 1);
 			break;
 		default:
-			if (isprint((unsigned char)msg[i]))
-				fputc(msg[i], stderr);
-			else
-				fputc('?', stderr);
+			if (isprint((unsigned char)*cp))
+				logbuf_put(cp, 1);
+			else if (KLOGFMT_JSON == lb.fmt &&
+			    (unsigned char)*cp >= 0x80)
+				logbuf_put(cp, 1);
+			else if (KLOGFMT_JSON == lb.fmt) {
+				snprintf(buf, sizeof(buf), 
+					"\\u%.4x", (unsigned char)*cp);
+				logbuf_put(buf, 6);
+			} else
+				logbuf_put("?", 1);
 			break;
 		}
 
+	if (KLOGFMT_TEXT != lb.fmt)
+		logbuf_put("\"", 1);
+}
+
+/*
+ * Begin a structured field "key" (not for text output).
+ */
+static void
+logbuf_key(const char *key, int first)
+{
+
+	if (KLOGFMT_JSON == lb.fmt) {
+		logbuf_puts(first ? "{\"" : ",\"");
+		logbuf_puts(key);
+		logbuf_puts("\":");
+	} else {
+		if ( ! first)
+			logbuf_put(" ", 1);
+		logbuf_puts(key);
+		logbuf_put("=", 1);
+	}
+}
+
+/*
+ * Begin a line with the date, remote address, identifier, and level.
+ * The date is cached and only reformatted when the second changes.
+ * Convert to GMT.
+ * We can't use localtime because we're probably going to be chrooted,
+ * and maybe sandboxed, and touching our timezone files will crash us
+ * (or at least not be applicable).
+ */
+static size_t
+logbuf_begin(const char *remote, const char *ident, const char *lvl)
+{
+	size_t	 start;
+	time_t	 t;
+
+	if (lb.pid != getpid())
+		logbuf_flush(0);
+	if (lb.head > 0 && lb.head < lb.tail) {
+		memmove(lb.buf, lb.buf + lb.head, lb.tail - lb.head);
+		lb.tail -= lb.head;
+		lb.head = 0;
+	}
+	if (0 == lb.tail)
+		lb.since = time(NULL);
+	start = lb.tail;
+
+	if ((t = time(NULL)) != lb.datesec) {
+		if (KLOGFMT_TEXT == lb.fmt)
+			kutil_epoch2str(t, lb.date, sizeof(lb.date));
+		else
+			kutil_epoch2utcstr(t, lb.date, sizeof(lb.date));
+		lb.datesec = t;
+	}
+
+	if (NULL == remote)
+		remote = "-";
+	if (NULL == ident)
+		ident = "-";
+	if (NULL == lvl)
+		lvl = "-";
+
+	if (KLOGFMT_TEXT == lb.fmt) {
+		logbuf_puts(remote);
+		logbuf_put(" ", 1);
+		logbuf_puts(ident);
+		logbuf_puts(" [");
+		logbuf_puts(lb.date);
+		logbuf_puts("] ");
+		logbuf_puts(lvl);
+		logbuf_put(" ", 1);
+		return(start);
+	}
+
+	logbuf_key("time", 1);
+	logbuf_putesc(lb.date);
+	logbuf_key("remote", 0);
+	logbuf_putesc(remote);
+	logbuf_key("ident", 0);
+	logbuf_putesc(ident);
+	logbuf_key("level", 0);
+	logbuf_putesc(lvl);
+	return(start);
+}
+
+/*
+ * Terminate the line begun at "start" and queue it, or drop it if it
+ * overflowed the buffer.
+ * Then write out what we can.
+ */
+static void
+logbuf_end(size_t start)
+{
+
+	if (KLOGFMT_JSON == lb.fmt)
+		logbuf_put("}", 1);
+	logbuf_put("\n", 1);
+
+	if (lb.tail > LOGBUFSZ) {
+		lb.tail = start;
+		lb.dropped++;
+	}
+
+	if ( ! lb.exitreg) {
+		lb.pid = getpid();
+		lb.exitreg = 1;
+		atexit(logbuf_exit);
+	}
+
+	if ( ! (KLOG_BATCH & lb.flags) || 
+	    lb.tail - lb.head > LOGBUFSZ / 2 || 
+	    time(NULL) > lb.since)
+		logbuf_flush(0);
+}
+
+/*
+ * Called between requests: write out queued lines that are due without
+ * blocking.
+ * Returns zero if nothing is left queued or the number of seconds after
+ * which to call again, which callers about to wait for a request
+ * should use as their timeout.
+ */
+int
+klogbuf_idle(void)
+{
+
+	if (lb.head == lb.tail)
+		return(0);
+	if ( ! (KLOG_BATCH & lb.flags) || 
+	    lb.tail - lb.head > LOGBUFSZ / 2 || 
+	    time(NULL) > lb.since)
+		logbuf_flush(0);
+	return(lb.head == lb.tail ? 0 : 1);
+}
+
+/*
+ * Note lines dropped because the buffer was full.
+ */
+static void
+logbuf_dropped(void)
+{
+	char	 buf[64];
+	size_t	 start, dropped = lb.dropped;
+
+	start = logbuf_begin(NULL, NULL, llevels[LLEVEL_WARN]);
+	snprintf(buf, sizeof(buf), 
+		"%zu log messages dropped", dropped);
+	if (KLOGFMT_TEXT != lb.fmt)
+		logbuf_key("msg", 0);
+	logbuf_putesc(buf);
+	logbuf_end(start);
+	if (lb.dropped == dropped)
+		lb.dropped = 0;
+}
+
+/*
+ * Actual logging function.
+ * All strings are trusted to have "good" characters except for the
+ * variable array, which may contain anything and is filtered.
+ *
+ * FIXME: don't trust "lvl" and "ident".
+ */
+static void
+logmsg(const struct kreq *r, const char *err, const char *lvl, 
+	const char *ident, const char *fmt, va_list ap)
+{
+	int		 er = errno, sz;
+	size_t		 start;
+	char		*cp;
+	va_list		 aq;
+
+	if (lb.dropped)
+		logbuf_dropped();
+
+	/* 
+	 * Format the message itself into our scratch buffer, growing
+	 * it if it doesn't fit.
+	 */
+
+	va_copy(aq, ap);
+	sz = vsnprintf(lb.msg, lb.msgsz, fmt, aq);
+	va_end(aq);
+	if (sz < 0) {
+		errno = er;
+		return;
+	} else if ((size_t)sz >= lb.msgsz) {
+		if (NULL == (cp = realloc(lb.msg, sz + 1))) {
+			errno = er;
+			return;
+		}
+		lb.msg = cp;
+		lb.msgsz = sz + 1;
+		vsnprintf(lb.msg, lb.msgsz, fmt, ap);
+	}
+
+	start = logbuf_begin(NULL == r ? NULL : r->remote, ident, lvl);
+	if (KLOGFMT_TEXT != lb.fmt)
+		logbuf_key("msg", 0);
+	logbuf_putesc(lb.msg);
+
 	/*
 	 * Emit the system error message, if applicable.
 	 */
 
 	if (NULL != err) {
-		fputs(": ", stderr);
-		fputs(err, stderr);
+		if (KLOGFMT_TEXT == lb.fmt)
+			logbuf_puts(": ");
+		else
+			logbuf_key("error", 0);
+		logbuf_putesc(err);
 	}
 
-	fputc('\n', stderr);
+	logbuf_end(start);
+	errno = er;
 }
 
 int
 kutil_openlog(const char *file)
 {
 
+	return(kutil_openlogx(file, KLOGFMT_TEXT, 0));
+}
+
+int
+kutil_openlogx(const char *file, enum klogfmt fmt, unsigned int flags)
+{
+
+	logbuf_flush(1);
+	lb.fmt = fmt;
+	lb.flags = flags;
+	lb.datesec = -1;
+
 	if (NULL != file && NULL == freopen(file, "a", stderr))
 		return(0);
 	return(EOF != setvbuf(stderr, NULL, _IOLBF, 0));
 }
 
+void
+kutil_logflush(void)
+{
+
+	logbuf_flush(0);
+}
+
+/*
+ * Log the request's method, path, response status, bytes written, and
+ * timing as an access log line.
+ * This should be called before khttp_free(3).
+ */
+void
+kutil_logaccess(const struct kreq *r)
+{
+	char		 buf[64];
+	const char	*meth;
+	uint64_t	 bytes;
+	int		 status, er = errno;
+	size_t		 start;
+	double		 parse, total;
+
+	if (lb.dropped)
+		logbuf_dropped();
+
+	status = NULL == r->kdata ? 0 : kdata_status(r->kdata, &bytes);
+	if (0 == status)
+		status = 200;
+	if (NULL == r->kdata)
+		bytes = 0;
+	meth = r->method < KMETHOD__MAX ? kmethods[r->method] : "-";
+	parse = khttp_timing(r, KTIME_START, KTIME_RECV);
+	total = 0 == r->timing[KTIME_START] ? -1.0 :
+		(kstats_ns() - r->timing[KTIME_START]) / 1000000000.0;
+
+	start = logbuf_begin(r->remote, NULL, llevels[LLEVEL_INFO]);
+
+	if (KLOGFMT_TEXT == lb.fmt) {
+		logbuf_put("\"", 1);
+		logbuf_puts(meth);
+		logbuf_put(" ", 1);
+		logbuf_putesc(NULL == r->fullpath ? "" : r->fullpath);
+		snprintf(buf, sizeof(buf), "\" %d %" PRIu64, status, bytes);
+		logbuf_puts(buf);
+		if (parse >= 0.0) {
+			snprintf(buf, sizeof(buf), " parse=%.3f", parse * 1000.0);
+			logbuf_puts(buf);
+		}
+		if (total >= 0.0) {
+			snprintf(buf, sizeof(buf), " total=%.3f", total * 1000.0);
+			logbuf_puts(buf);
+		}
+		logbuf_end(start);
+		errno = er;
+		return;
+	}
+
+	logbuf_key("method", 0);
+	logbuf_putesc(meth);
+	logbuf_key("path", 0);
+	logbuf_putesc(NULL == r->fullpath ? "" : r->fullpath);
+	logbuf_key("status", 0);
+	snprintf(buf, sizeof(buf), "%d", status);
+	logbuf_puts(buf);
+	logbuf_key("bytes", 0);
+	snprintf(buf, sizeof(buf), "%" PRIu64, bytes);
+	logbuf_puts(buf);
+	if (parse >= 0.0) {
+		logbuf_key("parse_ms", 0);
+		snprintf(buf, sizeof(buf), "%.3f", parse * 1000.0);
+		logbuf_puts(buf);
+	}
+	if (total >= 0.0) {
+		logbuf_key("total_ms", 0);
+		snprintf(buf, sizeof(buf), "%.3f", total * 1000.0);
+		logbuf_puts(buf);
+	}
+	logbuf_end(start);
+	errno = er;
+}
+
 void
 kutil_vlog(const struct kreq *r, const char *lvl,
 	const char *ident, const char *fmt, va_list ap)
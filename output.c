@@ -21,11 +21,17 @@
 #include <assert.h>
 #include <ctype.h>
 #include <inttypes.h>
+#if HAVE_MD5
+# include <sys/types.h>
+# include <md5.h>
+#endif
+#include <poll.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #if HAVE_ZLIB
 # include <zlib.h>
@@ -33,6 +39,8 @@
 
 #include "kcgi.h"
 #include "extern.h"
+#include "hash.h"
+#include "stats.h"
 
 /*
  * The state of our HTTP response.
@@ -46,6 +54,18 @@ enum	kstate {
 	KSTATE_BODY
 };
 
+/*
+ * State of the automatic ETag (see KOPT_ETAG).
+ * While computing it, the headers and body are held in the output
+ * buffer so that the ETag header can be added (or the response replaced
+ * with a 304) once the body is complete.
+ */
+enum	ketag {
+	KETAG_NONE = 0, /* not computing */
+	KETAG_HEAD, /* holding headers */
+	KETAG_BODY /* holding headers and hashing body */
+};
+
 /*
  * Interior data.
  * This is used for managing HTTP compression.
@@ -58,6 +78,7 @@ struct	kdata {
 	size_t		 linebufpos; /* output line buffer */
 	size_t		 linebufsz;
 	uint64_t	 bytes; /* total bytes written */
+	int		 status; /* HTTP status or 0 if not set */
 	uint16_t	 requestId; /* current requestId or 0 */
 	enum kstate	 state;
 #if HAVE_ZLIB
@@ -66,6 +87,32 @@ struct	kdata {
 	char		*outbuf;
 	size_t		 outbufpos;
 	size_t		 outbufsz;
+	volatile struct kstats_slot *stats; /* kfcgi(8) statistics */
+	unsigned int	 flags; /* from struct kopts */
+	uint64_t	*timing; /* "timing" of struct kreq */
+	enum ketag	 etag;
+	char		*inm; /* If-None-Match or NULL */
+	size_t		 bodypos; /* start of held body in outbuf */
+	struct kxxh64	 hash; /* of held body */
+	int		 gzwant; /* compression deferred */
+};
+
+/*
+ * Phases reported in the Server-Timing header and timing debug line,
+ * each running from the first to the second moment.
+ */
+static	const struct ktimephase {
+	const char	*name;
+	enum ktime	 from;
+	enum ktime	 to;
+} ktimephases[] = {
+	{ "env", KTIME_START, KTIME_ENV },
+	{ "body", KTIME_ENV, KTIME_BODY },
+	{ "parse", KTIME_BODY, KTIME_PARSE },
+	{ "recv", KTIME_PARSE, KTIME_RECV },
+	{ "app", KTIME_RECV, KTIME_HEAD },
+	{ "flush", KTIME_HEAD, KTIME_DONE },
+	{ NULL, KTIME__MAX, KTIME__MAX }
 };
 
 static char *
@@ -126,6 +173,8 @@ fcgi_write(uint8_t type, const struct kdata *p, const char *buf, size_t sz)
 			(type, p->requestId, rsz, paddingLength), 8);
 		fullwritenoerr(p->fcgi, buf, rsz);
 		fullwritenoerr(p->fcgi, padding, paddingLength);
+		if (NULL != p->stats)
+			p->stats->bytesout += 8 + rsz + paddingLength;
 		sz -= rsz;
 		buf += rsz;
 	} while (sz > 0);
@@ -198,6 +247,161 @@ kdata_drain(struct kdata *p)
 	p->outbufpos = 0;
 }
 
+/*
+ * Open the compressed stream on standard output.
+ * Return whether we did so.
+ */
+static int
+kdata_gzopen(struct kdata *p)
+{
+
+#if HAVE_ZLIB
+	assert(NULL == p->gz);
+	p->gz = gzdopen(STDOUT_FILENO, "w");
+	if (NULL == p->gz)
+		XWARN("gzdopen");
+	return(NULL != p->gz);
+#else
+	return(0);
+#endif
+}
+
+/*
+ * Stop computing the ETag.
+ * Headers are held in the output buffer as usual, so there's only
+ * something to do once the body has begun: flush the held headers,
+ * start any deferred compression, then flush the held body.
+ */
+static void
+kdata_etag_release(struct kdata *p)
+{
+
+	if (KETAG_BODY == p->etag) {
+		p->state = KSTATE_HEAD;
+		kdata_flush(p, p->outbuf, p->bodypos);
+		p->state = KSTATE_BODY;
+		if (p->gzwant)
+			kdata_gzopen(p);
+		p->gzwant = 0;
+		kdata_flush(p, p->outbuf + p->bodypos, 
+			p->outbufpos - p->bodypos);
+		p->outbufpos = 0;
+	}
+	p->etag = KETAG_NONE;
+	free(p->inm);
+	p->inm = NULL;
+}
+
+/*
+ * See whether the If-None-Match list "inm" has the quoted "etag" of
+ * size "sz" using the weak comparison of RFC 7232 section 2.3.2.
+ */
+static int
+kdata_etag_match(const char *inm, const char *etag, size_t sz)
+{
+	const char	*end;
+
+	while ('\0' != *inm) {
+		if (' ' == *inm || '\t' == *inm || ',' == *inm) {
+			inm++;
+			continue;
+		} else if ('*' == *inm)
+			return(1);
+		if (0 == strncmp(inm, "W/", 2))
+			inm += 2;
+		if ('"' != *inm || NULL == (end = strchr(inm + 1, '"')))
+			return(0);
+		end++;
+		if ((size_t)(end - inm) == sz && 0 == memcmp(inm, etag, sz))
+			return(1);
+		inm = end;
+	}
+	return(0);
+}
+
+/*
+ * The body is complete and held in the output buffer.
+ * Add the ETag header and flush everything or, if the client's
+ * If-None-Match has it, replace the response with a 304 and no body.
+ * Only successful responses get an ETag.
+ * The ETag is of the uncompressed body, so it's marked if compressed.
+ */
+static void
+kdata_etag_finish(struct kdata *p)
+{
+	char		 line[64], status[64];
+	char		*cp, *nl, *end;
+	size_t		 bodysz, sz, linesz;
+
+	if (0 != p->status && 200 != p->status) {
+		kdata_etag_release(p);
+		return;
+	}
+
+	/* The header and the blank line ending the headers. */
+
+	bodysz = p->outbufpos - p->bodypos;
+	linesz = snprintf(line, sizeof(line), 
+		"ETag: \"%016" PRIx64 "-%zx%s\"\r\n\r\n",
+		kxxh64_final(&p->hash), bodysz, p->gzwant ? "-gzip" : "");
+
+	end = p->outbuf + p->bodypos - 2;
+	p->state = KSTATE_HEAD;
+
+	if (NULL != p->inm && 
+	    kdata_etag_match(p->inm, line + 6, linesz - 10)) {
+		/* Strip the status, which we replace. */
+		sz = strlen(kresps[KRESP_STATUS]);
+		for (cp = p->outbuf; cp < end; cp = nl) {
+			nl = memchr(cp, '\n', end - cp);
+			nl = NULL == nl ? end : nl + 1;
+			if ((size_t)(nl - cp) <= sz || ':' != cp[sz] ||
+			    strncasecmp(cp, kresps[KRESP_STATUS], sz))
+				continue;
+			memmove(cp, nl, end - nl);
+			p->bytes -= nl - cp;
+			end -= nl - cp;
+			nl = cp;
+		}
+		sz = snprintf(status, sizeof(status), "%s: %s\r\n",
+			kresps[KRESP_STATUS], khttps[KHTTP_304]);
+		kdata_flush(p, status, sz);
+		p->bytes += sz;
+		p->bytes -= bodysz;
+		p->status = 304;
+		p->gzwant = 0;
+		bodysz = 0;
+	}
+
+	kdata_flush(p, p->outbuf, end - p->outbuf);
+	kdata_flush(p, line, linesz);
+	p->bytes += linesz - 2;
+	p->state = KSTATE_BODY;
+
+	if (p->gzwant)
+		kdata_gzopen(p);
+	p->gzwant = 0;
+	kdata_flush(p, p->outbuf + p->bodypos, bodysz);
+	p->outbufpos = 0;
+	p->etag = KETAG_NONE;
+}
+
+/*
+ * Tell the output whether the request may have an automatic ETag and,
+ * if so, the If-None-Match header (or NULL) to check against.
+ */
+void
+kdata_etag(struct kdata *p, int use, const char *inm)
+{
+
+	if (KETAG_NONE == p->etag)
+		return;
+	if ( ! use)
+		kdata_etag_release(p);
+	else if (NULL != inm && NULL == (p->inm = XSTRDUP(inm)))
+		kdata_etag_release(p);
+}
+
 /*
  * In this function, we handle arbitrary writes of data to the output.
  * In the event of CGI, this will be to stdout; in the event of FastCGI,
@@ -217,6 +421,8 @@ kdata_write(struct kdata *p, const char *buf, size_t sz)
 	if (0 == sz || NULL == buf)
 		return;
 
+	p->bytes += sz;
+
 	/*
 	 * We want to debug writes.
 	 * To do so, we write into a line buffer.
@@ -225,7 +431,7 @@ kdata_write(struct kdata *p, const char *buf, size_t sz)
 	 */
 	if (KREQ_DEBUG_WRITE & p->debugging) {
 		linebuf_init(p);
-		for (i = 0; i < sz; i++, p->bytes++) {
+		for (i = 0; i < sz; i++) {
 			if (p->linebufpos + 4 >= p->linebufsz)
 				linebuf_flush(p, 1);
 			if (isprint((unsigned char)buf[i]) || '\n' == buf[i]) {
@@ -256,6 +462,22 @@ kdata_write(struct kdata *p, const char *buf, size_t sz)
 		}
 	}
 
+	/*
+	 * If computing the ETag, hold everything in the output buffer
+	 * (hashing the body) unless it won't fit, in which case give up
+	 * and write out as usual.
+	 */
+	if (KETAG_NONE != p->etag) {
+		if (p->outbufpos + sz <= p->outbufsz) {
+			memcpy(p->outbuf + p->outbufpos, buf, sz);
+			p->outbufpos += sz;
+			if (KETAG_BODY == p->etag)
+				kxxh64_update(&p->hash, buf, sz);
+			return;
+		}
+		kdata_etag_release(p);
+	}
+
 	/* 
 	 * Short-circuit: if we have no output buffer, flush directly to
 	 * the wire.
@@ -301,6 +523,54 @@ khttp_write(struct kreq *req, const char *buf, size_t sz)
 	kdata_write(req->kdata, buf, sz);
 }
 
+/*
+ * Push everything we've buffered (including any compressed data held
+ * by zlib) to the wire, blocking until it's written.
+ */
+void
+khttp_flush(struct kreq *req)
+{
+	struct kdata	*p = req->kdata;
+
+	assert(NULL != p);
+	kdata_etag_release(p);
+	kdata_drain(p);
+#if HAVE_ZLIB
+	if (NULL != p->gz && KSTATE_HEAD != p->state)
+		if (Z_OK != gzflush(p->gz, Z_SYNC_FLUSH))
+			XWARNX("gzflush");
+#endif
+}
+
+/*
+ * See whether the wire (stdout for CGI, the socket for FastCGI) will
+ * accept data, waiting up to "timeout" milliseconds (or forever if
+ * negative) as with poll(2).
+ * Returns 1 if writable, 0 if not (would block), or -1 if the peer has
+ * gone away or an error occurred.
+ */
+int
+khttp_writable(struct kreq *req, int timeout)
+{
+	struct kdata	*p = req->kdata;
+	struct pollfd	 pfd;
+	int		 rc;
+
+	assert(NULL != p);
+	pfd.fd = -1 == p->fcgi ? STDOUT_FILENO : p->fcgi;
+	pfd.events = POLLOUT;
+
+	if ((rc = poll(&pfd, 1, timeout)) < 0) {
+		XWARN("poll: %d, POLLOUT", pfd.fd);
+		return(-1);
+	} else if (0 == rc)
+		return(0);
+
+	if ((POLLHUP | POLLERR | POLLNVAL) & pfd.revents)
+		return(-1);
+	return(POLLOUT & pfd.revents ? 1 : 0);
+}
+
 void
 khttp_puts(struct kreq *req, const char *cp)
 {
@@ -333,19 +603,115 @@ khttp_head(struct kreq *req, const char *key, const char *fmt, ...)
 	va_start(ap, fmt);
 	vsnprintf(buf, sizeof(buf), fmt, ap);
 	va_end(ap);
+	if (0 == strcasecmp(key, kresps[KRESP_STATUS]))
+		req->kdata->status = atoi(buf);
+	else if (0 == strcasecmp(key, kresps[KRESP_ETAG]))
+		kdata_etag_release(req->kdata);
 	kdata_write(req->kdata, key, strlen(key));
 	kdata_write(req->kdata, ": ", 2);
 	kdata_write(req->kdata, buf, strlen(buf));
 	kdata_write(req->kdata, "\r\n", 2);
 }
 
+/*
+ * Seconds between two moments of "timing", or -1 if either has not
+ * been recorded.
+ */
+static double
+ktime_diff(const uint64_t *timing, enum ktime from, enum ktime to)
+{
+
+	if (0 == timing[from] || 0 == timing[to])
+		return(-1.0);
+	if (timing[to] < timing[from])
+		return(0.0);
+	return((timing[to] - timing[from]) / 1000000000.0);
+}
+
+double
+khttp_timing(const struct kreq *req, enum ktime from, enum ktime to)
+{
+
+	if (from >= KTIME__MAX || to >= KTIME__MAX)
+		return(-1.0);
+	return(ktime_diff(req->timing, from, to));
+}
+
+/*
+ * Write the Server-Timing header (in milliseconds) for those phases
+ * complete when the headers are flushed.
+ */
+static void
+kdata_servertiming(struct kdata *p)
+{
+	const struct ktimephase *ph;
+	char		 buf[64];
+	double		 d;
+	int		 first = 1;
+
+	for (ph = ktimephases; NULL != ph->name; ph++) {
+		if (KTIME_HEAD < ph->to)
+			continue;
+		if ((d = ktime_diff(p->timing, ph->from, ph->to)) < 0.0)
+			continue;
+		snprintf(buf, sizeof(buf), "%s%s;dur=%.3f", 
+			first ? "Server-Timing: " : ", ", 
+			ph->name, d * 1000.0);
+		kdata_write(p, buf, strlen(buf));
+		first = 0;
+	}
+	if ( ! first)
+		kdata_write(p, "\r\n", 2);
+}
+
+/*
+ * Mark the request as drained and optionally log its timings as a line
+ * of key-value pairs (in milliseconds).
+ */
+static void
+kdata_done(struct kdata *p)
+{
+	const struct ktimephase *ph;
+	double		 d;
+
+	if (NULL == p->timing)
+		return;
+	p->timing[KTIME_DONE] = kstats_ns();
+	if ( ! (KREQ_DEBUG_TIMING & p->debugging))
+		return;
+
+	fprintf(stderr, "%u: timing", getpid());
+	for (ph = ktimephases; NULL != ph->name; ph++)
+		if ((d = ktime_diff(p->timing, ph->from, ph->to)) >= 0.0)
+			fprintf(stderr, " %s=%.3f", ph->name, d * 1000.0);
+	if ((d = ktime_diff(p->timing, KTIME_START, KTIME_DONE)) >= 0.0)
+		fprintf(stderr, " total=%.3f", d * 1000.0);
+	fputs(" ms\n", stderr);
+	fflush(stderr);
+}
+
+/*
+ * Return the HTTP status set with khttp_head(3), or zero if none, and
+ * fill in the total bytes written so far.
+ */
+int
+kdata_status(const struct kdata *p, uint64_t *bytes)
+{
+
+	*bytes = p->bytes;
+	return(p->status);
+}
+
 /*
  * Allocate our output data.
  * We accept the file descriptor for the FastCGI stream, if there's any.
+ * If "timing" is not NULL, we record when headers are flushed and when
+ * output is drained into it.
  */
 struct kdata *
 kdata_alloc(int control, int fcgi, uint16_t requestId, 
-	unsigned int debugging, const struct kopts *opts)
+	unsigned int debugging, const struct kopts *opts,
+	volatile struct kstats_slot *stats, uint64_t *timing)
 {
 	struct kdata	*p;
 
@@ -356,6 +722,9 @@ kdata_alloc(int control, int fcgi, uint16_t requestId,
 	p->fcgi = fcgi;
 	p->control = control;
 	p->requestId = requestId;
+	p->stats = stats;
+	p->flags = opts->flags;
+	p->timing = timing;
 
 	if (opts->sndbufsz > 0) {
 		p->outbufsz = opts->sndbufsz;
@@ -363,6 +732,8 @@ kdata_alloc(int control, int fcgi, uint16_t requestId,
 			free(p);
 			return(NULL);
 		}
+		if (KOPT_ETAG & p->flags)
+			p->etag = KETAG_HEAD;
 	} 
 
 	return(p);
@@ -382,6 +753,11 @@ kdata_free(struct kdata *p, int flush)
 	if (NULL == p)
 		return;
 
+	/* A response held for its ETag. */
+	if (flush && KETAG_BODY == p->etag)
+		kdata_etag_finish(p);
+	free(p->inm);
+
 	/* Debugging messages. */
 	if (flush && KREQ_DEBUG_WRITE & p->debugging) {
 		if (p->linebufpos > 0)
@@ -413,6 +789,8 @@ kdata_free(struct kdata *p, int flush)
 		gzclose(p->gz);
 #endif
 	if (-1 == p->fcgi) {
+		if (flush)
+			kdata_done(p);
 		free(p);
 		return;
 	}
@@ -431,8 +809,16 @@ kdata_free(struct kdata *p, int flush)
 		memcpy(buf, &appStatus, sizeof(uint32_t));
 		/* End of request. */
 		fcgi_write(3, p, buf, 8);
+		kdata_done(p);
 		/* Close out. */
 		close(p->fcgi);
+		if (NULL != p->stats) {
+			p->stats->handlens += 
+				kstats_ns() - p->stats->mark;
+			p->stats->requests++;
+			p->stats->last = time(NULL);
+			p->stats->state = KSTATS_IDLE;
+		}
 		fullwrite(p->control, &p->requestId, sizeof(uint16_t));
 		p->control = -1;
 		p->fcgi = -1;
@@ -459,11 +845,16 @@ kdata_compress(struct kdata *p)
 #if HAVE_ZLIB
 	if (-1 != p->fcgi)
 		return(0);
-	assert(NULL == p->gz);
-	p->gz = gzdopen(STDOUT_FILENO, "w");
-	if (NULL == p->gz)
-		XWARN("gzdopen");
-	return(NULL != p->gz);
+
+	/*
+	 * If holding the response for its ETag, open the stream only
+	 * once we know there's a body to compress.
+	 */
+	if (KETAG_NONE != p->etag) {
+		p->gzwant = 1;
+		return(1);
+	}
+	return(kdata_gzopen(p));
 #else
 	return(0);
 #endif
@@ -478,7 +869,24 @@ kdata_body(struct kdata *p)
 
 	assert(p->state == KSTATE_HEAD);
 
+	if (NULL != p->timing && KOPT_SERVER_TIMING & p->flags) {
+		p->timing[KTIME_HEAD] = kstats_ns();
+		kdata_servertiming(p);
+	}
 	kdata_write(p, "\r\n", 2);
+
+	/* Keep holding the headers until the body is complete. */
+
+	if (KETAG_HEAD == p->etag) {
+		p->bodypos = p->outbufpos;
+		kxxh64_init(&p->hash);
+		p->etag = KETAG_BODY;
+		if (NULL != p->timing)
+			p->timing[KTIME_HEAD] = kstats_ns();
+		p->state = KSTATE_BODY;
+		return;
+	}
+
 	/*
 	 * XXX: we always drain our buffer after the headers have been
 	 * written.
@@ -489,6 +897,13 @@ kdata_body(struct kdata *p)
 	kdata_drain(p);
 	if (-1 == p->fcgi)
 		fflush(stdout);
+	if (NULL != p->timing)
+		p->timing[KTIME_HEAD] = kstats_ns();
+
+	/* We stopped holding for the ETag before the body. */
 
+	if (p->gzwant)
+		kdata_gzopen(p);
+	p->gzwant = 0;
 	p->state = KSTATE_BODY;
 }
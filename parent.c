@@ -30,6 +30,7 @@
 
 #include "kcgi.h"
 #include "extern.h"
+#include "hash.h"
 
 /*
  * Read a single kpair from the child.
@@ -97,6 +98,9 @@ input(enum input *type, struct kpair *kp, int fd,
 	} else if (kp->type > KPAIR__MAX) {
 		XWARNX("parent: unknown kpair type");
 		return(-1);
+	} else if (KPAIR_VALID == kp->state && KPAIR__MAX == kp->type) {
+		XWARNX("parent: untyped valid kpair");
+		return(-1);
 	}
 
 	sz = sizeof(size_t);
@@ -178,16 +182,123 @@ input(enum input *type, struct kpair *kp, int fd,
 	return(1);
 }
 
+/*
+ * Append a zeroed pair to "kv", which has "kvsz" elements and room for
+ * "kvmax".
+ * The array grows geometrically to avoid copying it on every pair.
+ * Returns NULL on memory exhaustion.
+ */
 static struct kpair *
-kpair_expand(struct kpair **kv, size_t *kvsz)
+kpair_expand(struct kpair **kv, size_t *kvsz, size_t *kvmax)
 {
-
-	*kv = XREALLOCARRAY(*kv, *kvsz + 1, sizeof(struct kpair));
+	struct kpair	*p;
+	size_t		 max;
+
+	if (*kvsz == *kvmax) {
+		max = 0 == *kvmax ? 8 : *kvmax * 2;
+		p = XREALLOCARRAY(*kv, max, sizeof(struct kpair));
+		if (NULL == p)
+			return(NULL);
+		*kv = p;
+		*kvmax = max;
+	}
 	memset(&(*kv)[*kvsz], 0, sizeof(struct kpair));
 	(*kvsz)++;
 	return(&(*kv)[*kvsz - 1]);
 }
 
+/*
+ * Collect the validated values of all keys marked with KVALID_ARRAY in
+ * "keyflags" into the contiguous per-key arrays of "fieldvec".
+ * The first validated value of a key fixes the array type: later
+ * values of a different type are not collected (but remain in the
+ * field map as usual).
+ * Values are in submission order.
+ * Returns zero on memory exhaustion, non-zero otherwise.
+ */
+static int
+kvec_build(struct kreq *r, const unsigned int *keyflags)
+{
+	struct kpair	*kpp;
+	struct kvec	*kv;
+	size_t		 i;
+
+	r->fieldvec = XCALLOC(r->keysz, sizeof(struct kvec));
+	if (NULL == r->fieldvec)
+		return(0);
+	for (i = 0; i < r->keysz; i++)
+		r->fieldvec[i].type = KPAIR__MAX;
+
+	/* First pass: fix types and count. */
+
+	for (i = 0; i < r->fieldsz; i++) {
+		kpp = &r->fields[i];
+		if (kpp->keypos == r->keysz ||
+		    KPAIR_VALID != kpp->state ||
+		    KPAIR__MAX == kpp->type ||
+		    ! (KVALID_ARRAY & keyflags[kpp->keypos]))
+			continue;
+		kv = &r->fieldvec[kpp->keypos];
+		if (KPAIR__MAX == kv->type)
+			kv->type = kpp->type;
+		if (kv->type == kpp->type)
+			kv->sz++;
+	}
+
+	/* Allocate arrays and reset counts for the second pass. */
+
+	for (i = 0; i < r->keysz; i++) {
+		kv = &r->fieldvec[i];
+		if (0 == kv->sz)
+			continue;
+		switch (kv->type) {
+		case (KPAIR_INTEGER):
+			kv->v.i = XREALLOCARRAY
+				(NULL, kv->sz, sizeof(int64_t));
+			break;
+		case (KPAIR_DOUBLE):
+			kv->v.d = XREALLOCARRAY
+				(NULL, kv->sz, sizeof(double));
+			break;
+		case (KPAIR_STRING):
+			kv->v.s = XREALLOCARRAY
+				(NULL, kv->sz, sizeof(char *));
+			break;
+		default:
+			abort();
+		}
+		if (NULL == kv->v.i)
+			return(0);
+		kv->sz = 0;
+	}
+
+	for (i = 0; i < r->fieldsz; i++) {
+		kpp = &r->fields[i];
+		if (kpp->keypos == r->keysz ||
+		    KPAIR_VALID != kpp->state ||
+		    ! (KVALID_ARRAY & keyflags[kpp->keypos]))
+			continue;
+		kv = &r->fieldvec[kpp->keypos];
+		if (kv->type != kpp->type)
+			continue;
+		switch (kv->type) {
+		case (KPAIR_INTEGER):
+			kv->v.i[kv->sz++] = kpp->parsed.i;
+			break;
+		case (KPAIR_DOUBLE):
+			kv->v.d[kv->sz++] = kpp->parsed.d;
+			break;
+		case (KPAIR_STRING):
+			kv->v.s[kv->sz++] = kpp->parsed.s;
+			break;
+		default:
+			abort();
+		}
+	}
+
+	return(1);
+}
+
 /*
  * This is the parent kcgi process.
  * It spins on input from the child until all fields have been received.
@@ -197,7 +308,8 @@ kpair_expand(struct kpair **kv, size_t *kvsz)
  * kpairs into named buckets.
  */
 enum kcgi_err
-kworker_parent(int fd, struct kreq *r, int eofok, size_t mimesz)
+kworker_parent(int fd, struct kreq *r, int eofok, 
+	size_t mimesz, const struct kopts *opts)
 {
 	struct kpair	 kp;
 	struct kpair	*kpp;
@@ -205,7 +317,8 @@ kworker_parent(int fd, struct kreq *r, int eofok, size_t mimesz)
 	enum input	 type;
 	int		 rc;
 	enum kcgi_err	 ke;
-	size_t		 i, dgsz;
+	const struct khash *hash;
+	size_t		 i, dgsz, cookiemax = 0, fieldmax = 0;
 
 	/* Pointers freed at "out" label. */
 	memset(&kp, 0, sizeof(struct kpair));
@@ -279,19 +392,9 @@ kworker_parent(int fd, struct kreq *r, int eofok, size_t mimesz)
 	} else if (fullread(fd, &r->port, sizeof(uint16_t), 0, &ke) < 0) {
 		XWARNX("failed to read port");
 		goto out;
-	} else if (fullread(fd, &dgsz, sizeof(size_t), 0, &ke) < 0) {
-		XWARNX("failed to read digest length");
-		goto out;
-	} else if (MD5_DIGEST_LENGTH == dgsz) {
-		/* This is a binary value. */
-		if (NULL == (r->rawauth.digest = XMALLOC(dgsz)))
-			goto out;
-		if (fullread(fd, r->rawauth.digest, dgsz, 0, &ke) < 0) {
-			XWARNX("failed to read digest");
-			goto out;
-		}
 	}
 
+	type = IN_COOKIE;
 	for (;;) {
 		rc = input(&type, &kp, fd, &ke, 
 			eofok, mimesz, r->keysz);
@@ -309,8 +412,10 @@ kworker_parent(int fd, struct kreq *r, int eofok, size_t mimesz)
 
 		assert(type < IN__MAX);
 		kpp = IN_COOKIE == type ?
-			kpair_expand(&r->cookies, &r->cookiesz) :
-			kpair_expand(&r->fields, &r->fieldsz);
+			kpair_expand(&r->cookies, 
+				&r->cookiesz, &cookiemax) :
+			kpair_expand(&r->fields, 
+				&r->fieldsz, &fieldmax);
 
 		if (NULL == kpp) {
 			ke = KCGI_ENOMEM;
@@ -322,6 +427,43 @@ kworker_parent(int fd, struct kreq *r, int eofok, size_t mimesz)
 
 	assert(0 == rc);
 
+	/*
+	 * The terminator is followed by the times at which the child
+	 * started, scanned its environment, read, and parsed, then the
+	 * hash of the body if the digest's QOP is "auth-int".
+	 * (We may instead have stopped at a CGI child's end of file.)
+	 */
+	if (IN__MAX == type) {
+		if (fullread(fd, &r->timing[KTIME_START], 
+		    sizeof(uint64_t) * (KTIME_PARSE + 1), 0, &ke) < 0) {
+			XWARNX("failed to read timing");
+			goto out;
+		} else if (fullread(fd, &dgsz, sizeof(size_t), 0, &ke) < 0) {
+			XWARNX("failed to read digest length");
+			goto out;
+		} else if (dgsz > 0 && 
+		    (KAUTH_DIGEST != r->rawauth.type ||
+		     ! r->rawauth.authorised ||
+		     NULL == (hash = khash_get(r->rawauth.d.digest.alg)) ||
+		     hash->digestsz != dgsz)) {
+			XWARNX("unexpected digest length");
+			ke = KCGI_FORM;
+			goto out;
+		} else if (dgsz > 0) {
+			/* This is a binary value. */
+			r->rawauth.digest = XMALLOC(dgsz);
+			if (NULL == r->rawauth.digest) {
+				ke = KCGI_ENOMEM;
+				goto out;
+			}
+			if (fullread(fd, r->rawauth.digest, 
+			    dgsz, 0, &ke) < 0) {
+				XWARNX("failed to read digest");
+				goto out;
+			}
+		}
+	}
+
 	/*
 	 * Now that the field and cookie arrays are fixed and not going
 	 * to be reallocated any more, we run through both arrays and
@@ -359,6 +501,15 @@ kworker_parent(int fd, struct kreq *r, int eofok, size_t mimesz)
 		}
 	}
 
+	/* Optionally collect repeated values into arrays. */
+
+	if (r->keysz && NULL != opts->keyflags &&
+	    ! kvec_build(r, opts->keyflags)) {
+		ke = KCGI_ENOMEM;
+		goto out;
+	}
+
+	r->timing[KTIME_RECV] = kstats_ns();
 	return(KCGI_OK);
 out:
 	assert(KCGI_OK != ke);
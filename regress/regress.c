@@ -52,6 +52,14 @@ doparent(void *arg)
 		exit(EXIT_FAILURE);
 	}
 
+	/*
+	 * The FastCGI harness passes the application's response through
+	 * without a status line, which newer libcurl rejects as HTTP/0.9
+	 * unless explicitly allowed.
+	 */
+#if LIBCURL_VERSION_NUM >= 0x074000
+	curl_easy_setopt(curl, CURLOPT_HTTP09_ALLOWED, 1L);
+#endif
 	rc = parent(curl);
 	curl_easy_cleanup(curl);
 	curl_global_cleanup();
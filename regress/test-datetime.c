@@ -33,12 +33,36 @@
 #include "../kcgi.h"
 #include "regress.h"
 
+/*
+ * Dates that kutil_str2epoch() must reject.
+ */
+static const char *const bad[] = {
+	"",
+	"Sun, 06 Nov 1994 08:49:37 GMT ",
+	"Sun, 06 Nov 1994 08:49:37 UTC",
+	"Sunday, 06-Nov-94 08:49:37 GMT",
+	"Sun Nov  6 08:49:37 1994",
+	"Sun, 6 Nov 1994 08:49:37 GMT",
+	"Sun, 06 nov 1994 08:49:37 GMT",
+	"Sux, 06 Nov 1994 08:49:37 GMT",
+	"Sun, 06 Nov 1969 08:49:37 GMT",
+	"Sun, 00 Nov 1994 08:49:37 GMT",
+	"Sun, 31 Nov 1994 08:49:37 GMT",
+	"Sun, 29 Feb 1900 08:49:37 GMT",
+	"Sun, 06 Nov 1994 24:49:37 GMT",
+	"Sun, 06 Nov 1994 08:60:37 GMT",
+	"Sun, 06 Nov 1994 08:49:61 GMT",
+	"Sun, 06 Nov 1994 08:4x:37 GMT",
+	NULL
+};
+
 int
 main(int argc, char *argv[])
 {
 	size_t	 	 i;
 	time_t	 	 v;
-	struct tm	*tm;
+	int64_t		 res;
+	struct tm	*tm, ktm;
 	char	 	 inbuf[64], testbuf[64];
 
 	for (i = 0; i < 100000; i++) {
@@ -51,6 +75,8 @@ main(int argc, char *argv[])
 		 * 32-bit time.
 		 */
 		v = arc4random_uniform(50 * 365 * 24 * 60 * 60);
+		if (sizeof(time_t) > 4 && i % 2)
+			v *= 160;
 		tm = gmtime(&v);
 		strftime(inbuf, sizeof(inbuf), "%a, %d %b %Y %T GMT", tm);
 		kutil_epoch2str(v, testbuf, sizeof(testbuf));
@@ -59,7 +85,56 @@ main(int argc, char *argv[])
 			warnx("KCGI: %s", testbuf);
 			return(EXIT_FAILURE);
 		}
+		if ( ! kutil_str2epoch(testbuf, &res) || res != v) {
+			warnx("Parse: %s", testbuf);
+			return(EXIT_FAILURE);
+		}
+		strftime(inbuf, sizeof(inbuf), "%Y-%m-%dT%H:%M:%SZ", tm);
+		kutil_epoch2utcstr(v, testbuf, sizeof(testbuf));
+		if (strcmp(inbuf, testbuf)) {
+			warnx("System: %s", inbuf);
+			warnx("KCGI: %s", testbuf);
+			return(EXIT_FAILURE);
+		}
+		memset(&ktm, 0, sizeof(struct tm));
+		KUTIL_EPOCH2TM(v, &ktm);
+		if (ktm.tm_sec != tm->tm_sec ||
+		    ktm.tm_min != tm->tm_min ||
+		    ktm.tm_hour != tm->tm_hour ||
+		    ktm.tm_mday != tm->tm_mday ||
+		    ktm.tm_mon != tm->tm_mon ||
+		    ktm.tm_year != tm->tm_year ||
+		    ktm.tm_wday != tm->tm_wday ||
+		    ktm.tm_yday != tm->tm_yday) {
+			warnx("Breakdown: %s", inbuf);
+			return(EXIT_FAILURE);
+		}
+	}
+
+	/* Formatting is cached: make sure the buffer is still filled. */
+
+	kutil_epoch2str(0, testbuf, sizeof(testbuf));
+	memset(inbuf, 0, sizeof(inbuf));
+	kutil_epoch2str(-1, inbuf, 17);
+	if (strcmp(testbuf, "Thu, 01 Jan 1970 00:00:00 GMT") ||
+	    strcmp(inbuf, "Thu, 01 Jan 1970")) {
+		warnx("Cached: %s, %s", testbuf, inbuf);
+		return(EXIT_FAILURE);
 	}
 
+	if ( ! kutil_str2epoch("Sun, 06 Nov 1994 08:49:37 GMT", &res) ||
+	    784111777 != res ||
+	    ! kutil_str2epoch("Thu, 29 Feb 2024 23:59:60 GMT", &res) ||
+	    1709251200 != res) {
+		warnx("Parse: known dates");
+		return(EXIT_FAILURE);
+	}
+
+	for (i = 0; NULL != bad[i]; i++)
+		if (kutil_str2epoch(bad[i], &res)) {
+			warnx("Parse: accepted %s", bad[i]);
+			return(EXIT_FAILURE);
+		}
+
 	return(EXIT_SUCCESS);
 }
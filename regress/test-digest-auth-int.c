@@ -0,0 +1,116 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+/*
+ * A multipart body with "auth-int" and SHA-512-256-sess.
+ * The body is parsed as it's read, so this makes sure that it's also
+ * hashed as it's read.
+ */
+static int
+parent(CURL *curl)
+{
+	struct curl_slist *list = NULL;
+	int c;
+
+	curl_easy_setopt(curl, CURLOPT_URL, 
+		"http://localhost:17123/");
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, 
+		"--xyzzy\r\n"
+		"Content-Disposition: form-data; name=\"foo\"\r\n"
+		"\r\n"
+		"bar\r\n"
+		"--xyzzy--\r\n");
+	list = curl_slist_append(list, 
+		"Content-Type: multipart/form-data; boundary=xyzzy");
+	list = curl_slist_append(list, 
+		"Authorization: Digest username=\"Mufasa\","
+		"realm=\"testrealm@host.com\","
+		"nonce=\"abc123\","
+		"uri=\"/dir/index.html\","
+		"algorithm=SHA-512-256-sess,"
+		"qop=auth-int,"
+		"nc=00000002,"
+		"cnonce=\"0a4f113b\","
+		"response=\"364b244e33e9b214a70bf298e13791c5"
+			"a475b2a482dc245c91699c761a973030\"");
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+	c = curl_easy_perform(curl);
+	curl_slist_free_all(list); 
+	return(CURLE_OK == c);
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	const char 	*page = "index";
+	int		 rc;
+
+	rc = 0;
+	if (khttp_fcgi_test())
+		return(0);
+	if (KCGI_OK != khttp_parse(&r, NULL, 0, &page, 1, 0))
+		return(0);
+	if (KAUTH_DIGEST != r.rawauth.type) 
+		goto out;
+	else if (0 == r.rawauth.authorised)
+		goto out;
+	else if (KHTTPALG_SHA512_256_SESS != r.rawauth.d.digest.alg)
+		goto out;
+	else if (KHTTPQOP_AUTH_INT != r.rawauth.d.digest.qop)
+		goto out;
+	else if (1 != r.fieldsz || strcmp(r.fields[0].key, "foo") ||
+		 strcmp(r.fields[0].val, "bar"))
+		goto out;
+	else if (khttpdigest_validate(&r, "Circle Of Life") <= 0)
+		goto out;
+	else if (0 != khttpdigest_validate(&r, "Circle Of Lif"))
+		goto out;
+	else if (khttpdigest_validatehash(&r, 
+		 "4f89a1c293dd533bc27546c1da0608df"
+		 "9efcaa6bd1c350edca70a01c8a823360") <= 0)
+		goto out;
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+	rc = 1;
+out:
+	khttp_free(&r);
+	return(rc);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,98 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+/*
+ * The SHA-256 example of RFC 7616 section 3.9.1.
+ */
+static int
+parent(CURL *curl)
+{
+	struct curl_slist *list = NULL;
+	int c;
+
+	curl_easy_setopt(curl, CURLOPT_URL, 
+		"http://localhost:17123/");
+	list = curl_slist_append(list, 
+		"Authorization: Digest username=\"Mufasa\","
+		"realm=\"http-auth@example.org\","
+		"uri=\"/dir/index.html\","
+		"algorithm=SHA-256,"
+		"nonce=\"7ypf/xlj9XXwfDPEoM4URrv/xwf94BcCAzFZH4GiTo0v\","
+		"nc=00000001,"
+		"cnonce=\"f2/wE4q74E6zIJEtWaHKaf5wv/H5QzzpXusqGemxURZJ\","
+		"qop=auth,"
+		"response=\"753927fa0e85d155564e2e272a28d1802ca10daf"
+			"4496794697cf8db5856cb6c1\","
+		"opaque=\"FQhe/qaU925kfnzjCev0ciny7QMkPqMAFRtzCUYo5tdS\"");
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+	c = curl_easy_perform(curl);
+	curl_slist_free_all(list); 
+	return(CURLE_OK == c);
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	const char 	*page = "index";
+	int		 rc;
+
+	rc = 0;
+	if (khttp_fcgi_test())
+		return(0);
+	if (KCGI_OK != khttp_parse(&r, NULL, 0, &page, 1, 0))
+		return(0);
+	if (KAUTH_DIGEST != r.rawauth.type) 
+		goto out;
+	else if (0 == r.rawauth.authorised)
+		goto out;
+	else if (KHTTPALG_SHA256 != r.rawauth.d.digest.alg)
+		goto out;
+	else if (khttpdigest_validate(&r, "Circle of Life") <= 0)
+		goto out;
+	else if (0 != khttpdigest_validate(&r, "Circle Of Life"))
+		goto out;
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+	rc = 1;
+out:
+	khttp_free(&r);
+	return(rc);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -73,9 +73,27 @@ child(void)
 		goto out;
 	else if (strcmp(r.rawauth.d.digest.uri, "/dir/index.html"))
 		goto out;
+	else if (strcmp(r.rawauth.d.digest.opaque, 
+		 "5ccc069c403ebaf9f0171e9517f40e41"))
+		goto out;
 	else if (khttpdigest_validate(&r, "Circle Of Life") <= 0)
 		goto out;
 
+	/*
+	 * Validation must be repeatable, must refuse passwords that
+	 * differ only at the end, and must match when given H(A1).
+	 */
+
+	if (khttpdigest_validate(&r, "Circle Of Life") <= 0)
+		goto out;
+	else if (0 != khttpdigest_validate(&r, "Circle Of Lif"))
+		goto out;
+	else if (0 != khttpdigest_validate(&r, "Circle Of Life!"))
+		goto out;
+	else if (khttpdigest_validatehash(&r, 
+		 "939e7578ed9e3c518a452acee763bce9") <= 0)
+		goto out;
+
 	khttp_head(&r, kresps[KRESP_STATUS], 
 		"%s", khttps[KHTTP_200]);
 	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
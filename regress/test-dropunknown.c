@@ -0,0 +1,84 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+static int
+parent(CURL *curl)
+{
+
+	curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:17123/"
+		"index.html?foo=bar&unk=%zz&baz=%41+%42&unk2");
+	curl_easy_setopt(curl, CURLOPT_COOKIE, 
+		"unk=xyzzy; foo=c=d; ;unk2");
+	return(CURLE_OK == curl_easy_perform(curl));
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	struct kopts	 opts;
+	struct kvalid	 key[2] = { 
+		{ kvalid_string, "foo" },
+		{ kvalid_string, "baz" }};
+	const char 	*page[] = { "index" };
+
+	khttp_opts_init(&opts);
+	opts.flags = KOPT_DROPUNKNOWN;
+
+	if (KCGI_OK != khttp_parsex(&r, ksuffixmap, kmimetypes, 
+	    KMIME__MAX, key, 2, page, 1, KMIME_TEXT_HTML, 
+	    0, NULL, NULL, 0, &opts))
+		return(0);
+
+	if (2 != r.fieldsz || 1 != r.cookiesz)
+		return(0);
+	if (NULL == r.fieldmap[0] || strcmp(r.fieldmap[0]->val, "bar"))
+		return(0);
+	if (NULL == r.fieldmap[1] || strcmp(r.fieldmap[1]->val, "A B"))
+		return(0);
+	if (3 != r.fieldmap[1]->valsz)
+		return(0);
+	if (NULL == r.cookiemap[0] || strcmp(r.cookiemap[0]->val, "c=d"))
+		return(0);
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+	khttp_free(&r);
+	return(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
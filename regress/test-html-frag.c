@@ -0,0 +1,146 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "../kcgihtml.h"
+#include "regress.h"
+
+/*
+ * The first fragment opens a <div>.
+ * The second closes the <div> open when it was recorded, then opens a
+ * paragraph and span around its hole.
+ * It's written once where the stack doesn't match and once where it
+ * does.
+ */
+#define	BODY	 "<body><p></p><div></div><p><span>a&#x3c;b</span></p></body>"
+
+struct	buf {
+	char	  buf[BUFSIZ];
+	size_t	  sz;
+};
+
+static int
+parentwrite(void *ptr, size_t sz, size_t nm, void *dat)
+{
+	struct buf	*buf = dat;
+
+	if (buf->sz + (sz * nm) + 1 > BUFSIZ)
+		return(-1);
+	memcpy(buf->buf + buf->sz, ptr, sz * nm);
+	buf->sz += sz * nm;
+	buf->buf[buf->sz] = '\0';
+	return(sz * nm);
+}
+
+static int
+parent(CURL *curl)
+{
+	struct buf	 buf;
+
+	memset(&buf, 0, sizeof(struct buf));
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, parentwrite);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buf);
+	curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:17123/");
+	if (CURLE_OK != curl_easy_perform(curl))
+		return(0);
+	return(0 == strcmp(buf.buf, BODY));
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	struct khtmlreq	 rec, req;
+	struct khtmlfrag div, frag;
+	const char 	*page = "index";
+	const char	*vals[] = { "a<b" };
+	int		 rc = 0;
+
+	/* Record the fragments. */
+
+	khtml_open(&rec, NULL, 0);
+	if ( ! khtml_frag_open(&rec, &div))
+		return(0);
+	khtml_elem(&rec, KELEM_DIV);
+	if ( ! khtml_frag_close(&rec))
+		return(0);
+	if ( ! khtml_frag_open(&rec, &frag)) {
+		khtml_frag_free(&div);
+		return(0);
+	}
+	khtml_closeelem(&rec, 1);
+	khtml_elem(&rec, KELEM_P);
+	khtml_elem(&rec, KELEM_SPAN);
+	khtml_frag_hole(&rec);
+	if ( ! khtml_frag_close(&rec)) {
+		khtml_frag_free(&div);
+		return(0);
+	}
+
+	if (KCGI_OK != khttp_parse(&r, NULL, 0, &page, 1, 0))
+		goto out;
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+
+	/* Nothing to close, then the wrong element. */
+
+	khtml_open(&req, &r, 0);
+	if (khtml_frag_write(&req, &frag, vals))
+		goto out;
+	khtml_elem(&req, KELEM_BODY);
+	khtml_elem(&req, KELEM_P);
+	if (khtml_frag_write(&req, &frag, vals) ||
+	    2 != khtml_elemat(&req))
+		goto out;
+
+	/* Now the <div> is closed and two elements opened. */
+
+	khtml_closeelem(&req, 1);
+	if ( ! khtml_frag_write(&req, &div, NULL) ||
+	    2 != khtml_elemat(&req))
+		goto out;
+	if ( ! khtml_frag_write(&req, &frag, vals) ||
+	    3 != khtml_elemat(&req))
+		goto out;
+	khtml_close(&req);
+	khttp_free(&r);
+	rc = 1;
+out:
+	khtml_frag_free(&div);
+	khtml_frag_free(&frag);
+	return(rc);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
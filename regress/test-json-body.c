@@ -0,0 +1,141 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+#define	BODY "{\"name\": \"J\\u00e9r\\u00f4me \\\"x\\\"\", " \
+	"\"age\": 42, \"user\": {\"email\": \"A@Example.com\", " \
+	"\"tags\": [\"a\", \"b\"], \"none\": null}, \"ok\": true, " \
+	"\"deep\": [[[-1.5e2]]], \"\": \"anon\"}"
+
+enum	key {
+	KEY_BODY,
+	KEY_NAME,
+	KEY_AGE,
+	KEY_EMAIL,
+	KEY_TAGS,
+	KEY_NONE,
+	KEY_OK,
+	KEY_DEEP,
+	KEY__MAX
+};
+
+static const struct kvalid keys[KEY__MAX] = {
+	{ kvalid_string, "" }, /* KEY_BODY */
+	{ kvalid_stringne, "name" }, /* KEY_NAME */
+	{ kvalid_int, "age" }, /* KEY_AGE */
+	{ kvalid_email, "user.email" }, /* KEY_EMAIL */
+	{ kvalid_stringne, "user.tags" }, /* KEY_TAGS */
+	{ NULL, "user.none" }, /* KEY_NONE */
+	{ NULL, "ok" }, /* KEY_OK */
+	{ kvalid_double, "deep" }, /* KEY_DEEP */
+};
+
+static int
+parent(CURL *curl)
+{
+	struct curl_slist	*list = NULL;
+	int			 rc;
+
+	list = curl_slist_append(list, 
+		"Content-Type: application/json; charset=utf-8");
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+	curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:17123/");
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, BODY);
+	rc = CURLE_OK == curl_easy_perform(curl);
+	curl_slist_free_all(list);
+	return(rc);
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	struct kopts	 opts;
+	struct kpair	*kp;
+	const char 	*page = "index";
+	size_t		 i;
+	int		 rc = 0;
+
+	khttp_opts_init(&opts);
+	opts.flags = KOPT_JSON_BODY;
+
+	if (KCGI_OK != khttp_parsex(&r, ksuffixmap, kmimetypes, 
+	    KMIME__MAX, keys, KEY__MAX, &page, 1, KMIME_TEXT_HTML, 
+	    0, NULL, NULL, 0, &opts))
+		return(0);
+
+	/* The opaque body is still passed back as it was sent. */
+
+	if (NULL == (kp = r.fieldmap[KEY_BODY]) ||
+	    strcmp(kp->val, BODY))
+		goto out;
+	if (NULL == (kp = r.fieldmap[KEY_NAME]) ||
+	    strcmp(kp->parsed.s, "J\xc3\xa9r\xc3\xb4me \"x\""))
+		goto out;
+	if (NULL == (kp = r.fieldmap[KEY_AGE]) || 
+	    KPAIR_INTEGER != kp->type || 42 != kp->parsed.i)
+		goto out;
+	if (NULL == (kp = r.fieldmap[KEY_EMAIL]) ||
+	    strcmp(kp->parsed.s, "a@example.com"))
+		goto out;
+	if (NULL == (kp = r.fieldmap[KEY_TAGS]) || 
+	    NULL == kp->next || NULL != kp->next->next)
+		goto out;
+	if (NULL != r.fieldmap[KEY_NONE])
+		goto out;
+	if (NULL == (kp = r.fieldmap[KEY_OK]) ||
+	    strcmp(kp->val, "true"))
+		goto out;
+	if (NULL == (kp = r.fieldmap[KEY_DEEP]) ||
+	    KPAIR_DOUBLE != kp->type || -150.0 != kp->parsed.d)
+		goto out;
+
+	/* Only the opaque body has an empty key. */
+
+	for (i = 0; i < r.fieldsz; i++)
+		if ('\0' == r.fields[i].key[0] && 
+		    &r.fields[i] != r.fieldmap[KEY_BODY])
+			goto out;
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+	rc = 1;
+out:
+	khttp_free(&r);
+	return(rc);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
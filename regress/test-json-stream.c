@@ -0,0 +1,199 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "../kcgijson.h"
+#include "regress.h"
+
+/*
+ * First, a few newline-delimited rows flushed every second row.
+ * Then a JSON text sequence of large rows flushed every FLUSHROWS rows
+ * to a client that stalls, which must make us invoke the callback.
+ */
+#define	NDJSON	 "1\n\"a\"\n[1, 2]\n"
+#define	PADSZ	 1000
+#define	FLUSHROWS 16
+#define	MAXROWS	 16384
+
+struct	buf {
+	char	 *buf;
+	size_t	  sz;
+	size_t	  max;
+};
+
+struct	stall {
+	size_t	  calls; /* callback invocations */
+	size_t	  badrows; /* invocations off the cadence */
+	struct kjsonreq *req;
+};
+
+static char	 pad[PADSZ + 1];
+
+static int
+parentwrite(void *ptr, size_t sz, size_t nm, void *dat)
+{
+	struct buf	*buf = dat;
+	void		*pp;
+
+	/* Stall on the first write so that the child blocks. */
+
+	if (0 == buf->sz)
+		sleep(1);
+	if (buf->sz + sz * nm > buf->max) {
+		buf->max = (buf->sz + sz * nm) * 2;
+		if (NULL == (pp = realloc(buf->buf, buf->max)))
+			return(-1);
+		buf->buf = pp;
+	}
+	memcpy(buf->buf + buf->sz, ptr, sz * nm);
+	buf->sz += sz * nm;
+	return(sz * nm);
+}
+
+/*
+ * Check that "cp" of "sz" bytes is the sequence of rows.
+ * There's at least one, but we don't know how many.
+ */
+static int
+parentseq(const char *cp, size_t sz)
+{
+	char	 row[PADSZ + 64];
+	size_t	 i, len;
+
+	for (i = 0; sz > 0; i++) {
+		len = snprintf(row, sizeof(row), 
+			"\x1e{\"row\": %zu, \"pad\": \"%s\"}\n", i, pad);
+		if (len > sz || memcmp(cp, row, len))
+			return(0);
+		cp += len;
+		sz -= len;
+	}
+	return(i > 0);
+}
+
+static int
+parent(CURL *curl)
+{
+	struct buf	 buf;
+	int		 rc;
+
+	memset(&buf, 0, sizeof(struct buf));
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, parentwrite);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buf);
+	curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:17123/");
+	rc = CURLE_OK == curl_easy_perform(curl) &&
+		buf.sz >= strlen(NDJSON) &&
+		0 == memcmp(buf.buf, NDJSON, strlen(NDJSON)) &&
+		parentseq(buf.buf + strlen(NDJSON), 
+			buf.sz - strlen(NDJSON));
+	free(buf.buf);
+	return(rc);
+}
+
+static int
+wouldblock(void *arg)
+{
+	struct stall	*st = arg;
+
+	if (0 != st->req->rows % FLUSHROWS)
+		st->badrows++;
+	st->calls++;
+	usleep(1000);
+	return(1);
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	struct kopts	 opts;
+	struct kjsonreq	 req;
+	struct stall	 st;
+	const char 	*page = "index";
+	size_t		 i;
+
+	/* Buffer more than we flush at once. */
+
+	khttp_opts_init(&opts);
+	opts.sndbufsz = FLUSHROWS * (PADSZ + 64) * 2;
+
+	if (KCGI_OK != khttp_parsex(&r, ksuffixmap, kmimetypes, 
+	    KMIME__MAX, NULL, 0, &page, 1, KMIME_TEXT_HTML, 
+	    0, NULL, NULL, 0, &opts))
+		return(0);
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_PLAIN]);
+	khttp_body(&r);
+
+	kjson_open(&req, &r);
+	if ( ! kjson_stream(&req, KJSON_STREAM_NDJSON, 2, NULL, NULL))
+		return(0);
+	kjson_putint(&req, 1);
+	kjson_putstring(&req, "a");
+	kjson_array_open(&req);
+	kjson_putint(&req, 1);
+	kjson_putint(&req, 2);
+	kjson_array_close(&req);
+	if (3 != req.rows)
+		return(0);
+	kjson_close(&req);
+
+	/* Not once we've written something. */
+
+	if (kjson_stream(&req, KJSON_STREAM_SEQ, 0, NULL, NULL))
+		return(0);
+
+	memset(&st, 0, sizeof(struct stall));
+	st.req = &req;
+	kjson_open(&req, &r);
+	if ( ! kjson_stream(&req, KJSON_STREAM_SEQ, 
+	    FLUSHROWS, wouldblock, &st))
+		return(0);
+	for (i = 0; i < MAXROWS && 
+	     (st.calls < 4 || 0 != i % FLUSHROWS); i++) {
+		kjson_obj_open(&req);
+		kjson_putintp(&req, "row", i);
+		kjson_putstringp(&req, "pad", pad);
+		kjson_obj_close(&req);
+	}
+	if (i != req.rows)
+		return(0);
+	kjson_close(&req);
+	khttp_free(&r);
+	return(st.calls > 0 && 0 == st.badrows);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	memset(pad, 'x', PADSZ);
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
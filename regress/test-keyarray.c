@@ -0,0 +1,112 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+
+static int
+parent(CURL *curl)
+{
+
+	curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:17123/"
+		"index.html?id=3&id=1&id=x&id=2&d=1.5&s=a&d=-2&s=b"
+		"&one=4&one=5");
+	return(CURLE_OK == curl_easy_perform(curl));
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	struct kopts	 opts;
+	struct kvalid	 key[5] = { 
+		{ kvalid_int, "id" },
+		{ kvalid_double, "d" },
+		{ kvalid_stringne, "s" },
+		{ kvalid_int, "one" },
+		{ NULL, "none" }};
+	const unsigned int keyflags[5] = {
+		KVALID_ARRAY, KVALID_ARRAY, KVALID_ARRAY, 0, KVALID_ARRAY };
+	const char 	*page[] = { "index" };
+
+	khttp_opts_init(&opts);
+	opts.keyflags = keyflags;
+
+	if (KCGI_OK != khttp_parsex(&r, ksuffixmap, kmimetypes, 
+	    KMIME__MAX, key, 5, page, 1, KMIME_TEXT_HTML, 
+	    0, NULL, NULL, 0, &opts))
+		return(0);
+
+	if (NULL == r.fieldvec)
+		return(0);
+
+	/* Submission order, invalid "x" omitted. */
+
+	if (KPAIR_INTEGER != r.fieldvec[0].type ||
+	    3 != r.fieldvec[0].sz ||
+	    3 != r.fieldvec[0].v.i[0] ||
+	    1 != r.fieldvec[0].v.i[1] ||
+	    2 != r.fieldvec[0].v.i[2])
+		return(0);
+	if (KPAIR_DOUBLE != r.fieldvec[1].type ||
+	    2 != r.fieldvec[1].sz ||
+	    1.5 != r.fieldvec[1].v.d[0] ||
+	    -2.0 != r.fieldvec[1].v.d[1])
+		return(0);
+	if (KPAIR_STRING != r.fieldvec[2].type ||
+	    2 != r.fieldvec[2].sz ||
+	    strcmp(r.fieldvec[2].v.s[0], "a") ||
+	    strcmp(r.fieldvec[2].v.s[1], "b"))
+		return(0);
+
+	/* Not flagged and not submitted. */
+
+	if (0 != r.fieldvec[3].sz || NULL != r.fieldvec[3].v.i)
+		return(0);
+	if (0 != r.fieldvec[4].sz || KPAIR__MAX != r.fieldvec[4].type)
+		return(0);
+
+	/* The usual maps are unaffected. */
+
+	if (NULL == r.fieldmap[3] || 5 != r.fieldmap[3]->parsed.i)
+		return(0);
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+	khttp_free(&r);
+	return(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
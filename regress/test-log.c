@@ -0,0 +1,94 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+static int
+parent(CURL *curl)
+{
+
+	curl_easy_setopt(curl, CURLOPT_URL, 
+		"http://localhost:17123/index.html");
+	return(CURLE_OK == curl_easy_perform(curl));
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	const char 	*page = "index";
+	char		 file[] = "/tmp/test-log.XXXXXXXXXX";
+	char		 buf[BUFSIZ];
+	FILE		*f;
+	size_t		 sz;
+	int		 fd, rc = 0;
+
+	if (-1 == (fd = mkstemp(file)))
+		return(0);
+	close(fd);
+
+	if (KCGI_OK != khttp_parse(&r, NULL, 0, &page, 1, 0))
+		goto out;
+	if ( ! kutil_openlogx(file, KLOGFMT_JSON, KLOG_BATCH))
+		goto out;
+
+	kutil_warnx(&r, "test", "%s", 
+		"quote\" and\nnewline \xc3\xa9\x7f");
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_404]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_PLAIN]);
+	khttp_body(&r);
+	khttp_puts(&r, "hello");
+	kutil_logaccess(&r);
+	khttp_free(&r);
+	kutil_logflush();
+
+	if (NULL == (f = fopen(file, "r")))
+		goto out;
+	sz = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[sz] = '\0';
+
+	rc = NULL != strstr(buf, "\"ident\":\"test\",\"level\":\"WARN\","
+		"\"msg\":\"quote\\\" and\\nnewline "
+		"\xc3\xa9\\u007f\"}\n") &&
+	     NULL != strstr(buf, "\"method\":\"GET\","
+		"\"path\":\"/index.html\",\"status\":404,\"bytes\":") &&
+	     NULL != strstr(buf, "\"total_ms\":");
+out:
+	unlink(file);
+	return(rc);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
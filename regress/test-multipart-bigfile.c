@@ -0,0 +1,110 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+#define	BIGSZ	(1024 * 1024)
+
+static int
+parent(CURL *curl)
+{
+	struct curl_httppost	*post, *last;
+	char			*p;
+	size_t			 i;
+	int			 rc;
+
+	if (NULL == (p = malloc(BIGSZ)))
+		return(0);
+
+	/* 
+	 * Use a byte sequence that partially matches the boundary so
+	 * that the matcher is exercised across reads.
+	 */
+
+	for (i = 0; i < BIGSZ; i++)
+		p[i] = "\r\n--"[i % 4];
+
+	post = last = NULL;
+	curl_formadd(&post, &last, CURLFORM_COPYNAME, "first", 
+		CURLFORM_COPYCONTENTS, "abc", CURLFORM_END);
+	curl_formadd(&post, &last, CURLFORM_COPYNAME, "big", 
+		CURLFORM_BUFFER, "data", CURLFORM_BUFFERPTR, p, 
+		CURLFORM_BUFFERLENGTH, (long)BIGSZ, CURLFORM_END);
+	curl_formadd(&post, &last, CURLFORM_COPYNAME, "last", 
+		CURLFORM_COPYCONTENTS, "xyz", CURLFORM_END);
+
+	curl_easy_setopt(curl, CURLOPT_HTTPPOST, post);
+	curl_easy_setopt(curl, CURLOPT_URL, 
+		"http://localhost:17123/");
+	rc = curl_easy_perform(curl);
+	curl_formfree(post);
+	free(p);
+	return(CURLE_OK == rc);
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	const char 	*page = "index";
+	struct kvalid	 valid[3] = {
+		{ NULL, "first" },
+		{ NULL, "big" },
+		{ NULL, "last" } };
+	size_t		 i;
+	int		 rc = 0;
+
+	if (KCGI_OK != khttp_parse(&r, valid, 3, &page, 1, 0))
+		return(0);
+
+	if (NULL == r.fieldmap[0] || strcmp(r.fieldmap[0]->val, "abc"))
+		goto out;
+	if (NULL == r.fieldmap[2] || strcmp(r.fieldmap[2]->val, "xyz"))
+		goto out;
+	if (NULL == r.fieldmap[1] || BIGSZ != r.fieldmap[1]->valsz)
+		goto out;
+	for (i = 0; i < BIGSZ; i++)
+		if (r.fieldmap[1]->val[i] != "\r\n--"[i % 4])
+			goto out;
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+	rc = 1;
+out:
+	khttp_free(&r);
+	return(rc);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
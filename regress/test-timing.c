@@ -0,0 +1,112 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "../kcgi.h"
+#include "regress.h"
+
+struct	buf {
+	char	  buf[BUFSIZ];
+	size_t	  sz;
+};
+
+static int
+parentwrite(void *ptr, size_t sz, size_t nm, void *dat)
+{
+	struct buf	*buf = dat;
+
+	if (buf->sz + (sz * nm) + 1 > BUFSIZ)
+		return(-1);
+	memcpy(buf->buf + buf->sz, ptr, sz * nm);
+	buf->sz += sz * nm;
+	buf->buf[buf->sz] = '\0';
+	return(sz * nm);
+}
+
+static int
+parent(CURL *curl)
+{
+	struct buf	 buf;
+
+	memset(&buf, 0, sizeof(struct buf));
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, parentwrite);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &buf);
+	curl_easy_setopt(curl, CURLOPT_URL, "http://localhost:17123/");
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "foo=bar");
+	if (CURLE_OK != curl_easy_perform(curl))
+		return(0);
+	return(NULL != strstr(buf.buf, "Server-Timing: env;dur=") &&
+	       NULL != strstr(buf.buf, ", app;dur="));
+}
+
+static int
+child(void)
+{
+	struct kreq	 r;
+	struct kopts	 opts;
+	struct kvalid	 key = { kvalid_string, "foo" };
+	const char 	*page = "index";
+	size_t		 i;
+
+	khttp_opts_init(&opts);
+	opts.flags = KOPT_SERVER_TIMING;
+
+	if (KCGI_OK != khttp_parsex(&r, ksuffixmap, kmimetypes, 
+	    KMIME__MAX, &key, 1, &page, 1, KMIME_TEXT_HTML, 
+	    0, NULL, NULL, 0, &opts))
+		return(0);
+
+	/* Everything up to receipt, in order, but no further. */
+
+	for (i = 0; i <= KTIME_RECV; i++)
+		if (0 == r.timing[i] || 
+		    (i > 0 && r.timing[i] < r.timing[i - 1]))
+			return(0);
+	if (0 != r.timing[KTIME_HEAD] || 0 != r.timing[KTIME_DONE])
+		return(0);
+	if (khttp_timing(&r, KTIME_START, KTIME_RECV) < 0.0 ||
+	    khttp_timing(&r, KTIME_RECV, KTIME_HEAD) >= 0.0 ||
+	    khttp_timing(&r, KTIME__MAX, KTIME_START) >= 0.0)
+		return(0);
+	if (NULL == r.fieldmap[0])
+		return(0);
+
+	khttp_head(&r, kresps[KRESP_STATUS], 
+		"%s", khttps[KHTTP_200]);
+	khttp_head(&r, kresps[KRESP_CONTENT_TYPE], 
+		"%s", kmimetypes[KMIME_TEXT_HTML]);
+	khttp_body(&r);
+	if (r.timing[KTIME_HEAD] < r.timing[KTIME_RECV])
+		return(0);
+	khttp_free(&r);
+	return(r.timing[KTIME_DONE] >= r.timing[KTIME_HEAD]);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	return(regress_cgi(parent, child) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
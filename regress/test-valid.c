@@ -0,0 +1,198 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "../config.h"
+
+#include <err.h>
+#include <errno.h>
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#if !HAVE_ARC4RANDOM
+# include <bsd/stdlib.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "../kcgi.h"
+
+/*
+ * Run validator "fp" over a copy of "val", returning its result and
+ * filling in "kp".
+ */
+static int
+valid(int (*fp)(struct kpair *), const char *val, 
+	struct kpair *kp, char *buf, size_t bufsz)
+{
+
+	memset(kp, 0, sizeof(struct kpair));
+	strlcpy(buf, val, bufsz);
+	kp->val = buf;
+	kp->valsz = strlen(buf);
+	return(fp(kp));
+}
+
+static int
+check_int(const char *val, int ok, int64_t v)
+{
+	struct kpair	 kp;
+	char		 buf[64];
+
+	if (ok != valid(kvalid_int, val, &kp, buf, sizeof(buf))) {
+		warnx("kvalid_int: %s: bad result", val);
+		return(0);
+	} else if (ok && v != kp.parsed.i) {
+		warnx("kvalid_int: %s: bad value: %" PRId64, 
+			val, kp.parsed.i);
+		return(0);
+	}
+	return(1);
+}
+
+static int
+check_email(const char *val, const char *res)
+{
+	struct kpair	 kp;
+	char		 buf[512];
+	int		 ok;
+
+	ok = valid(kvalid_email, val, &kp, buf, sizeof(buf));
+	if ((NULL != res) != ok) {
+		warnx("kvalid_email: %s: bad result", val);
+		return(0);
+	} else if (ok && strcmp(kp.parsed.s, res)) {
+		warnx("kvalid_email: %s: bad value: %s", 
+			val, kp.parsed.s);
+		return(0);
+	}
+	return(1);
+}
+
+/*
+ * Make sure that kvalid_double() agrees exactly with strtod(3), which
+ * it uses for the slow path, except in rejecting overflows.
+ */
+static int
+check_double(const char *val)
+{
+	struct kpair	 kp;
+	char		 buf[64], *ep;
+	double		 d;
+	int		 ok;
+
+	ok = valid(kvalid_double, val, &kp, buf, sizeof(buf));
+	errno = 0;
+	d = strtod(val, &ep);
+	if (ok != ('\0' == *ep && 
+	    ! (ERANGE == errno && isinf(d)))) {
+		warnx("kvalid_double: %s: bad result", val);
+		return(0);
+	} else if (ok && (d != kp.parsed.d ||
+		   signbit(d) != signbit(kp.parsed.d))) {
+		warnx("kvalid_double: %s: bad value: %.17g", 
+			val, kp.parsed.d);
+		return(0);
+	}
+	return(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct kpair	 kp;
+	char		 buf[64], in[64];
+	size_t		 i, j;
+	uint32_t	 y, m, d;
+
+	if ( ! check_int("0", 1, 0) ||
+	    ! check_int("-0", 1, 0) ||
+	    ! check_int(" +12 ", 1, 12) ||
+	    ! check_int("-12", 1, -12) ||
+	    ! check_int("9223372036854775807", 1, INT64_MAX) ||
+	    ! check_int("-9223372036854775808", 1, INT64_MIN) ||
+	    ! check_int("9223372036854775808", 0, 0) ||
+	    ! check_int("-9223372036854775809", 0, 0) ||
+	    ! check_int("99999999999999999999", 0, 0) ||
+	    ! check_int("", 0, 0) ||
+	    ! check_int("-", 0, 0) ||
+	    ! check_int("1 2", 0, 0) ||
+	    ! check_int("12a", 0, 0) ||
+	    ! check_int("0x10", 0, 0))
+		return(EXIT_FAILURE);
+
+	if (valid(kvalid_uint, "-1", &kp, buf, sizeof(buf)) ||
+	    ! valid(kvalid_uint, " 10", &kp, buf, sizeof(buf)) ||
+	    10 != kp.parsed.i)
+		return(EXIT_FAILURE);
+
+	if ( ! check_email(" Foo.Bar@Example.COM ", "foo.bar@example.com") ||
+	    ! check_email("a+b@c.de", "a+b@c.de") ||
+	    ! check_email("a@b.c", NULL) ||
+	    ! check_email("@bar.com", NULL) ||
+	    ! check_email("foo@bar@baz.com", NULL) ||
+	    ! check_email("foo bar@baz.com", NULL) ||
+	    ! check_email("foobar.com", NULL))
+		return(EXIT_FAILURE);
+
+	if ( ! check_double("0") || ! check_double("-0") ||
+	    ! check_double("-0.0e10") || ! check_double(".5") ||
+	    ! check_double("5.") || ! check_double(".") ||
+	    ! check_double("1.2.3") || ! check_double("1e") ||
+	    ! check_double("1e+") || ! check_double(" 3.25") ||
+	    ! check_double("3.25 ") || ! check_double("1e30") ||
+	    ! check_double("1e-30") || ! check_double("1e400") ||
+	    ! check_double("0x1p3") || ! check_double("inf") ||
+	    ! check_double("9007199254740993") ||
+	    ! check_double("123456789012345678901234") ||
+	    ! check_double("0.000000000000000000000000001"))
+		return(EXIT_FAILURE);
+
+	for (i = 0; i < 100000; i++) {
+		j = arc4random_uniform(17) + 1;
+		snprintf(buf, sizeof(buf), "%.*g", (int)j, 
+			(arc4random() - (double)UINT32_MAX / 2) *
+			(arc4random() / (double)arc4random_uniform(
+			 UINT32_MAX - 1) + 1));
+		if ( ! check_double(buf))
+			return(EXIT_FAILURE);
+		snprintf(buf, sizeof(buf), "%" PRIu32 ".%.*" PRIu32,
+			arc4random(), (int)j, arc4random());
+		if ( ! check_double(buf))
+			return(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < 10000; i++) {
+		y = 1900 + arc4random_uniform(200);
+		m = 1 + arc4random_uniform(12);
+		d = 1 + arc4random_uniform(28);
+		snprintf(in, sizeof(in), "%.4" PRIu32 "-%.2" 
+			PRIu32 "-%.2" PRIu32, y, m, d);
+		if ( ! valid(kvalid_date, in, &kp, buf, sizeof(buf)) ||
+		    kp.parsed.i != kutil_date2epoch(d, m, y)) {
+			warnx("kvalid_date: %s: bad value", in);
+			return(EXIT_FAILURE);
+		}
+	}
+
+	if (valid(kvalid_date, "2016-1-01", &kp, buf, sizeof(buf)) ||
+	    valid(kvalid_date, "2016/01/01", &kp, buf, sizeof(buf)))
+		return(EXIT_FAILURE);
+
+	return(EXIT_SUCCESS);
+}
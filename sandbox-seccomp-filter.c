@@ -96,6 +96,9 @@ static const struct sock_filter preauth_ctrl[] = {
 	SC_ALLOW(accept),
 #endif
 	SC_ALLOW(fcntl),
+#ifdef __NR_getrandom /* arc4random(3) in newer glibc */
+	SC_ALLOW(getrandom),
+#endif
 #ifdef __NR_sendmsg /* not defined for __i386__ (linux) */
 	SC_ALLOW(sendmsg),
 #endif
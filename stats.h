@@ -0,0 +1,74 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Statistics shared between kfcgi(8) and its workers.
+ * The file given to kfcgi with "-M" consists of a struct kstats_hdr
+ * followed by "slots" struct kstats_slot, one per worker, with a pid of
+ * zero marking an empty slot.
+ * A slot is only emptied (and given to a new worker) once its worker
+ * has been reaped.
+ * kfcgi passes the file descriptor and slot index to workers in the
+ * KFCGI_STATS_FD and KFCGI_STATS_SLOT environment variables.
+ * Every field has only one writer at a time and is a naturally-aligned
+ * 64-bit integer, so we needn't lock: readers may only see the fields
+ * of a slot from slightly different moments.
+ */
+#define	KSTATS_MAGIC	0x6b66636769737431ULL /* "kfcgist1" */
+
+enum	kstats_state {
+	KSTATS_IDLE = 0, /* waiting for a connection */
+	KSTATS_PARSE, /* reading and parsing a request */
+	KSTATS_HANDLE /* in the application's handler */
+};
+
+/*
+ * The pool as a whole, written by kfcgi(8).
+ * The "busy", "queued", and "accepted" fields are only known to
+ * variable-sized pools, which accept connections themselves.
+ */
+struct	kstats_hdr {
+	uint64_t	 magic; /* KSTATS_MAGIC */
+	uint64_t	 slots; /* number of slots following */
+	uint64_t	 start; /* epoch when started */
+	uint64_t	 workers; /* running workers */
+	uint64_t	 busy; /* workers with a connection */
+	uint64_t	 queued; /* connections waiting for a worker */
+	uint64_t	 accepted; /* connections accepted */
+};
+
+/*
+ * One worker.
+ * The "pid" is set by kfcgi(8); the rest by the worker's kcgi(3)
+ * control process (when a connection arrives) and application.
+ * Times are in nanoseconds of the monotonic clock.
+ */
+struct	kstats_slot {
+	uint64_t	 pid; /* worker or 0 if the slot is empty */
+	uint64_t	 state; /* enum kstats_state */
+	uint64_t	 requests; /* requests served */
+	uint64_t	 bytesin; /* bytes read from connections */
+	uint64_t	 bytesout; /* bytes written to connections */
+	uint64_t	 parsens; /* total time parsing requests */
+	uint64_t	 handlens; /* total time in handlers */
+	uint64_t	 mark; /* when the current state began */
+	uint64_t	 last; /* epoch of last request finished or 0 */
+};
+
+#endif